@@ -4,6 +4,8 @@
 #include "list.h"
 #include "ip_utils.h"
 #include "bqueue.h"
+#include "ring_queue.h"
+#include "timer_wheel.h"
 
 /*#define RIP_DATA 200  
 #define TEST_DATA 0  
@@ -12,15 +14,20 @@
 
 //// some helpful static globals
 #define STDIN fileno(stdin)
-#define SELECT_TIMEOUT 1
+#define SELECT_TIMEOUT 1 // seconds between routing table timer checks
+#define IP_NODE_MAX_EVENTS 64 // max events handled per epoll_wait
+#define IP_NODE_PACKET_POOL_SLOTS 4096 // MTU sized receive buffers preallocated by the link interface thread
+#define IP_NODE_PACKET_POOL_HUGEPAGES 0 // set to back the receive buffers with hugepages
+#define IP_NODE_TO_SEND_CAPACITY 4096 // packets tcp can have queued up for ip to send
+#define IP_NODE_TO_READ_CAPACITY 4096 // packets ip can have queued up for tcp to handle
 
 typedef struct ip_node* ip_node_t; 
 
 /*alex created ip_thread_data struct to pass in following arguments to start: */
 struct ip_thread_data{
 	ip_node_t ip_node;
-	bqueue_t *to_send;
-	bqueue_t *to_read;
+	ring_queue_t to_send;
+	ring_queue_t to_read;
 	bqueue_t *stdin_commands;   // way for tcp_node to pass user input commands to ip_node
 };
 typedef struct ip_thread_data* ip_thread_data_t;
@@ -32,7 +39,8 @@ void ip_node_destroy(ip_node_t* ip_node);
 int ip_node_send_tcp(ip_node_t ip_node, tcp_packet_data_t packet);
 int ip_node_command(ip_node_t ip_node, const char* command);
 // NEIL NOTE THIS CHANGE: NEED TO MOVE PACKET INTO A tcp_packet_data by mallocing tcp_packet_data and appropriately filling it
-int ip_node_read(ip_node_t ip_node, char* packet, int packet_size, uint32_t remote_virt_ip, uint32_t local_virt_ip);
+// pool_buffer is the packet_pool buffer that packet points into (NULL if packet was malloc()ed) -- the tcp_packet_data takes over that reference
+int ip_node_read(ip_node_t ip_node, char* packet, int packet_size, uint32_t remote_virt_ip, uint32_t local_virt_ip, char* pool_buffer);
 void ip_node_stop(ip_node_t ip_node);
 
 void ip_node_print(ip_node_t ip_node);
@@ -48,6 +56,8 @@ int ip_node_running(ip_node_t ip_node);
 // returns ip address of remote side of passed in remote ip
 // returns 0 if remote ip unreachable
 uint32_t tcp_ip_node_get_local_ip(ip_node_t ip_node, uint32_t remote_ip);
+// the wheel every timer on the node should be armed on -- it's driven by the link interface thread
+timer_wheel_t ip_node_get_timer_wheel(ip_node_t ip_node);
 
 /****** FOR TESTING *******/
 
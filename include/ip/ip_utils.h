@@ -2,6 +2,7 @@
 #define __IP_UTILS_H__
 
 #include "link_interface.h"
+#include "mirror_buffer.h"
 #include <netinet/ip.h>
 
 #define RIP_DATA 200  
@@ -24,7 +25,13 @@ struct tcp_packet_data{
 	uint32_t local_virt_ip;
 	uint32_t remote_virt_ip;
 	char* packet;//char packet[MTU];
-	int packet_size;  //size of packet in bytes
+	int packet_size;  //size of packet in bytes (not counting payload)
+	char* pool_buffer; // if packet points into a packet_pool buffer, that buffer (released on destroy) -- otherwise NULL and packet is free()ed
+	int headroom;      // bytes free in front of packet (same malloc) for the ip header to be written into
+	char* payload;     // outgoing only: sent right after packet without being copied in
+	int payload_size;
+	char* payload_buffer; // the packet_pool buffer payload points into (released on destroy)...
+	mirror_buffer_t payload_ring; // ...or the mirror_buffer it does (same)
 };
 
 typedef struct tcp_packet_data* tcp_packet_data_t;
@@ -45,13 +52,22 @@ int ip_check_valid_packet(char* buffer, int bytes_read);
 uint32_t ip_get_dest_addr(char* buffer);
 // returns source address of packet
 uint32_t ip_get_src_addr(char* buffer);
-// decrements packet's TTL.
-// returns -1 if packet needs to be thrown out (if TTL == 0 when received)
+// returns protocol of packet (RIP_DATA, TCP_DATA, ...)
+int ip_get_protocol(char* buffer);
+// returns length of the ip header in bytes -- ie where the payload starts
+int ip_get_header_length(char* buffer);
+// decrements packet's TTL (keeping the checksum right).
+// returns -1 if packet needs to be thrown out (if its TTL runs out)
 int ip_decrement_TTL(char* packet);
 // Returns type: RIP vs other  --return -1 if bad packet
 // fills packet_unwrapped with data within packet
 int ip_unwrap_packet(char* buffer, char** packet_unwrapped, int packet_data_size);
 
+// fills in the ip header at buffer for data_len bytes of data following it
+void ip_fill_header(char* buffer, int data_len, int protocol, struct in_addr ip_src, struct in_addr ip_dst);
+// wraps ip header around data into a newly malloc()ed *wrapped (caller frees)
+// returns the total length of *wrapped
+int ip_wrap_packet(void* data, int data_len, int protocol, struct in_addr ip_src, struct in_addr ip_dst, char** wrapped);
 // wraps ip header around data and sends through link_interface li to destination
 int ip_wrap_send_packet(void* data, int data_len, int protocol, struct in_addr ip_src, struct in_addr ip_dst, link_interface_t li);
 // helper to node -- to call for sending an RIP packet across an interface -- calls ip_wrap_send_packet
@@ -9,6 +9,7 @@
 #include <inttypes.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netdb.h>
 #include <unistd.h>
 #include <netinet/in.h>
@@ -26,6 +27,8 @@
 
 /// Some configuration
 #define DISCARD_ON_WRONG_ADDRESS 1
+// max number of datagrams pulled/pushed with a single recvmmsg/sendmmsg
+#define LINK_INTERFACE_BATCH_SIZE 32
 
 typedef struct link_interface * link_interface_t;
 
@@ -49,6 +52,20 @@ int compare_remote_addr(struct sockaddr* a1, struct sockaddr* a2);
 // returns bytes_read on success, -1 on error or socket closure
 int link_interface_read_packet(link_interface_t l_i, char* buffer, int buffer_len);
 
+/* Batched versions of the above -- one syscall for up to LINK_INTERFACE_BATCH_SIZE datagrams */
+
+// sends num_packets packets (datas[i] of length data_lens[i]) with sendmmsg
+// returns number of packets sent, -1 on error/failure
+int link_interface_send_packets(link_interface_t li, void** datas, int* data_lens, int num_packets);
+// same as above but each packet is gathered from iovcnts[i] pieces, taken in order from iovecs
+// (so the headers and the data of a packet don't have to be next to each other in memory)
+int link_interface_send_iovecs(link_interface_t li, struct iovec* iovecs, int* iovcnts, int num_packets);
+// drains up to max_packets datagrams that are already waiting on the socket with recvmmsg (never blocks)
+// buffers[i] (each buffer_len long) is filled in and lengths[i] set to its bytes_read, or to
+// INTERFACE_ERROR_WRONG_ADDRESS if that datagram should be discarded
+// returns number of datagrams read (possibly 0), or INTERFACE_DOWN/INTERFACE_ERROR_FATAL
+int link_interface_read_packets(link_interface_t l_i, char** buffers, int* lengths, int buffer_len, int max_packets);
+
 // returns sfd	
 int link_interface_get_sfd(link_interface_t interface);
 // returns local_virt_ip
@@ -3,6 +3,7 @@
 
 #include <inttypes.h>
 #include "forwarding_table.h"
+#include "timer_wheel.h"
 
 #define INFINITY 16
 #define INTERNAL_INFORMATION 0
@@ -21,7 +22,9 @@ struct routing_info{
 
 typedef struct routing_table* routing_table_t;
 
-routing_table_t routing_table_init();
+/* routes that aren't refreshed for a while get set to INFINITY by timers on timer_wheel
+	(pass NULL for routes that never expire) -- and taken out of ft */
+routing_table_t routing_table_init(forwarding_table_t ft, timer_wheel_t timer_wheel);
 void routing_table_destroy(routing_table_t* rt);
 
 void update_routing_table(routing_table_t rt, 
@@ -39,6 +42,4 @@ struct routing_info* routing_table_RIP_response(routing_table_t rt, uint32_t ip,
 
 void routing_table_bring_down(routing_table_t rt, forwarding_table_t ft, uint32_t local_ip_dead_interface);
 
-void routing_table_check_timers(routing_table_t rt, forwarding_table_t ft);
-
 #endif // __ROUTING_TABLE_H__
@@ -0,0 +1,125 @@
+#ifndef __CONGESTION_CONTROL_H__
+#define __CONGESTION_CONTROL_H__
+
+#include <inttypes.h>
+#include "utils.h"
+
+/* Congestion control for the send_window.  The send_window never has more than cwnd bytes out on the
+   network (on top of the peer's window), and tells its congestion_control about everything that should
+   change that: new data getting acked, duplicate acks, and retransmission timeouts.
+
+   The bookkeeping every algorithm needs -- counting duplicate acks, fast retransmit on the third one,
+   and NewReno's fast recovery (RFC 6582) -- is done here.  What an algorithm actually does to cwnd and
+   ssthresh is up to its congestion_control_ops:
+
+	on_ack   some new data got acked outside of fast recovery -- grow cwnd
+	on_loss  three duplicate acks: a segment was lost -- set ssthresh and cwnd for fast recovery
+	         (cwnd gets inflated by the three segments that left the network afterwards)
+	on_rto   the retransmission timer went off -- set ssthresh and cwnd to start over from
+
+   With SACK, the send_window keeps a scoreboard of what the peer has and finds the lost segments itself
+   (RFC 6675), and starts recovery with congestion_control_enter_recovery.  The scoreboard also knows
+   exactly what's still out on the network, so recovery doesn't inflate or deflate the window at all.
+
+   init and destroy are for setting up and tearing down whatever the algorithm keeps in priv, and can be NULL.
+
+   Rate-based algorithms (BBR) go by on_rate_sample instead, which the send_window calls with a
+   delivery rate sample for every ack that acks something, and can set pacing_rate -- then the
+   send_window spaces its chunks out at that rate rather than sending the whole cwnd in one burst.
+   on_rate_sample is NULL and pacing_rate stays 0 for everything else.
+
+   Every time cwnd or ssthresh changes it gets written down in a little history (the last
+   CONGESTION_CONTROL_HISTORY changes), so you can see how the window's been evolving with
+   congestion_control_print. */
+
+#define DUP_ACK_THRESHOLD 3
+// RFC 5681's initial window
+#define CONGESTION_CONTROL_INITIAL_WINDOW(mss) (MIN(4*(mss), MAX(2*(mss), 4380)))
+#define CONGESTION_CONTROL_DEFAULT "newreno"
+#define CONGESTION_CONTROL_HISTORY 64
+
+typedef struct congestion_control* congestion_control_t;
+
+/* how fast data's been getting to the peer, from the chunk that just got acked (see draft-cheng-iccrg-delivery-rate-estimation)
+	delivered counts bytes acked since the connection started */
+struct congestion_control_rate_sample{
+	uint64_t delivered; // delivered as of now
+	uint64_t prior_delivered; // delivered when the chunk was sent
+	double interval; // how long it took prior_delivered to become delivered
+	double delivery_rate; // (delivered-prior_delivered)/interval in bytes per second, 0 if there's no good sample
+	uint32_t acked; // newly acked by this ack
+	uint32_t in_flight; // after this ack
+	double RTT; // 0 if this ack didn't give one
+	int app_limited; // we weren't sending as fast as we could when the chunk went out
+};
+
+struct congestion_control_ops{
+	const char* name;
+	void (*init)(congestion_control_t cc);
+	void (*destroy)(congestion_control_t cc);
+	// acked: how many new bytes got acked, RTT: the RTT sample this ack gave (0 if none)
+	void (*on_ack)(congestion_control_t cc, uint32_t acked, uint32_t in_flight, double RTT);
+	void (*on_loss)(congestion_control_t cc, uint32_t in_flight);
+	void (*on_rto)(congestion_control_t cc, uint32_t in_flight);
+	void (*on_rate_sample)(congestion_control_t cc, const struct congestion_control_rate_sample* rs);
+};
+
+// the algorithms we have
+extern const struct congestion_control_ops newreno_ops;
+extern const struct congestion_control_ops cubic_ops;
+extern const struct congestion_control_ops bbr_ops;
+
+struct congestion_control{
+	const struct congestion_control_ops* ops;
+	void* priv; // the algorithm's own state
+
+	uint32_t cwnd;
+	uint32_t ssthresh;
+	uint32_t mss;
+	double pacing_rate; // bytes per second -- 0 for no pacing
+
+	int dup_acks;
+	int in_recovery; // in fast recovery
+	uint32_t recover; // the highest seqnum sent when fast recovery started -- recovery's over once that's acked
+	int sack; // the send_window has a SACK scoreboard (see above)
+
+	// the history: a ring of the last CONGESTION_CONTROL_HISTORY changes, oldest at history_start
+	struct congestion_control_sample{
+		double time; // seconds since init
+		uint32_t cwnd;
+		uint32_t ssthresh;
+	} history[CONGESTION_CONTROL_HISTORY];
+	int history_start;
+	int history_count;
+	double start_time;
+};
+
+congestion_control_t congestion_control_init(const struct congestion_control_ops* ops, uint32_t mss);
+void congestion_control_destroy(congestion_control_t* cc);
+
+// looks up one of the algorithms we have by name -- NULL if there's no such thing
+const struct congestion_control_ops* congestion_control_find(const char* name);
+
+/* called by the send_window --
+	ack: the new ack, acked: bytes it newly acked, snd_nxt: the next seqnum to be sent,
+	in_flight: bytes sent and not acked (after this ack)
+	each returns 1 if the segment at the left of the window should be retransmitted right away */
+int congestion_control_on_ack(congestion_control_t cc, uint32_t ack, uint32_t acked, uint32_t in_flight, double RTT);
+int congestion_control_on_dup_ack(congestion_control_t cc, uint32_t snd_nxt, uint32_t in_flight);
+void congestion_control_on_rto(congestion_control_t cc, uint32_t in_flight);
+// the scoreboard found a lost segment: start fast recovery if we're not already in it (returns 1 if we weren't)
+int congestion_control_enter_recovery(congestion_control_t cc, uint32_t snd_nxt, uint32_t in_flight);
+void congestion_control_set_sack(congestion_control_t cc, int sack);
+// the MSS got negotiated -- only for before anything's been sent, since it starts cwnd over from the initial window
+void congestion_control_set_mss(congestion_control_t cc, uint32_t mss);
+void congestion_control_on_rate_sample(congestion_control_t cc, const struct congestion_control_rate_sample* rs);
+
+uint32_t congestion_control_get_cwnd(congestion_control_t cc);
+double congestion_control_get_pacing_rate(congestion_control_t cc);
+// prints the algorithm, cwnd, ssthresh, and how cwnd got there
+void congestion_control_print(congestion_control_t cc);
+
+// for the algorithms: gettimeofday in seconds
+double congestion_control_now();
+
+#endif // __CONGESTION_CONTROL_H__
@@ -2,22 +2,32 @@
 #define __RECV_WINDOW_H__
 
 #include <inttypes.h>
+#include <sys/uio.h>
 
 #include "utils.h"
 
 #define MAX_SEQNUM ((unsigned)-1)
+/* the most chunks the window will hang onto past a hole -- each one pins a packet_pool buffer, so past
+	that, out-of-order segments get dropped (they haven't been SACKed, so they'll be resent) */
+#define RECV_WINDOW_MAX_OUT_OF_ORDER 256
 
+/* a recv_chunk is a slice of a received packet -- data points somewhere inside of buffer,
+	the refcounted packet_pool buffer that the packet was read into, so that we can hang onto
+	segment text without copying it out of the packet */
 struct recv_chunk{
 	uint32_t seqnum;
 	void* data;
 	int length;
+	char* buffer;
+	struct recv_chunk* next; // the next one in its range when it's been received out of order, or the next one to read once it's in order
 };
 
 typedef struct recv_chunk* recv_chunk_t;
 
-recv_chunk_t recv_chunk_init(uint32_t seq, void* data, int l);
+// takes over a reference to buffer
+recv_chunk_t recv_chunk_init(uint32_t seq, void* data, int l, char* buffer);
 
-// this destroys the data it was holding!!
+// this releases the buffer it was holding!!
 void recv_chunk_destroy(recv_chunk_t* rc);
 
 //typedef struct recv_window_chunk* recv_window_chunk_t;
@@ -27,7 +37,7 @@ void recv_chunk_destroy(recv_chunk_t* rc);
 //void recv_window_chunk_destroy_free(recv_window_chunk_t* rwc);
 
 typedef struct recv_window* recv_window_t;
-recv_window_t recv_window_init(uint16_t window_size, uint32_t ISN);
+recv_window_t recv_window_init(uint32_t window_size, uint32_t ISN);
 void recv_window_destroy(recv_window_t* recv_window);
 /* allows us to decide if we should drop the packet or not right away 
 	pass in length 0
@@ -35,9 +45,31 @@ void recv_window_destroy(recv_window_t* recv_window);
 */
 int recv_window_validate_seqnum(recv_window_t recv_window, uint32_t seqnum, uint32_t length);
 pthread_cond_t* recv_window_get_read_condition(recv_window_t recv_window);
+// returns a malloc()ed copy of up to bytes of the next in-order data, NULL if there is none
 memchunk_t recv_window_get_next(recv_window_t window, int bytes);
+// copies up to bytes of the next in-order data straight into dest
+// returns the number of bytes copied, 0 if there was nothing to read
+int recv_window_read(recv_window_t window, void* dest, int bytes);
+// same, but fills the iovcnt buffers in iov one after the other
+int recv_window_readv(recv_window_t window, const struct iovec* iov, int iovcnt);
+/* fills iov with up to max slices of the next in-order data, pointing right into the packets it came in,
+	without taking it out of the window -- they stay good until recv_window_consume lets go of them (or 
+	recv_window_destroy does)
+	returns how many slices there are, 0 if there's nothing to read */
+int recv_window_peek(recv_window_t window, struct iovec* iov, int max);
+// takes the next bytes of in-order data out of the window (after a peek), returns how many it took
+int recv_window_consume(recv_window_t window, int bytes);
 uint32_t recv_window_get_ack(recv_window_t window);
-uint16_t recv_window_get_size(recv_window_t window);
+uint32_t recv_window_get_size(recv_window_t window);
+/* fills blocks with left and right edges (blocks[2*i], blocks[2*i+1]) of up to max blocks of data received
+	out of order, for SACKing -- the one that was added to most recently first
+	returns how many blocks there are */
+int recv_window_get_sack_blocks(recv_window_t window, uint32_t* blocks, int max);
+// stores the data directly, so give it something it can free
 void recv_window_receive(recv_window_t window, void* data, uint32_t length, uint32_t seqnum);
+/* same as above but data points into buffer, a packet_pool buffer -- the window takes its own 
+	references on buffer for whatever it keeps rather than copying the data, so the caller still 
+	has to release theirs. if buffer is NULL the data is copied */
+void recv_window_receive_buffer(recv_window_t window, void* data, uint32_t length, uint32_t seqnum, char* buffer);
 
 #endif // __RECV_WINDOW_H__
@@ -2,100 +2,148 @@
 #define __WINDOW_H__
 
 #include "utils.h"
+#include "congestion_control.h"
+#include "mirror_buffer.h"
 #include <inttypes.h>
 #include <sys/time.h>
 #include <time.h>
+#include <sys/uio.h>
 
-/* RFC:
-   An Example Retransmission Timeout Procedure
+/* RFC 6298 -- Computing TCP's Retransmission Timer
 
-      Measure the elapsed time between sending a data octet with a
-      particular sequence number and receiving an acknowledgment that
-      covers that sequence number (segments sent do not have to match
-      segments received).  This measured elapsed time is the Round Trip
-      Time (RTT).  Next compute a Smoothed Round Trip Time (SRTT) as:
+      When the first RTT measurement R is made, the host MUST set
 
-        SRTT = ( ALPHA * SRTT ) + ((1-ALPHA) * RTT)
+            SRTT <- R
+            RTTVAR <- R/2
+            RTO <- SRTT + max (G, K*RTTVAR)
 
-      and based on this, compute the retransmission timeout (RTO) as:
+      where K = 4.
 
-        RTO = min[UBOUND,max[LBOUND,(BETA*SRTT)]]
+      When a subsequent RTT measurement R' is made, a host MUST set
 
-      where UBOUND is an upper bound on the timeout (e.g., 1 minute),
-      LBOUND is a lower bound on the timeout (e.g., 1 second), ALPHA is
-      a smoothing factor (e.g., .8 to .9), and BETA is a delay variance
-      factor (e.g., 1.3 to 2.0).
-*/
-#define WINDOW_ALPHA 0.8
-#define WINDOW_BETA 1.5
-#define WINDOW_UBOUND 10 //10 seconds is the upper bound on the window RTO -- really long, right?
-#define WINDOW_LBOUND 0.001 //1 millisecond
+            RTTVAR <- (1 - beta) * RTTVAR + beta * |SRTT - R'|
+            SRTT <- (1 - alpha) * SRTT + alpha * R'
 
-#define WINDOW_CHUNK_SIZE 1024
-#define MAX_SEQNUM ((unsigned)-1)
-
-typedef struct send_window* send_window_t;
-
-/* RFC:     An Example Retransmission Timeout Procedure
+      The above SHOULD be computed using alpha=1/8 and beta=1/4.
 
-      Measure the elapsed time between sending a data octet with a
-      particular sequence number and receiving an acknowledgment that
-      covers that sequence number (segments sent do not have to match
-      segments received).  This measured elapsed time is the Round Trip
-      Time (RTT).  Next compute a Smoothed Round Trip Time (SRTT) as:
+   RTT measurements only ever come from chunks that were sent once (Karn's algorithm), and there's one
+   retransmission timer for the whole window rather than one per chunk: it's running whenever something's
+   out on the network, restarts every time an ack acks new data, and when it goes off the RTO doubles
+   (up to UBOUND) until a fresh measurement brings it back down.  G is however finely our timers can go off.
 
-        SRTT = ( ALPHA * SRTT ) + ((1-ALPHA) * RTT)
+   The RFC's 1 second minimum is for the internet -- ours are virtual links on one machine, so LBOUND is
+   what Linux uses instead, which is still well clear of any jitter we've got */
+#define WINDOW_ALPHA 0.125
+#define WINDOW_BETA 0.25
+#define WINDOW_K 4
+#define WINDOW_GRANULARITY 0.001 // the timer wheel's tick
+#define WINDOW_UBOUND 60 // the most the RFC lets the RTO be capped at
+#define WINDOW_LBOUND 0.2 //200 milliseconds
+#define WINDOW_INITIAL_RTO 1.0
 
-      and based on this, compute the retransmission timeout (RTO) as:
+#define WINDOW_CHUNK_SIZE 1024
+#define MAX_SEQNUM ((unsigned)-1)
 
-        RTO = min[UBOUND,max[LBOUND,(BETA*SRTT)]]
+typedef struct send_window* send_window_t;
 
-      where UBOUND is an upper bound on the timeout (e.g., 1 minute),
-      LBOUND is a lower bound on the timeout (e.g., 1 second), ALPHA is
-      a smoothing factor (e.g., .8 to .9), and BETA is a delay variance
-      factor (e.g., 1.3 to 2.0). */
+/* a segment that's been sent and not acked yet -- they live in a ring in the send_window (so a chunk from
+	get_next is only good until the window's unlocked).  send_time is when the chunk (last) went out 
+	-- only used for its RTT measurement, if it was only sent the once */
 struct send_window_chunk{
 	struct timeval send_time;
-	void* data;
+	void* data; // a slice of the window's send buffer (so it goes once the chunk's acked)
 	int resending;
 	int length;
 	int seqnum;
-	int offset;
-	int resent; /*number of times chunk has been resent so we can practice exponential backoff.  This will also
-					allow us to avoid effecting RTO incorrectly.  resent initialized at 0 */
+	int resent; /*number of times chunk has been resent, so that (Karn) its ack doesn't give an RTT 
+					measurement.  resent initialized at 0 */
+	int fast_retransmit; // queued up to be resent right away, no matter the congestion window
+	int sacked; // the peer SACKed it, so it never needs resending
+	int sack_lost; // the SACK scoreboard presumed it lost (which it only does once)
+
+	/* the window's delivery rate bookkeeping as of when this chunk (last) went out, for the rate
+		sample its ack gives congestion control */
+	uint64_t delivered;
+	double delivered_time;
+	double first_sent_time;
+	int app_limited;
 };
 
 typedef struct send_window_chunk* send_window_chunk_t;
 
-void send_window_chunk_destroy(send_window_chunk_t* wc);
-void send_window_chunk_destroy_total(send_window_chunk_t* wc, destructor_f destructor);
-void send_window_chunk_destroy_free(send_window_chunk_t* wc);
-
 void send_window_set_seq(send_window_t sc, uint32_t seq);
 
 send_window_t send_window_init(int window_size, int send_size, int ISN, 
 								double ALPHA, double BETA, double UBOUND, double LBOUND);
 void send_window_destroy(send_window_t* send_window);
+/* starts the window over (same arguments as init) as though it had just been made, whatever's buffered
+	and in flight included -- but keeps its socket options and which congestion control it uses */
+void send_window_reset(send_window_t send_window, int window_size, int send_size, int ISN);
 
 // use syn-timeout same as send_window RTO -- so we need to get it
 double send_window_get_RTO(send_window_t send_window);
 void send_window_set_size(send_window_t send_window, uint32_t size);
-void send_window_push(send_window_t send_window, void* data, int length);
+/* both push no more than fits in the send buffer (see send_window_set_buffer) and return how much that was
+	-- pushv pushes the iovcnt buffers in iov one after the other, all at once */
+int send_window_push(send_window_t send_window, void* data, int length);
+int send_window_pushv(send_window_t send_window, const struct iovec* iov, int iovcnt);
+/* the send buffer: there's never more than size bytes pushed and not acked yet (unsent or in flight),
+	and it's writable again once that's down to low_watermark */
+void send_window_set_buffer(send_window_t send_window, uint32_t size, uint32_t low_watermark);
+int send_window_writable(send_window_t send_window);
 /* Alex wants to be able to use this for closing purposes as well
 	-- so if there are no more timers to check -- all data sent successfully acked 
 	-- then we cant continue with close
 	returns 0 if no more outstanding segmements -- all data sent acked
 	returns > 0 number for remaining outstanding segments 
-	NEIL -- PLEASE CHECK THAT I DID THIS RIGHT */
+	NEIL -- PLEASE CHECK THAT I DID THIS RIGHT 
+	(if the retransmission timer's gone off, everything outstanding gets queued up to be resent) */
 int send_window_check_timers(send_window_t send_window);
+/* when (seconds, on the gettimeofday clock) the retransmission timer goes off, 
+	0 if it isn't running (nothing sent is waiting on an ack) */
+double send_window_get_next_timeout(send_window_t send_window);
+// when pacing lets the next chunk go out, 0 if there's nothing being held back for it
+double send_window_get_next_send_time(send_window_t send_window);
 int send_window_validate_ack(send_window_t send_window, uint32_t ack);
-void send_window_ack(send_window_t send_window, int index);
+/* index is the ack, seg_len how much of the sequence space the segment it came on takes up (its data, 
+	plus one each for SYN and FIN) -- only segments with none count as duplicate acks (RFC 5681) */
+void send_window_ack(send_window_t send_window, int index, int seg_len);
+/* blocks are the n left and right edge pairs from a SACK option -- call it before send_window_ack
+	for the same segment, which does the loss detection */
+void send_window_sack(send_window_t send_window, uint32_t* blocks, int n);
+// whether the peer SACKs (it has to have said so on its SYN), off to start with
+void send_window_set_sack(send_window_t send_window, int sack);
+/* how big the chunks are -- the MSS, once the SYNs have settled it.  For before anything's been
+	sent: the congestion control starts over from its initial window for the new size */
+void send_window_set_mss(send_window_t send_window, int mss);
+/* segments smaller than a chunk: with nagle (on to start with) they wait until everything that's out
+	has been acked, corked they wait until it's uncorked -- either way to go out with whatever gets pushed
+	in the meantime */
+void send_window_set_nagle(send_window_t send_window, int nagle);
+void send_window_set_cork(send_window_t send_window, int cork);
+// nothing more is getting pushed (we're closing): send whatever's left, however small
+void send_window_flush(send_window_t send_window);
 void send_window_resize(send_window_t send_window, int size);
 uint32_t send_window_get_next_seq(send_window_t send_window);
+// bytes that have been pushed but haven't made it into a chunk yet (so have never been sent)
+int send_window_get_unsent(send_window_t send_window);
 send_window_chunk_t send_window_get_next(send_window_t send_window);
+// same as get_next, but rather than the chunk (which an ack can free as soon as the window is unlocked)
+// gives back its seqnum, its data, and a reference to what the data points into: either the send buffer
+// itself (ring, which the caller must mirror_buffer_release) or a packet_pool buffer with a copy in it 
+// (buffer, which the caller must packet_pool_release) -- the other one's NULL.  returns length of the 
+// data, 0 if there's nothing to send
+int send_window_get_next_data(send_window_t send_window, uint32_t* seqnum, char** data, char** buffer, mirror_buffer_t* ring);
 
 // needed for driver window_cmd
 int send_window_get_size(send_window_t send_window);
+uint32_t send_window_get_cwnd(send_window_t send_window);
+
+/* switches to another congestion control algorithm (the window starts off with CONGESTION_CONTROL_DEFAULT)
+	starts the new one off from scratch */
+void send_window_set_congestion_control(send_window_t send_window, const struct congestion_control_ops* ops);
+// prints what the congestion control is up to
+void send_window_print_congestion_control(send_window_t send_window);
 
 
 void send_window_print(send_window_t send_window);
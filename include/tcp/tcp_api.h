@@ -5,11 +5,26 @@
 #include "tcp_node.h"
 #include "tcp_connection.h"
 #include "utils.h"
+#include <sys/uio.h>
 
 #define SHUTDOWN_READ 2
 #define SHUTDOWN_WRITE 1
 #define SHUTDOWN_BOTH 3
 
+/* socket options for tcp_api_setsockopt -- same numbers as linux's (we don't include netinet/tcp.h) */
+#ifndef TCP_NODELAY
+#define TCP_NODELAY 1
+#endif
+#ifndef TCP_CORK
+#define TCP_CORK 3
+#endif
+#ifndef SO_SNDBUF
+#define SO_SNDBUF 7
+#endif
+#ifndef SO_SNDLOWAT
+#define SO_SNDLOWAT 19
+#endif
+
 //forward declaration:
 struct tcp_connection;
 
@@ -39,14 +54,36 @@ int tcp_api_args_destroy(tcp_api_args_t* args);
 /* connects a socket to an address (active OPEN in the RFC)
 returns 0 on success or a negative number on failure */
 int tcp_api_connect(struct tcp_node* node, int socket, struct in_addr* addr, uint16_t port);
+/* just the first half of tcp_api_connect -- sends the SYN and returns without waiting for the handshake
+returns 1 on success or a negative number on failure */
+int tcp_api_connect_start(struct tcp_node* node, int socket, struct in_addr* addr, uint16_t port);
 void* tcp_api_connect_entry(void* args);
 
 /* write on an open socket (SEND in the RFC)
-return num bytes written or negative number on failure */
+if the socket's send buffer fills up, blocks until it's drained down to its low watermark (see SO_SNDBUF)
+return num bytes written or negative number on failure -- less than num_bytes if the connection 
+stopped being writable partway through */
 int tcp_api_write(tcp_node_t tcp_node, int socket, const unsigned char* to_write, uint32_t num_bytes);
+/* same, for the iovcnt buffers in iov one after the other (behave like unix's writev) */
+int tcp_api_writev(tcp_node_t tcp_node, int socket, const struct iovec* iov, int iovcnt);
+/* same as tcp_api_write but never blocks: writes as much as fits in the send buffer
+return num bytes written, -EAGAIN if none of it fit, or negative number on failure */
+int tcp_api_write_nonblocking(tcp_node_t tcp_node, int socket, const unsigned char* to_write, uint32_t num_bytes);
 
 void* tcp_api_sendfile_entry(void* _args);
 
+/* sets/gets a socket option (value is 0 for off, 1 for on):
+	TCP_NODELAY  turns off Nagle's algorithm -- small writes go out right away, rather than waiting
+	             to be sent along with the next ones until what's out on the network gets acked
+	TCP_CORK     holds back anything smaller than a full segment until it's turned back off 
+or a size in bytes:
+	SO_SNDBUF    how much written data (sent or not) the socket holds onto until it's acked -- 
+	             writes block once it's full (DEFAULT_SEND_BUFFER_SIZE to start with)
+	SO_SNDLOWAT  how far that has to drain before blocked writes go on (DEFAULT_SEND_LOW_WATERMARK)
+returns 0 on success or negative number on failure */
+int tcp_api_setsockopt(tcp_node_t tcp_node, int socket, int option, int value);
+int tcp_api_getsockopt(tcp_node_t tcp_node, int socket, int option, int* value);
+
 int tcp_api_socket(struct tcp_node* node);
 /* binds a socket to a port
 always bind to all interfaces - which means addr is unused.
@@ -67,6 +104,18 @@ void* tcp_api_recvfile_entry(void* _args);
 return num bytes read or negative number on failure or 0 on eof */
 //int v read(int socket, unsigned char *buf, uint32 t nbyte);
 int tcp_api_read(tcp_node_t tcp_node, int socket, char *buffer, uint32_t nbyte);
+/* same, but fills the iovcnt buffers in iov one after the other (behave like unix's readv) */
+int tcp_api_readv(tcp_node_t tcp_node, int socket, const struct iovec* iov, int iovcnt);
+/* looks at what there is to read without copying it or reading it: fills iov with up to max slices of it, 
+pointing right at it where it sits in the window.  they stay good until tcp_api_consume gets past them, or
+until the window goes away -- which it does when the connection closes, is reset or gets aborted, whether
+or not they've been consumed -- so don't close the socket while you're still looking at them, and copy out
+anything that has to outlive a reset.
+returns how many slices there are (0 if nothing's come in yet), or what tcp_api_read would on eof/failure */
+int tcp_api_peek(tcp_node_t tcp_node, int socket, struct iovec* iov, int max);
+/* reads nbyte bytes without copying them anywhere -- for after tcp_api_peek
+returns num bytes consumed, or what tcp_api_read would on eof/failure */
+int tcp_api_consume(tcp_node_t tcp_node, int socket, uint32_t nbyte);
 void* tcp_api_read_entry(void* _args);
 
 void* tcp_driver_accept_entry(void* args);
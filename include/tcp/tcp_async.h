@@ -0,0 +1,63 @@
+#ifndef __TCP_ASYNC_H__
+#define __TCP_ASYNC_H__
+
+#include <inttypes.h>
+#include <time.h>
+#include "tcp_api.h"
+
+/* An io_uring-style way of calling the tcp_api without a thread per call (which is what tcp_node_thread
+   and all the *_entry functions do).  The application gets a submission entry, fills it in, and submits;
+   the ops get started right there in tcp_async_submit, and whatever can't finish right away (a read
+   with nothing to read yet, a connect waiting on the handshake, ...) is parked on its connection.
+   The connection hands the op each of its api signals from then on -- on whichever worker is running
+   it -- until the op is done, and done ops show up on the completion queue for tcp_async_reap.
+
+   A tcp_async_t belongs to ONE application thread: get_sqe, submit and reap all have to be called
+   from it.  There are never more than `entries` ops in flight, so the completion queue can't overflow
+   (tcp_async_get_sqe returns NULL until something gets reaped).
+
+   Don't mix these with the blocking tcp_api calls on the same socket, and reap everything you submitted
+   before destroying it (or the tcp_node). */
+
+#define TCP_ASYNC_READ 1	// into buffer, up to length bytes. result: bytes read, 0 on eof
+#define TCP_ASYNC_WRITE 2	// length bytes of buffer. result: bytes written (only what fit in the send buffer, -EAGAIN if none of it did)
+#define TCP_ASYNC_CONNECT 3	// to addr:port. result: 0 once ESTABLISHED
+#define TCP_ASYNC_ACCEPT 4	// on a listening socket. result: the new socket once it's ESTABLISHED
+#define TCP_ASYNC_CLOSE 5	// result: 0 once the connection is closed (the socket is gone once reaped)
+
+// results are negative errno values on failure, -ECANCELED if the connection got destroyed under the op
+
+struct tcp_async_sqe{
+	int opcode;
+	int socket;
+	char* buffer;
+	uint32_t length;
+	struct in_addr addr;
+	uint16_t port;
+	uint64_t user_data; // handed back untouched in the cqe
+};
+
+struct tcp_async_cqe{
+	uint64_t user_data;
+	int result;
+};
+
+typedef struct tcp_async* tcp_async_t;
+
+tcp_async_t tcp_async_init(tcp_node_t tcp_node, int entries);
+void tcp_async_destroy(tcp_async_t* async);
+
+// a zeroed out sqe to fill in, or NULL if there are already `entries` ops in flight
+struct tcp_async_sqe* tcp_async_get_sqe(tcp_async_t async);
+// starts every sqe gotten since the last submit (in order) -- returns how many
+int tcp_async_submit(tcp_async_t async);
+/* fills up to max cqes, blocking until at least one op completes or the absolute time abs_timeout
+	(NULL to wait forever).  returns how many were filled -- 0 on timeout or if nothing is in flight */
+int tcp_async_reap(tcp_async_t async, struct tcp_async_cqe* cqes, int max, const struct timespec* abs_timeout);
+
+/* for tcp_connection: hands event (whatever the connection api signalled) to op, which is parked on connection
+	returns 0 if op is still waiting on connection, 1 if it's done with it */
+struct tcp_async_op;
+int tcp_async_op_event(struct tcp_async_op* op, struct tcp_connection* connection, int event);
+
+#endif // __TCP_ASYNC_H__
@@ -4,10 +4,12 @@
 #include <inttypes.h>
 //#include <netinet/tcp.h> -- we define it in utils.h!
 #include "bqueue.h"
+#include "ring_queue.h"
 #include "send_window.h"
 #include "recv_window.h"
 #include "state_machine.h"
 #include "tcp_node.h"
+#include "tcp_worker.h"
 #include "int_queue.h"
 
 /* for api signaling */
@@ -22,6 +24,10 @@
 
 #define BACKOFF_MULTIPLER 2 //set back to 1
 #define SYN_COUNT_MAX 5 // how many syns we send before timing out
+#define TCP_CONNECTION_TO_READ_CAPACITY 1024 // packets tcp_node can have queued up for a connection
+#define TCP_CONNECTION_RUN_BUDGET 64 // packets a connection gets to handle each time its worker runs it
+#define TCP_DELAYED_ACK_SEGMENTS 2 // ack at least every this many in-order segments
+#define TCP_DELAYED_ACK_TIMEOUT 0.04 // seconds we'll sit on an ack for in-order data (RFC 1122 says < 0.5)
 /* TIMEOUTS DEFINED BY RFC:
       Timeouts
 
@@ -41,7 +47,7 @@ if it is believed that will lead to better operation. */
 
 typedef struct tcp_connection* tcp_connection_t;  
 
-tcp_connection_t tcp_connection_init(tcp_node_t tcp_node, int socket, bqueue_t *to_send);
+tcp_connection_t tcp_connection_init(tcp_node_t tcp_node, int socket, ring_queue_t to_send);
 void tcp_connection_destroy(tcp_connection_t *connection);
 
 /*
@@ -74,6 +80,14 @@ void tcp_connection_api_cancel(tcp_connection_t connection);
 void tcp_connection_api_signal(tcp_connection_t connection, int ret);
 void tcp_connection_api_lock(tcp_connection_t connection);
 void tcp_connection_api_unlock(tcp_connection_t connection);
+
+/* for tcp_async: an op that's waiting on this connection gets parked on it, and is then handed
+	every api signal the connection makes until it says it's done (see tcp_async_op_event)
+	park with the async lock held */
+struct tcp_async_op;
+void tcp_connection_async_lock(tcp_connection_t connection);
+void tcp_connection_async_unlock(tcp_connection_t connection);
+void tcp_connection_async_park(tcp_connection_t connection, struct tcp_async_op* op);
 int tcp_connection_api_result(tcp_connection_t connection);
 
 int tcp_connection_get_socket(tcp_connection_t connection);
@@ -87,14 +101,28 @@ recv_window_t tcp_connection_recv_window_init(tcp_connection_t connection, uint3
 void tcp_connection_recv_window_destroy(tcp_connection_t connection);
 */
 recv_window_t tcp_connection_get_recv_window(tcp_connection_t connection);
+// picks the congestion control algorithm for this connection, starting right away
+void tcp_connection_set_congestion_control(tcp_connection_t connection, const struct congestion_control_ops* ops);
 send_window_t tcp_connection_get_send_window(tcp_connection_t connection);
+// TCP_NODELAY and TCP_CORK (see tcp_api_setsockopt)
+void tcp_connection_set_nodelay(tcp_connection_t connection, int nodelay);
+void tcp_connection_set_cork(tcp_connection_t connection, int cork);
+int tcp_connection_get_nodelay(tcp_connection_t connection);
+int tcp_connection_get_cork(tcp_connection_t connection);
+// SO_SNDBUF and SO_SNDLOWAT (see tcp_api_setsockopt)
+void tcp_connection_set_send_buffer(tcp_connection_t connection, uint32_t size, uint32_t low_watermark);
+uint32_t tcp_connection_get_send_buffer(tcp_connection_t connection);
+uint32_t tcp_connection_get_send_low_watermark(tcp_connection_t connection);
 
 /******* End of Window getting and setting and destroying functions *********/
 
-/*0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0 to_read Thread o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0*/
+/*0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0 Running on the worker o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0*/
 
-// runs thread for tcp_connection to handle sending/reading and keeping track of its packets/acks
-void *_handle_read_send(void *tcpconnection);
+// puts the connection on its worker's run queue (if it isn't already) -- for anything that the connection needs to react to
+void tcp_connection_schedule(tcp_connection_t connection);
+/* for the worker to call: handles sending/reading and keeping track of its packets/acks
+	returns 1 if there's still more to do and it should be scheduled again */
+int tcp_connection_run(tcp_connection_t connection);
 
 /************* Functions regarding the accept queue ************************/
 	/* The accept queue is initialized when the server goes into the listen state.  
@@ -105,11 +133,15 @@ void tcp_connection_accept_queue_init(tcp_connection_t connection);
 void tcp_connection_accept_queue_destroy(tcp_connection_t connection);
 //void tcp_connection_accept_queue_connect(tcp_connection_t connection, accept_queue_triple_t triple);
 accept_queue_data_t tcp_connection_accept_queue_dequeue(tcp_connection_t connection);
+// never blocks -- NULL if nothing is queued
+accept_queue_data_t tcp_connection_accept_queue_trydequeue(tcp_connection_t connection);
 
 
 /************* End of Functions regarding the accept queue ************************/
 
 void tcp_connection_set_last_seq_received(tcp_connection_t connection, uint32_t seq);
+// what the other side offered on its SYN (or SYN/ACK) -- decides whether we SACK
+void tcp_connection_set_syn_options(tcp_connection_t connection, const struct tcp_syn_options* options);
 
 /*
 uint32_t tcp_connection_get_last_seq_received(tcp_connection_t connection);
@@ -137,11 +169,11 @@ void tcp_connection_handle_syn_ack(tcp_connection_t connection, tcp_packet_data_
 	Queues info necessary to create a new connection when accept called 
 	returns 0 on success, negative if failed -- ie queue destroyed */
 int tcp_connection_handle_syn_LISTEN(tcp_connection_t connection, 
-		uint32_t local_ip,uint32_t remote_ip, uint16_t remote_port, uint32_t seqnum);
+		uint32_t local_ip,uint32_t remote_ip, uint16_t remote_port, uint32_t seqnum, const struct tcp_syn_options* options);
 
 
 /* Function for tcp_node to call to place a packet on this connection's
-	my_to_read queue for this connection to handle in its _handle_read_send thread 
+	my_to_read queue for this connection to handle the next time its worker runs it
 	returns 1 on success, 0 on failure */
 int tcp_connection_queue_to_read(tcp_connection_t connection, tcp_packet_data_t tcp_packet);
 
@@ -151,14 +183,15 @@ void tcp_connection_handle_receive_packet(tcp_connection_t connection, tcp_packe
 /******* Sending Packets **************/
 
 // puts tcp_packet_data_t on to to_send queue
-// returns 1 on success, -1 on failure (failure when queue actually already destroyed)
+// returns 1 on success, negative on failure (queue already destroyed, or full)
 int tcp_connection_queue_ip_send(tcp_connection_t connection, tcp_packet_data_t packet);
 
 int tcp_wrap_packet_send(tcp_connection_t connection, struct tcphdr* header, void* data, int data_len);
 
 // pushes data to send_window for window to break into chunks which we can call get next on
 // meant to be used before tcp_connection_send_next
-void tcp_connection_push_data(tcp_connection_t connection, void* to_write, int num_bytes);
+// returns how much of it fit in the send buffer
+int tcp_connection_push_data(tcp_connection_t connection, void* to_write, int num_bytes);
 //##TODO##
 // queues chunks off from send_window and handles sending them for as long as send_window wants to send more chunks
 int tcp_connection_send_next(tcp_connection_t connection);
@@ -168,6 +201,11 @@ void tcp_connection_refuse_connection(tcp_connection_t connection, tcp_packet_da
 int tcp_connection_ABORT(tcp_connection_t connection);
 // called by v_write
 int tcp_connection_send_data(tcp_connection_t connection, const unsigned char* to_write, int num_bytes);
+/* called by v_writev -- the same, for the iovcnt buffers in iov one after the other
+	when the send buffer fills up, this blocks until it drains down to its low watermark and keeps going,
+	unless it's nonblocking -- then it just returns what fit (-EAGAIN if nothing did)
+	returns num bytes written or negative number on failure */
+int tcp_connection_send_datav(tcp_connection_t connection, const struct iovec* iov, int iovcnt, int nonblocking);
 void tcp_connection_ack(tcp_connection_t connection, uint32_t ack);
 /******* End of Sending Packets **************/
 //////////////////////////////////////////////////////////////////////////////////////
@@ -9,11 +9,13 @@
 typedef struct tcp_node* tcp_node_t;
 
 #include "ip_node.h"
+#include "tcp_worker.h"
 #include "list.h"
 #include "tcp_api.h"
 
 /* set artificially low right now so we can make sure have no segfaults if ever reach limit */
 #define MAX_FILE_DESCRIPTORS 1024 // per process limit commonly set to 1024 on mac and linux machines
+#define TCP_NODE_WORKERS 4 // threads that all the connections get run on
 
 //// some helpful static globals
 #define IP_HEADER_SIZE sizeof(struct ip)
@@ -33,8 +35,8 @@ struct tcp_connection;
 //alex created ip_thread_data struct to pass in following arguments to start:
 	struct ip_thread_data{
 		ip_node_t ip_node;
-		bqueue_t *to_send;
-		bqueue_t *to_read;
+		ring_queue_t to_send;
+		ring_queue_t to_read;
 		bqueue_t *stdin_commands;   // way for tcp_node to pass user input commands to ip_node
 	};
 // data type that to_send and to_read queues will store (ie queue and dequeue) -- need vip's associated with packet
@@ -61,6 +63,10 @@ void tcp_node_start(tcp_node_t tcp_node);
 
 // returns tcp_node->running
 int tcp_node_running(tcp_node_t tcp_node);
+// the ip_node's timer wheel, for the connections' timers
+timer_wheel_t tcp_node_get_timer_wheel(tcp_node_t tcp_node);
+// the worker whose shard a connection on socket belongs in
+tcp_worker_t tcp_node_get_worker(tcp_node_t tcp_node, int socket);
 /* ***************************** */
 
 /******** Commands Regarding Kernal **********************/
@@ -127,6 +133,8 @@ void tcp_node_refuse_connection(tcp_node_t tcp_node, tcp_packet_data_t packet);
 // returned int is the new socket assigned to that new connection.  The connection finishes its handshake to get to
 // 	established state
 struct tcp_connection* tcp_node_connection_accept(tcp_node_t tcp_node, struct tcp_connection* listening_connection);
+// same, but with a triple that was already dequeued (which it destroys)
+struct tcp_connection* tcp_node_connection_accept_data(tcp_node_t tcp_node, struct tcp_connection* listening_connection, accept_queue_data_t data);
 
 /*********** For use by tcp_node to reach ip_node items ****************/
 // returns ip address of remote side of passed in remote ip
@@ -7,16 +7,55 @@
 #include "ip_utils.h" // tcp_packet_data_t and its associated functions defined there
 
 #define TCP_HEADER_MIN_SIZE 20
+// options can take the header up to 60 bytes
+#define TCP_OPTIONS_MAX_SIZE 40
+// room left in front of every header from tcp_header_init so that ip can put its header there without copying
+#define TCP_HEADROOM IP_HEADER_SIZE
 
 #define WINDOW_DEFAULT_TIMEOUT 3.0
 
 #define ACCEPT_QUEUE_DEFAULT_SIZE 10
 
 #define DEFAULT_TIMEOUT 12.0
-#define DEFAULT_WINDOW_SIZE ((uint16_t)30000)
-#define DEFAULT_WINDOW_CHUNK_SIZE 1000
+/* with window scaling (RFC 7323) the receive window can be bigger than the 16 bits in the header -- 
+	we advertise it shifted down by DEFAULT_WINDOW_SCALE, the smallest shift that fits it in there.  
+	If the other side doesn't do window scaling, it only ever hears about the first 64K of it */
+#define DEFAULT_WINDOW_SIZE ((uint32_t)262144)
+#define DEFAULT_WINDOW_SCALE 3
+/* how much a socket will hold onto that the peer hasn't acked yet (whether it's been sent or not) before 
+	writes block, and how far that has to drain before they wake back up (SO_SNDBUF and SO_SNDLOWAT) */
+#define DEFAULT_SEND_BUFFER_SIZE (4*DEFAULT_WINDOW_SIZE)
+#define DEFAULT_SEND_LOW_WATERMARK (DEFAULT_SEND_BUFFER_SIZE/2)
+#define TCP_WINDOW_SCALE_MAX 14
+#define TCP_WINDOW_MAX 0xffff
+/* MSS: the most segment text we'll take in one segment -- whatever fits in one of our IP packets behind 
+	a bare TCP header (all our links have the same MTU).  We tell the other side on our SYN, and if they
+	don't tell us theirs we have to go by the RFC's default (RFC 9293) */
+#define TCP_MSS ((int)(MTU - TCP_HEADER_MIN_SIZE))
+#define TCP_DEFAULT_MSS 536
+// the least MSS we'll go along with -- a peer asking for less would have us sending mostly headers
+#define TCP_MIN_MSS 88
+#define DEFAULT_WINDOW_CHUNK_SIZE TCP_DEFAULT_MSS // until we've heard their MSS
 #define RAND_ISN() rand()
 
+/* option kinds (RFC 793, RFC 7323, RFC 2018) */
+#define TCP_OPTION_END 0
+#define TCP_OPTION_NOP 1
+#define TCP_OPTION_MSS 2
+#define TCP_OPTION_WSCALE 3
+#define TCP_OPTION_SACK_PERMITTED 4
+#define TCP_OPTION_SACK 5
+
+// the most SACK blocks that fit in an option (each is a left and right edge)
+#define TCP_SACK_MAX_BLOCKS 4
+
+/* what the other side offered on its SYN (or SYN/ACK) */
+struct tcp_syn_options{
+	int sack_permitted;
+	int window_scale; // the shift count, -1 if they didn't offer window scaling
+	int mss; // 0 if they didn't send one
+};
+
 /*// a tcp_connection in the listen state queues this triple on its accept_queue when
 // it receives a syn.  Nothing further happens until the user calls accept at which point
 // this triple is dequeued and a connection is initiated with this information
@@ -26,15 +65,18 @@ struct accept_queue_data{
 	uint32_t remote_ip;
 	uint16_t remote_port;
 	uint32_t last_seq_received;
+	struct tcp_syn_options options;
 };*/
 typedef struct accept_queue_data* accept_queue_data_t;
-accept_queue_data_t accept_queue_data_init(uint32_t local_ip,uint32_t remote_ip,uint16_t remote_port,uint32_t last_seq_received);
+accept_queue_data_t accept_queue_data_init(uint32_t local_ip,uint32_t remote_ip,uint16_t remote_port,uint32_t last_seq_received,
+												const struct tcp_syn_options* options);
 void accept_queue_data_destroy(accept_queue_data_t* data);
 /* Getting functions for accept_queue_data_t */
 uint32_t accept_queue_data_get_local_ip(accept_queue_data_t data);
 uint32_t accept_queue_data_get_remote_ip(accept_queue_data_t data);
 uint16_t accept_queue_data_get_remote_port(accept_queue_data_t data);
 uint32_t accept_queue_data_get_seq(accept_queue_data_t data);
+const struct tcp_syn_options* accept_queue_data_get_syn_options(accept_queue_data_t data);
 
 
 /* tcp_connection_tosend_data_t is what is loaded on and off each tcp_connection's my_to_send queue */
@@ -242,7 +284,27 @@ struct memchunk* tcp_unwrap_data(void* packet, int length);
 	#define tcp_set_urg_bit(header) ((((struct tcphdr*)header)->th_flags) |= (1 << URG_BIT)) // set the urg bit to 1
 #endif
 
+// mallocs a zeroed header with room for TCP_OPTIONS_MAX_SIZE bytes of options and data_size bytes
+// after that, and TCP_HEADROOM bytes in front of it
 struct tcphdr* tcp_header_init(int data_size);
+void tcp_header_destroy(struct tcphdr* header);
+
+/* tacks an option (kind, then length, then len bytes of value) onto the end of a header from tcp_header_init,
+	NOP padded so that it takes up whole words, and moves the data offset past it
+	returns 0 on success, -1 if there isn't room for it */
+int tcp_header_add_option(struct tcphdr* header, uint8_t kind, void* value, int len);
+/* looks for an option of kind in a received header (length is the whole tcp packet's, to make sure a bad
+	offset doesn't send us off the end of it).  points value at the option's value
+	returns the length of the value, -1 if there's no such option */
+int tcp_header_find_option(struct tcphdr* header, int length, uint8_t kind, void** value);
+// fills in options from a received SYN or SYN/ACK
+void tcp_utils_get_syn_options(struct tcphdr* header, int length, struct tcp_syn_options* options);
+
+// wraps a header from tcp_header_init (and optionally a payload sent right after it without being copied 
+// in, which points into the packet_pool buffer payload_buffer or the mirror_buffer payload_ring) into a 
+// tcp_packet_data for the to_send queue -- takes over the header and the reference to whichever isn't NULL
+tcp_packet_data_t tcp_utils_outgoing_packet(struct tcphdr* header, int header_len, char* payload, int payload_len, 
+												char* payload_buffer, mirror_buffer_t payload_ring, uint32_t local_ip, uint32_t remote_ip);
 
 // takes in data and wraps data in header with correct addresses.  
 // frees parameter data and mallocs new packet  -- sets data to point to new packet
@@ -255,6 +317,9 @@ struct tcphdr* tcp_header_init(int data_size);
 
 uint16_t tcp_utils_calc_checksum(void* packet, uint16_t total_length, uint32_t src_ip, uint32_t dest_ip, uint16_t proto);
 void tcp_utils_add_checksum(void* packet, uint16_t  total_length, uint32_t src_ip, uint32_t dest_ip, uint16_t proto);
+// same as the above but for a header (of even length) and data that aren't next to each other in memory
+uint16_t tcp_utils_calc_checksum_sg(void* header, int header_len, void* data, int data_len, uint32_t src_ip, uint32_t dest_ip, uint16_t proto);
+void tcp_utils_add_checksum_sg(void* header, int header_len, void* data, int data_len, uint32_t src_ip, uint32_t dest_ip, uint16_t proto);
 int tcp_utils_validate_checksum(void* packet, uint16_t total_length, uint32_t src_ip, uint32_t dest_ip, uint16_t proto);
 
 
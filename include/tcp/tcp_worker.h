@@ -0,0 +1,34 @@
+#ifndef __TCP_WORKER_H__
+#define __TCP_WORKER_H__
+
+#include "ring_queue.h"
+
+/* Rather than every tcp_connection having a thread of its own, the tcp_node has a fixed pool of
+   TCP_NODE_WORKERS workers, and each connection belongs to one of them for its whole life.  A worker
+   runs an event loop over its shard of connections: whenever something happens to a connection
+   (a packet for it shows up, its timer goes off, the api gives it something to send) the connection
+   gets scheduled on its worker's run queue, and the worker calls tcp_connection_run on it.
+
+   A connection is only ever on its worker's run queue once at a time (tcp_connection_schedule takes
+   care of that), so the run queue never needs to be any bigger than the number of connections there
+   can be -- and only the one worker ever runs it, so nothing about running a connection has to change
+   from when it had its own thread. */
+
+struct tcp_connection;
+
+typedef struct tcp_worker* tcp_worker_t;
+typedef struct tcp_worker_pool* tcp_worker_pool_t;
+
+// starts up num_workers worker threads, each with a run queue big enough for max_connections
+tcp_worker_pool_t tcp_worker_pool_init(int num_workers, int max_connections);
+// stops and joins all the workers -- every connection should be destroyed by now
+void tcp_worker_pool_destroy(tcp_worker_pool_t* pool);
+
+// the worker that owns the shard that hash falls into
+tcp_worker_t tcp_worker_pool_get(tcp_worker_pool_t pool, unsigned int hash);
+
+/* puts connection on worker's run queue -- only for tcp_connection_schedule to call
+	returns 0 on success, -1 if the worker has been stopped */
+int tcp_worker_schedule(tcp_worker_t worker, struct tcp_connection* connection);
+
+#endif // __TCP_WORKER_H__
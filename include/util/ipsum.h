@@ -1,8 +1,47 @@
 #ifndef IPSUM_H
 #define IPSUM_H
 
+#include <inttypes.h>
+
+/* The Internet checksum (RFC 1071): the one's complement of the one's complement sum of the 16-bit 
+   words of whatever it covers.  Since the one's complement sum doesn't care what order the words get 
+   added in (or byte order, as long as everything's in the same one), it's done as a partial sum that
+   you can keep adding pieces to -- a TCP segment's pseudo-header, header and payload are summed right 
+   where they sit -- and only folded down to 16 bits at the end:
+
+	uint32_t sum = ip_sum_pseudo_header(src, dst, IPPROTO_TCP, length, 0);
+	sum = ip_sum_partial(header, header_len, sum);
+	sum = ip_sum_partial(payload, payload_len, sum);
+	checksum = ip_sum_fold(sum);
+
+   Every piece but the last has to be an even length, so that the next one's words line up.  Checking
+   a checksum is the same thing with the checksum left in: it folds to 0 if it's right.
+
+   The summing goes as wide as the CPU does -- AVX2 or SSE2 if it has them (picked the first time 
+   through), otherwise 8 bytes at a time -- into a 64-bit accumulator, so there's no carry to deal 
+   with until the end. */
+
 //do an ip checksum on a generic block of memory
 //for IP, len should always be the size of the ip header (sizeof (struct ip))
 int ip_sum(char* packet, int len);
 
+// adds the len bytes at buffer to the partial sum sum (start with 0)
+uint32_t ip_sum_partial(const void* buffer, int len, uint32_t sum);
+// adds the TCP/UDP pseudo-header (addresses as they sit in the packet, protocol and length in host order)
+uint32_t ip_sum_pseudo_header(uint32_t src, uint32_t dst, uint8_t protocol, uint16_t length, uint32_t sum);
+// the checksum for a partial sum
+uint16_t ip_sum_fold(uint32_t sum);
+
+/* RFC 1624: the checksum sum after one 16-bit word of what it covers changed from old_word to new_word 
+   (both as they sit in the packet), without summing the whole thing over again */
+uint16_t ip_sum_update(uint16_t sum, uint16_t old_word, uint16_t new_word);
+
+/* for testing the kernels against each other: makes ip_sum_partial sum with the given one from now on
+   (IP_SUM_KERNEL_BEST goes back to the widest the CPU can do).  returns 0, or -1 if the CPU can't do it */
+#define IP_SUM_KERNEL_BEST  0
+#define IP_SUM_KERNEL_WORDS 1
+#define IP_SUM_KERNEL_SSE2  2
+#define IP_SUM_KERNEL_AVX2  3
+int ip_sum_set_kernel(int kernel);
+
 #endif
@@ -0,0 +1,36 @@
+#ifndef __MIRROR_BUFFER_H__
+#define __MIRROR_BUFFER_H__
+
+/* A mirror_buffer is a byte ring (a FIFO of bytes) whose memory is mapped twice, back to back, so
+   the byte at data[i] is also at data[i+capacity].  Whatever's in it is always contiguous starting
+   from the read end, and there's always contiguous room after it -- pushing is one memcpy no matter
+   where in the ring it lands, any run of bytes in it can be handed out as a plain pointer, and
+   nothing ever gets shifted down.
+
+   The capacity gets rounded up to a whole number of pages (the mapping needs that) and is fixed:
+   it never reallocates, push just takes as much as fits.  If the double mapping can't be had (no
+   memfd_create), it quietly falls back to a plain buffer twice the size, and push writes everything
+   twice to keep up the mirror itself.
+
+   It's refcounted, so that pointers into it can outlive whoever owns it: init hands it out with a
+   count of 1, mirror_buffer_ref takes another, and it's unmapped once the last mirror_buffer_release
+   (destroy is a release that NULLs the caller's pointer) drops it to 0.  Any thread can release. */
+
+typedef struct mirror_buffer* mirror_buffer_t;
+
+mirror_buffer_t mirror_buffer_init(int capacity);
+void mirror_buffer_destroy(mirror_buffer_t* mb);
+void mirror_buffer_ref(mirror_buffer_t mb);
+void mirror_buffer_release(mirror_buffer_t mb);
+
+// pushes no more than there's room for, returns how much that was
+int mirror_buffer_push(mirror_buffer_t mb, const void* data, int length);
+// the oldest byte -- all size of them follow it contiguously
+char* mirror_buffer_data(mirror_buffer_t mb);
+// drops the length oldest bytes
+void mirror_buffer_consume(mirror_buffer_t mb, int length);
+// how many bytes are in there
+int mirror_buffer_size(mirror_buffer_t mb);
+int mirror_buffer_capacity(mirror_buffer_t mb);
+
+#endif // __MIRROR_BUFFER_H__
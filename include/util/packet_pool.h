@@ -0,0 +1,36 @@
+#ifndef __PACKET_POOL_H__ 
+#define __PACKET_POOL_H__
+
+#include "utils.h"
+
+/* A packet_pool is a fixed number of fixed-size packet buffers (slots) carved out of one 
+   big region that is mmap()ed up front, optionally backed by hugepages.  Each slot is 
+   refcounted: packet_pool_alloc hands out a slot with a count of 1, anyone who wants to 
+   hang onto it takes a packet_pool_ref, and the slot is recycled once the last 
+   packet_pool_release drops the count to 0.
+
+   The pool belongs to the one thread that allocates from it (the first one to call 
+   packet_pool_alloc), so allocating never takes a lock.  Any thread can release: releases 
+   from other threads get pushed onto a lock-free return stack that the owning thread 
+   reclaims in one go when it runs out of free slots.  If the pool is ever completely 
+   used up, packet_pool_alloc falls back to malloc() so it never fails. */
+
+typedef struct packet_pool* packet_pool_t;
+
+// slot_size is the usable size of each buffer.  if use_hugepages is set we try for 
+// MAP_HUGETLB and quietly fall back to normal pages if there aren't any 
+packet_pool_t packet_pool_init(int num_slots, int slot_size, int use_hugepages);
+void packet_pool_destroy(packet_pool_t* pool);
+
+// returns a buffer of at least slot_size bytes with a refcount of 1
+char* packet_pool_alloc(packet_pool_t pool);
+// returns a heap buffer of size bytes that isn't part of any pool, but is refcounted 
+// (and released) just like one that is
+char* packet_pool_alloc_unpooled(int size);
+// both take a buffer returned by packet_pool_alloc
+void packet_pool_ref(char* buffer);
+void packet_pool_release(char* buffer);
+
+int packet_pool_slot_size(packet_pool_t pool);
+
+#endif // __PACKET_POOL_H__
@@ -0,0 +1,47 @@
+#ifndef __RING_QUEUE_H__
+#define __RING_QUEUE_H__
+
+#include <time.h>
+
+#include "utils.h"
+
+/* A ring_queue is a bounded queue of void*s for handing packets from one thread to another
+   without taking any locks or malloc()ing anything per item.  The slots are allocated up front
+   (capacity gets rounded up to a power of 2) and each one carries a sequence number that says
+   whose turn it is to touch it, so producers and the consumer never need to agree on anything
+   else.
+
+   There can only ever be ONE consumer.  If there is only one producer as well, init it with
+   RING_QUEUE_SPSC and enqueueing doesn't even need a compare-and-swap -- with RING_QUEUE_MPSC
+   any number of threads can enqueue.
+
+   A consumer that finds the queue empty can block (with a timeout) on an eventfd, which
+   producers only bother writing to when they know somebody is actually asleep on it. */
+
+#define RING_QUEUE_SPSC 0
+#define RING_QUEUE_MPSC 1
+
+typedef struct ring_queue* ring_queue_t;
+
+ring_queue_t ring_queue_init(int capacity, int producers);
+// doesn't touch whatever is still in the queue -- drain it first
+void ring_queue_destroy(ring_queue_t* q);
+
+/* returns 0 on success,
+	-EAGAIN if the queue is full (the item is NOT queued, so it's still yours),
+	-EINVAL if the queue has been stopped */
+int ring_queue_enqueue(ring_queue_t q, void* data);
+/* returns 0 and sets *data if there was something to dequeue, 1 if the queue is empty */
+int ring_queue_trydequeue(ring_queue_t q, void** data);
+/* same as bqueue_timed_dequeue_abs: blocks until there's something to dequeue or until the
+	absolute time abs_ts (NULL to wait forever)
+	returns 0 on success, -ETIMEDOUT if nothing came, -EINVAL if the queue was stopped */
+int ring_queue_timed_dequeue_abs(ring_queue_t q, void** data, const struct timespec* abs_ts);
+// returns 1 if the queue is empty, 0 otherwise
+int ring_queue_empty(ring_queue_t q);
+
+// wakes up the consumer and makes enqueues and timed dequeues fail with -EINVAL from now on 
+// (trydequeue still works, so whatever is left can be drained)
+void ring_queue_stop(ring_queue_t q);
+
+#endif // __RING_QUEUE_H__
@@ -0,0 +1,48 @@
+#ifndef __TIMER_WHEEL_H__
+#define __TIMER_WHEEL_H__
+
+#include "utils.h"
+
+/* A timer_wheel is a hierarchical timing wheel (Varghese & Lauck) for keeping track of lots of
+   timers that mostly get re-armed or cancelled long before they ever go off.  Arming and
+   cancelling a wheel_timer are O(1) -- it's just unlinking it from one slot's list and linking
+   it into another's -- and nothing ever walks timers that aren't due.
+
+   TIMER_WHEEL_LEVELS wheels of TIMER_WHEEL_SLOTS slots each: a slot on the first wheel is one
+   TIMER_WHEEL_TICK_MS tick, a slot on each wheel after that covers a whole turn of the one
+   before it.  Timers too far out for the first wheel sit on a coarser one and get cascaded down
+   as their time gets closer.
+
+   The wheel doesn't have a thread of its own.  Whoever drives it registers timer_wheel_get_fd
+   (a timerfd that becomes readable when the next timer is due) with their select/epoll, and
+   calls timer_wheel_run when it is.  Callbacks run on that thread, without the wheel locked, so
+   they can arm/cancel timers -- arming/cancelling can be done from any thread. */
+
+#define TIMER_WHEEL_TICK_MS 1
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+
+typedef struct timer_wheel* timer_wheel_t;
+typedef struct wheel_timer* wheel_timer_t;
+
+typedef void (*wheel_timer_f)(void* arg);
+
+timer_wheel_t timer_wheel_init();
+void timer_wheel_destroy(timer_wheel_t* wheel);
+
+int timer_wheel_get_fd(timer_wheel_t wheel);
+// fires every timer that's due
+void timer_wheel_run(timer_wheel_t wheel);
+
+wheel_timer_t wheel_timer_init(timer_wheel_t wheel, wheel_timer_f callback, void* arg);
+// cancels it first
+void wheel_timer_destroy(wheel_timer_t* timer);
+
+// (re)arms timer to go off secs from now, replacing whenever it was going to go off before
+void wheel_timer_arm(wheel_timer_t timer, double secs);
+/* makes sure timer won't go off -- if its callback is running on another thread right now,
+	waits for it to finish so that it's safe to free whatever arg is */
+void wheel_timer_cancel(wheel_timer_t timer);
+
+#endif // __TIMER_WHEEL_H__
@@ -56,6 +56,8 @@
 #define WRAP_ADD(x,y,mod) (((x) + (y)) % (mod))
 
 #define WRAP_DIFF(x,y,length) ((y) >= (x) ? (y) - (x) : (length) - (x) + (y)) 
+// how far seqnum a is past seqnum b -- negative if it's before it (WRAP_DIFF never is)
+#define SEQ_DIFF(a,b) ((int32_t)((uint32_t)(a) - (uint32_t)(b)))
 
 #define CRASH_AND_BURN(msg) 						\
 do{													\
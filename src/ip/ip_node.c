@@ -2,6 +2,7 @@
 #include <netinet/ip.h>
 #include <time.h>
 #include <sys/time.h>
+#include <sys/epoll.h>
 
 
 #include "bqueue.h"
@@ -10,6 +11,8 @@
 #include "link_interface.h"
 #include "parselinks.h"
 #include "utils.h"
+#include "packet_pool.h"
+#include "timer_wheel.h"
 #include "ip_node.h"
 
 //// select
@@ -31,16 +34,22 @@
 #define UPDATE_INTERFACES_HZ 5
 
 /* Static functions for internal use */
-static void _update_select_list(ip_node_t node);
+static void _register_interface(ip_node_t ip_node, link_interface_t interface);
+static void _unregister_interface(ip_node_t ip_node, link_interface_t interface);
+static void _register_timer_wheel(ip_node_t ip_node);
+static void _query_timer_fired(void* ip_node);
+static void _update_timer_fired(void* ip_node);
 static void _update_all_interfaces(ip_node_t node);
-static void _handle_selected(ip_node_t ip_node, link_interface_t interface);
+static int _handle_selected(ip_node_t ip_node, link_interface_t interface);
 static void _handle_reading_stdin(ip_node_t ip_node, char* command);//bqueue_t *stdin_commands);
-static void _handle_reading_sockets(ip_node_t ip_node);
+static void _handle_reading_sockets(ip_node_t ip_node, struct epoll_event* events, int num_events);
 static void _handle_user_command(ip_node_t ip_node, char* command);//bqueue_t *stdin_commands);
 static int _is_local_ip(ip_node_t ip_node, uint32_t ip);
 static void _handle_query_interfaces(ip_node_t ip_node);
 static void _handle_user_command_down(ip_node_t ip_node, char* buffer);
-static void _handle_to_send_queue(ip_node_t ip_node, void* packet);//bqueue_t *to_send);
+static link_interface_t _handle_to_send_queue(ip_node_t ip_node, tcp_packet_data_t tcp_packet_data);
+static void _handle_to_send_batch(ip_node_t ip_node, void** packets, int num_packets);
+static void _handle_selected_packet(ip_node_t ip_node, link_interface_t interface, char* packet_buffer, int bytes_read);
 static void _request_RIP(ip_node_t ip_node);
 
 /* STRUCTS */
@@ -73,8 +82,10 @@ typedef struct interface_ip_keyed* interface_ip_keyed_t;
 /* The ip_node has a forwarding_table, a routing_table and then the number of
    interfaces that it owns, an array to keep them in, and then a hashmap that maps
    sockets/ip addresses to one of these interface pointers. The ip_node also needs
-   an fdset in order to use select() for reading from each of the interfaces, as 
-   well as a highsock that will be passed to select(). */
+   an epoll instance that the sockets of all the up interfaces are registered with 
+   (once, not every time around the loop), and a timer_wheel (whose timerfd is in that epoll 
+   set too) that every timer on the node -- route expiry, RIP updates, the tcp connections' 
+   retransmission/state timers -- hangs off of. */
 
 struct ip_node{
 	forwarding_table_t forwarding_table;
@@ -85,11 +96,18 @@ struct ip_node{
 	interface_ip_keyed_t addressToInterface;
 
 	bqueue_t* stdin_queue;
-	bqueue_t* send_queue;
-	bqueue_t* read_queue;
+	ring_queue_t send_queue;
+	ring_queue_t read_queue;
 	
-	fd_set read_fds;
-	int highsock;
+	int epoll_fd;
+	timer_wheel_t timer_wheel;
+	wheel_timer_t query_timer;  // fires every SELECT_TIMEOUT seconds: interface up/down
+	wheel_timer_t update_timer; // fires every UPDATE_INTERFACES_HZ seconds: RIP responses
+
+	/* MTU sized buffers that every burst gets read into by _handle_selected -- tcp packets
+	   get handed off to the tcp_node still sitting in these, and are recycled once consumed */
+	packet_pool_t rx_pool;
+	char* rx_buffers[LINK_INTERFACE_BATCH_SIZE];
 
 	int running; 
 };	
@@ -135,8 +153,9 @@ ip_node_t ip_node_init(iplist_t* links){
 		return NULL;
 
 	ip_node_t ip_node = (ip_node_t)malloc(sizeof(struct ip_node));
+	ip_node->timer_wheel = timer_wheel_init();
 	ip_node->forwarding_table = forwarding_table_init();
-	ip_node->routing_table = routing_table_init();
+	ip_node->routing_table = routing_table_init(ip_node->forwarding_table, ip_node->timer_wheel);
 	ip_node->num_interfaces = links->length;	
 	
 	ip_node->interfaces = (link_interface_t*)malloc(sizeof(link_interface_t)*(ip_node->num_interfaces));
@@ -145,6 +164,17 @@ ip_node_t ip_node_init(iplist_t* links){
 	ip_node->read_queue = NULL;
 	ip_node->stdin_queue = NULL;
 	ip_node->send_queue = NULL;
+
+	/* the interfaces get registered with epoll when their (initial) up status is queried */
+	ip_node->epoll_fd = epoll_create1(0);
+	_register_timer_wheel(ip_node);
+	/* armed once the link interface thread gets going */
+	ip_node->query_timer = wheel_timer_init(ip_node->timer_wheel, _query_timer_fired, ip_node);
+	ip_node->update_timer = wheel_timer_init(ip_node->timer_wheel, _update_timer_fired, ip_node);
+
+	/* rx_buffers get filled from the pool by the link interface thread, which owns the pool */
+	ip_node->rx_pool = packet_pool_init(IP_NODE_PACKET_POOL_SLOTS, UDP_PACKET_MAX_SIZE, IP_NODE_PACKET_POOL_HUGEPAGES);
+	memset(ip_node->rx_buffers, 0, sizeof(char*)*LINK_INTERFACE_BATCH_SIZE);
 	
 	link_interface_t interface; 
 	link_t* link;
@@ -195,6 +225,11 @@ void ip_node_destroy(ip_node_t* ip_node){
 	//// destroy forwarding/routing tables
 	forwarding_table_destroy(&((*ip_node)->forwarding_table));
 	routing_table_destroy(&((*ip_node)->routing_table));
+
+	//// the routes' timers are gone with the routing table, so now the wheel can go
+	wheel_timer_destroy(&((*ip_node)->query_timer));
+	wheel_timer_destroy(&((*ip_node)->update_timer));
+	timer_wheel_destroy(&((*ip_node)->timer_wheel));
 	
 	//// iterate through the hash maps and destroy all of the keys/values,
 	//// this will NOT destroy the interfaces
@@ -216,6 +251,8 @@ void ip_node_destroy(ip_node_t* ip_node){
 		link_interface_destroy((*ip_node)->interfaces[i]);
 	}	
 	free((*ip_node)->interfaces);
+	packet_pool_destroy(&((*ip_node)->rx_pool));
+	close((*ip_node)->epoll_fd);
 	//// basic clean up
 	free(*ip_node);
 	*ip_node = NULL;
@@ -238,18 +275,25 @@ returns:
 	0 	on success
 	-1 	queue does not exist 
 */
-int ip_node_read(ip_node_t ip_node, char* packet, int packet_size, uint32_t local_virt_ip, uint32_t remote_virt_ip){
+int ip_node_read(ip_node_t ip_node, char* packet, int packet_size, uint32_t local_virt_ip, uint32_t remote_virt_ip, char* pool_buffer){
 
-	if(!ip_node->read_queue) 
+	if(!ip_node->read_queue){
+		if(pool_buffer)
+			packet_pool_release(pool_buffer);
 		return -1;
+	}
 	
 	if(packet_size > MTU)
 		printf("Received tcp packet of size %d which is larger than the tcp MTU %lu.  Will only keep MTU bytes\n", packet_size, MTU);
 	
 	tcp_packet_data_t tcp_packet = tcp_packet_data_init(packet, packet_size, local_virt_ip, remote_virt_ip);
+	tcp_packet->pool_buffer = pool_buffer;
 		
-	if(bqueue_enqueue(ip_node->read_queue, tcp_packet) < 0){
-		ip_node->read_queue = NULL;
+	int ret = ring_queue_enqueue(ip_node->read_queue, tcp_packet);
+	if(ret < 0){
+		/* if it's just full tcp is falling behind, so drop it like any router would -- otherwise the queue's gone */
+		if(ret != -EAGAIN)
+			ip_node->read_queue = NULL;
 		tcp_packet_data_destroy(&tcp_packet);
 		return -1;
 	}
@@ -270,9 +314,11 @@ int ip_node_send_tcp(ip_node_t ip_node, tcp_packet_data_t data){
 	/* make sure the queue has been inited and not destroyed */
 	if(!ip_node->send_queue) return -2;	
 
-	if(bqueue_enqueue(ip_node->send_queue, data) < 0){
-		/* queue has been destroyed */
-		ip_node->send_queue = NULL;
+	int ret = ring_queue_enqueue(ip_node->send_queue, data);
+	if(ret < 0){
+		/* queue has been destroyed (or is just full) */
+		if(ret != -EAGAIN)
+			ip_node->send_queue = NULL;
 		return -1;
 	}
 	
@@ -316,8 +362,8 @@ void ip_node_print_interfaces(ip_node_t ip_node){
 	alex created ip_thread_data struct to pass in following arguments to start:
 	struct ip_thread_data {
 		ip_node_t ip_node;
-		bqueue_t *to_send;
-		bqueue_t *to_read;
+		ring_queue_t to_send;
+		ring_queue_t to_read;
 		bqueue_t *stdin_commands;   // way for tcp_node to pass user input commands to ip_node
 	};
 */
@@ -364,15 +410,15 @@ void *ip_send_thread_run(void *ipdata){
 	ip_thread_data_t ip_data = (ip_thread_data_t)ipdata;
 	// only need to extract ip_node and to_send
 	ip_node_t ip_node = ip_data->ip_node;
-	bqueue_t *to_send = ip_data->to_send;
+	ring_queue_t to_send = ip_data->to_send;
 	ip_node->send_queue = to_send;
 	
 	free(ip_data);
 
 	struct timespec wait_cond;	
 	struct timeval now;
-	void* packet;
-	int ret;
+	void* packets[LINK_INTERFACE_BATCH_SIZE];
+	int ret, num_packets;
 
 	int count=0,mod=10;
 	while(ip_node->running){	
@@ -387,16 +433,23 @@ void *ip_send_thread_run(void *ipdata){
         wait_cond.tv_nsec %= 1000000000;
         
 		/* try to get the next thing on queue */
-		ret = bqueue_timed_dequeue_abs(to_send, &packet, &wait_cond);
+		ret = ring_queue_timed_dequeue_abs(to_send, &packets[0], &wait_cond);
         if (ret==-ETIMEDOUT) 
 			continue;
-		else if(ret==-EINVAL)
+		else if(ret==-EINVAL){
 			print(("EINVAL returned from dequeueing"), IP_PRINT);
+			continue;
+		}
 		
-			
-		/* otherwise there's a packet waiting for you! */
+		/* otherwise there's a packet waiting for you! -- and probably more behind it, 
+		   so drain whatever else is already queued and push it all out together */
+		num_packets = 1;
+		while(num_packets < LINK_INTERFACE_BATCH_SIZE 
+			&& ring_queue_trydequeue(to_send, &packets[num_packets]) == 0)
+			num_packets++;
+
 		print(("["), IP_PRINT);
-		_handle_to_send_queue(ip_node, packet);
+		_handle_to_send_batch(ip_node, packets, num_packets);
 		print(("]"), IP_PRINT);
 
 	}
@@ -411,48 +464,39 @@ void *ip_link_interface_thread_run(void *ipdata){
 	ip_thread_data_t ip_data = (ip_thread_data_t)ipdata;
 	// only need to extract ip_node and to_read for this thread
 	ip_node_t ip_node = ip_data->ip_node;
-	bqueue_t *to_read = ip_data->to_read;	//--- tcp data that ip pushes on to queue for tcp to handle
+	ring_queue_t to_read = ip_data->to_read;	//--- tcp data that ip pushes on to queue for tcp to handle
 	ip_node->read_queue = to_read;
 	
 	free(ip_data);
 	
-	int retval;
+	struct epoll_event events[IP_NODE_MAX_EVENTS];
+	int num_events, i;
 
-	//// init the timeval struct for breaking out of select
-	struct timeval tv;
-	tv.tv_sec = SELECT_TIMEOUT;
-	tv.tv_usec = 0;	
-	// do this to init the forwarding tables/routing tables
+	// do this to init the forwarding tables/routing tables -- also registers the interfaces with epoll
 	_handle_query_interfaces(ip_node);
 
 	// send out RIP request message on all interfaces
 	_request_RIP(ip_node);
 
-	time_t last_update,now;
-	time(&last_update);
+	wheel_timer_arm(ip_node->query_timer, SELECT_TIMEOUT);
+	wheel_timer_arm(ip_node->update_timer, UPDATE_INTERFACES_HZ);
+
 	while(ip_node->running){
 
-		//// first update the list (rebuild it)
-		_update_select_list(ip_node);
-
-		//// make sure you didn't error out, otherwise pass off to _handle_reading_sockets
-		retval = select(ip_node->highsock + 1, &(ip_node->read_fds), NULL, NULL, &tv);
-		routing_table_check_timers(ip_node->routing_table, ip_node->forwarding_table);
-		if (retval == -1)
-			{ error("select()"); } 
-		else if (retval){	  
-			_handle_query_interfaces(ip_node); // in case the user shut down a node
-			_handle_reading_sockets(ip_node);
-		}	 
-		else{
-			_handle_query_interfaces(ip_node); 
+		/* no timeout needed, the query timer wakes us up at least every SELECT_TIMEOUT seconds */
+		num_events = epoll_wait(ip_node->epoll_fd, events, IP_NODE_MAX_EVENTS, -1);
+		if(num_events < 0){
+			if(errno != EINTR)
+				error("epoll_wait()");
+			continue;
 		}
-	
-		time(&now);
-		if(difftime(now, last_update) > UPDATE_INTERFACES_HZ){
-			_update_all_interfaces(ip_node);
-			time(&last_update);
+
+		/* run whatever timers are due first, and pass everything else off to _handle_reading_sockets */
+		for(i=0;i<num_events;i++){
+			if(events[i].data.fd == timer_wheel_get_fd(ip_node->timer_wheel))
+				timer_wheel_run(ip_node->timer_wheel);
 		}
+		_handle_reading_sockets(ip_node, events, num_events);
 	}
 	pthread_exit(NULL);
 }
@@ -465,16 +509,26 @@ static void _handle_reading_stdin(ip_node_t ip_node, char* command){//bqueue_t *
 }
 
 /* _handle_reading_sockets is an internal function for dealing with the 
-   effect of a select call. This will get called only if there is a fd to
-   read from. First check STDIN, and handle that command. Then check all 
-   of the interface sockets by iterating over the hashmap of sockets to interfaces. */
-static void _handle_reading_sockets(ip_node_t ip_node){
-	struct interface_socket_keyed *socket_keyed, *tmp;
-	HASH_ITER(hh, ip_node->socketToInterface, socket_keyed, tmp){
-		if(FD_ISSET(socket_keyed->socket, &(ip_node->read_fds))){
-			_handle_selected(ip_node, socket_keyed->interface);	
-		}	
+   effect of an epoll_wait call. Each event that isn't one of the timers is 
+   an interface socket that became readable, which we find through the hashmap 
+   of sockets to interfaces. Since the sockets are registered edge-triggered, 
+   _handle_selected has to drain each of them.  If reading took an interface 
+   down, the routing table needs to hear about it right away. */
+static void _handle_reading_sockets(ip_node_t ip_node, struct epoll_event* events, int num_events){
+	struct interface_socket_keyed *socket_keyed;
+	int i, fd, status_changed = 0;
+
+	for(i=0;i<num_events;i++){
+		fd = events[i].data.fd;
+		if(fd == timer_wheel_get_fd(ip_node->timer_wheel))
+			continue;
+
+		HASH_FIND_INT(ip_node->socketToInterface, &fd, socket_keyed);
+		if(socket_keyed && _handle_selected(ip_node, socket_keyed->interface) < 0)
+			status_changed = 1;
 	}
+	if(status_changed)
+		_handle_query_interfaces(ip_node);
 }
 
 /*  Recently added by Alex: _handle_query_interfaces()
@@ -504,9 +558,11 @@ static void _handle_query_interfaces(ip_node_t ip_node){
 		if((up_down = link_interface_query_up_down(interface)) != 0){
 			// up-down status changed -- must update routing table with struct routing_info info
 			if(up_down < 0){
+				_unregister_interface(ip_node, interface);
 				routing_table_bring_down(ip_node->routing_table, ip_node->forwarding_table, link_interface_get_local_virt_ip(interface));
 			}
 			else{
+				_register_interface(ip_node, interface);
 				info->entries[0].cost = htons(0); 
 	
 				info->entries[0].address = link_interface_get_local_virt_ip(interface);
@@ -576,26 +632,53 @@ static int _is_local_ip(ip_node_t ip_node, uint32_t vip){
 		return 0;
 }
 
-/* This will handle updating the fdset that the ip_node uses in order
-   to read from each of the interfaces. It checks that each interface
-   is up before adding it  */ 
-
-static void _update_select_list(ip_node_t ip_node){
-	FD_ZERO(&(ip_node->read_fds));
-	/*FD_SET(STDIN, &(ip_node->read_fds));  stdin read by tcp_node */
-	int max_fd = 0;	
-	int sfd;		
-	
-	int i;
-	for(i=0;i<ip_node->num_interfaces;i++){
-		if(link_interface_up_down(ip_node->interfaces[i]) > 0){
-			sfd = link_interface_get_sfd(ip_node->interfaces[i]);
-			max_fd = (sfd > max_fd ? sfd : max_fd);
-			FD_SET(sfd, &(ip_node->read_fds));
-		}
+/* Adds the interface's socket to the ip_node's epoll set (edge-triggered).  If it's 
+   already in there (brought down and back up before we noticed) then just re-arm it, 
+   which also gets us an event for anything that piled up while it was down */
+static void _register_interface(ip_node_t ip_node, link_interface_t interface){
+	struct epoll_event event;
+	memset(&event, 0, sizeof(struct epoll_event));
+	event.events = EPOLLIN | EPOLLET;
+	event.data.fd = link_interface_get_sfd(interface);
+
+	if(epoll_ctl(ip_node->epoll_fd, EPOLL_CTL_ADD, event.data.fd, &event) < 0){
+		if(errno != EEXIST || epoll_ctl(ip_node->epoll_fd, EPOLL_CTL_MOD, event.data.fd, &event) < 0)
+			error("epoll_ctl()");
 	}
-	ip_node->highsock = max_fd;
 }
+
+/* Takes the interface's socket out of the epoll set while the interface is down */
+static void _unregister_interface(ip_node_t ip_node, link_interface_t interface){
+	int sfd = link_interface_get_sfd(interface);
+	if(epoll_ctl(ip_node->epoll_fd, EPOLL_CTL_DEL, sfd, NULL) < 0 && errno != ENOENT)
+		error("epoll_ctl()");
+}
+
+/* registers the timer wheel's timerfd with epoll -- level-triggered, since timer_wheel_run 
+   reads it */
+static void _register_timer_wheel(ip_node_t ip_node){
+	struct epoll_event event;
+	memset(&event, 0, sizeof(struct epoll_event));
+	event.events = EPOLLIN;
+	event.data.fd = timer_wheel_get_fd(ip_node->timer_wheel);
+	if(epoll_ctl(ip_node->epoll_fd, EPOLL_CTL_ADD, event.data.fd, &event) < 0)
+		error("epoll_ctl()");
+}
+
+/* the periodic timers just re-arm themselves.  (they run on the link interface thread, 
+   same as everything else that touches the routing table) */
+static void _query_timer_fired(void* arg){
+	ip_node_t ip_node = (ip_node_t)arg;
+	_handle_query_interfaces(ip_node); // in case the user shut down a node
+	wheel_timer_arm(ip_node->query_timer, SELECT_TIMEOUT);
+}
+
+static void _update_timer_fired(void* arg){
+	ip_node_t ip_node = (ip_node_t)arg;
+	_update_all_interfaces(ip_node);
+	wheel_timer_arm(ip_node->update_timer, UPDATE_INTERFACES_HZ);
+}
+
 /* _handle_user_command_down is a helper to _handle_user_command for handling 'down <interface>' command */
 static void _handle_user_command_down(ip_node_t ip_node, char* buffer){
 	char down[50];
@@ -634,28 +717,25 @@ static void _handle_user_command_up(ip_node_t ip_node, char* buffer){
 	}		
 }
 
-/* _handle_user_command_send iterates through to_send queue to handle each packet that has been wrapped by tcp_node */
-static void _handle_to_send_queue(ip_node_t ip_node, void* packet){
+/* _handle_to_send_queue takes a packet that has been wrapped by tcp_node off of the to_send queue, 
+	figures out which interface it should go out on, and writes its ip header into the headroom in front of it.
+	returns the interface to send the packet on, or NULL (having cleaned up the tcp_packet_data) if the packet was dropped */
+static link_interface_t _handle_to_send_queue(ip_node_t ip_node, tcp_packet_data_t tcp_packet_data){
 	
-	tcp_packet_data_t tcp_packet_data = (tcp_packet_data_t)packet;
-	
-	//char* packet = (char*) malloc(sizeof(char)*MTU);
 	struct in_addr send_to, send_from;
 	uint32_t send_to_vip;
-	int packet_size;
+	char* packet;
 	
 	packet = tcp_packet_data->packet;
 	send_to_vip = tcp_packet_data->remote_virt_ip;
-	packet_size = tcp_packet_data->packet_size;
 	
 	send_to.s_addr = send_to_vip;
 
 	// check if send_to_vip local -- if so must just print
 	if(_is_local_ip(ip_node, send_to_vip)){
-		printf("We send a message to ourselves?  Look into how we should handle packet: %s\n", (char*)packet);
-		free(packet);
-		free(tcp_packet_data);
-		return;
+		printf("We send a message to ourselves?  Look into how we should handle packet: %s\n", packet);
+		tcp_packet_data_destroy(&tcp_packet_data);
+		return NULL;
 	}
 		
 	// get next hop for sending message to send_to_vip
@@ -665,9 +745,8 @@ static void _handle_to_send_queue(ip_node_t ip_node, void* packet){
 		inet_ntop(AF_INET, &send_to_vip, addr_str, INET_ADDRSTRLEN);
 
 		printf("Cannot reach address %s\n", addr_str);
-		free(packet);
-		free(tcp_packet_data);
-		return;
+		tcp_packet_data_destroy(&tcp_packet_data);
+		return NULL;
 	}
 
 	// get struct in_addr corresponding to next_hop_addr
@@ -677,20 +756,92 @@ static void _handle_to_send_queue(ip_node_t ip_node, void* packet){
 	HASH_FIND(hh, ip_node->addressToInterface, &next_hop_addr, sizeof(uint32_t), address_keyed);
 	if(!address_keyed){
 		printf("Cannot reach address %d  -- TODO: MAKE SURE FIXED -- see _handle_user_command_send\n", send_to_vip);
-		free(packet);
-		free(tcp_packet_data);
-		return;
-		//continue;
+		tcp_packet_data_destroy(&tcp_packet_data);
+		return NULL;
+	}
+
+	int data_len = tcp_packet_data->packet_size + tcp_packet_data->payload_size;
+	if(IP_HEADER_SIZE + data_len > UDP_PACKET_MAX_SIZE){
+		printf("Dropping packet of %d bytes -- too big to send\n", data_len);
+		tcp_packet_data_destroy(&tcp_packet_data);
+		return NULL;
+	}
+
+	// packets that weren't built with room for our header in front of them get copied once into a buffer that has it
+	if(tcp_packet_data->headroom < IP_HEADER_SIZE){
+		char* with_headroom = (char*)malloc(IP_HEADER_SIZE + tcp_packet_data->packet_size);
+		memcpy(with_headroom + IP_HEADER_SIZE, packet, tcp_packet_data->packet_size);
+		if(tcp_packet_data->pool_buffer){
+			packet_pool_release(tcp_packet_data->pool_buffer);
+			tcp_packet_data->pool_buffer = NULL;
+		}
+		else
+			free(packet - tcp_packet_data->headroom);
+		tcp_packet_data->packet = with_headroom + IP_HEADER_SIZE;
+		tcp_packet_data->headroom = IP_HEADER_SIZE;
 	}
-	link_interface_t next_hop_interface = address_keyed->interface;
 			
-	// wrap and send IP packet
-	ip_wrap_send_packet(packet, packet_size, TCP_DATA, send_from, send_to, next_hop_interface);	
+	// wrap IP packet in place
+	ip_fill_header(tcp_packet_data->packet - IP_HEADER_SIZE, data_len, TCP_DATA, send_from, send_to);
+
+	return address_keyed->interface;
+}
+
+/* _handle_to_send_batch puts ip headers on each of the packets pulled off of the to_send queue, and then
+	sends them out grouped by interface so that each interface gets a single sendmmsg for the burst.
+	Each packet goes out as (ip header + tcp header) and its payload, gathered by the kernel, so the
+	payload is never copied on its way out */
+static void _handle_to_send_batch(ip_node_t ip_node, void** packets, int num_packets){
+	link_interface_t interfaces[LINK_INTERFACE_BATCH_SIZE];
+
+	struct iovec iovecs[2*LINK_INTERFACE_BATCH_SIZE];
+	int iovcnts[LINK_INTERFACE_BATCH_SIZE];
+	int i, j, num_to_send, num_iovecs;
+	tcp_packet_data_t tcp_packet_data;
+
+	for(i=0;i<num_packets;i++){
+		interfaces[i] = _handle_to_send_queue(ip_node, (tcp_packet_data_t)packets[i]);
+		if(!interfaces[i])
+			packets[i] = NULL; // already cleaned up
+	}
 
-	free(packet);
-	free(tcp_packet_data);
+	for(i=0;i<num_packets;i++){
+		if(!interfaces[i])
+			continue;
+		link_interface_t interface = interfaces[i];
+	
+		/* gather up everything else in the burst headed out the same interface */
+		num_to_send = 0;
+		num_iovecs = 0;
+		for(j=i;j<num_packets;j++){
+			if(interfaces[j] != interface)
+				continue;
+			tcp_packet_data = (tcp_packet_data_t)packets[j];
+			iovecs[num_iovecs].iov_base = tcp_packet_data->packet - IP_HEADER_SIZE;
+			iovecs[num_iovecs].iov_len = IP_HEADER_SIZE + tcp_packet_data->packet_size;
+			num_iovecs++;
+			iovcnts[num_to_send] = 1;
+			if(tcp_packet_data->payload_size){
+				iovecs[num_iovecs].iov_base = tcp_packet_data->payload;
+				iovecs[num_iovecs].iov_len = tcp_packet_data->payload_size;
+				num_iovecs++;
+				iovcnts[num_to_send]++;
+			}
+			num_to_send++;
+			interfaces[j] = NULL;
+		}
+		link_interface_send_iovecs(interface, iovecs, iovcnts, num_to_send);
+	}
 
-	print(("ip packet sent"), IP_PRINT);
+	/* everything that made it this far was sent (or lost with its interface) -- done with all of it */
+	for(i=0;i<num_packets;i++){
+		if(!packets[i])
+			continue;
+		tcp_packet_data = (tcp_packet_data_t)packets[i];
+		tcp_packet_data_destroy(&tcp_packet_data);
+	}
+
+	print(("%d ip packets sent", num_packets), IP_PRINT);
 }
 
 /* 
@@ -821,26 +972,53 @@ static void _handle_selected_RIP(ip_node_t ip_node, link_interface_t interface,
 }
 
 
-/* _handle_selected is a dummy function for testing the functionality of the rest
-   of the system (and not the implementation of the link_interface). This will be 
-   done by linking to a dummy link_interface file that provides the same methods */
-static void _handle_selected(ip_node_t ip_node, link_interface_t interface){
-	char* packet_buffer = (char*)malloc(sizeof(char)*(IP_PACKET_MAX_SIZE + 1));
-	int bytes_read = link_interface_read_packet(interface, packet_buffer, IP_PACKET_MAX_SIZE);
+/* _handle_selected drains the interface's socket -- pulls bursts of up to LINK_INTERFACE_BATCH_SIZE 
+   datagrams at a time into rx_buffers from the node's packet pool until nothing is left waiting, 
+   handing each one off to _handle_selected_packet.  Once the burst is handled we drop our reference 
+   to each buffer, so the ones nobody else held onto go straight back into the pool
+   returns 0 normally, or the (negative) interface error if reading failed */
+static int _handle_selected(ip_node_t ip_node, link_interface_t interface){
+	int lengths[LINK_INTERFACE_BATCH_SIZE];
+	int i, num_read;
+
+	do{
+		for(i=0;i<LINK_INTERFACE_BATCH_SIZE;i++)
+			ip_node->rx_buffers[i] = packet_pool_alloc(ip_node->rx_pool);
+
+		num_read = link_interface_read_packets(interface, ip_node->rx_buffers, lengths, 
+										packet_pool_slot_size(ip_node->rx_pool), LINK_INTERFACE_BATCH_SIZE);
+		if(num_read < 0){
+			//Error -- nothing read
+			_handle_selected_printerror(num_read, NULL);
+			for(i=0;i<LINK_INTERFACE_BATCH_SIZE;i++)
+				packet_pool_release(ip_node->rx_buffers[i]);
+			return num_read;
+		}
 
-	if(bytes_read < 0){
-		//Error -- discard packet
-		_handle_selected_printerror(bytes_read, packet_buffer);
-		//// clean up
-		free(packet_buffer);
-		return;
-	}
+		for(i=0;i<num_read;i++){
+			if(lengths[i] < 0){
+				//Error -- discard packet
+				_handle_selected_printerror(lengths[i], ip_node->rx_buffers[i]);
+				continue;
+			}
+			_handle_selected_packet(ip_node, interface, ip_node->rx_buffers[i], lengths[i]);
+		}
 
+		for(i=0;i<LINK_INTERFACE_BATCH_SIZE;i++)
+			packet_pool_release(ip_node->rx_buffers[i]);
+	} while(num_read == LINK_INTERFACE_BATCH_SIZE);
+	return 0;
+}
+
+/* _handle_selected_packet handles a single datagram read in by _handle_selected.  
+   packet_buffer is a packet_pool buffer that _handle_selected releases when we're done, so 
+   tcp packets take their own reference to it and go up to tcp without being copied.  Anything 
+   else that needs to hang onto the payload gets its own copy from ip_unwrap_packet */
+static void _handle_selected_packet(ip_node_t ip_node, link_interface_t interface, char* packet_buffer, int bytes_read){
 	/* packet_data_size is the size of the payload */
 	int packet_data_size = 	ip_check_valid_packet(packet_buffer, bytes_read);	
  	if(packet_data_size < 0){
  		puts("Discarding packet");
- 		free(packet_buffer);
 		return;
 	}
 
@@ -851,11 +1029,20 @@ static void _handle_selected(ip_node_t ip_node, link_interface_t interface){
 			// Time-to-live > 0: Forward packet to destination:
 			_handle_selected_forward(ip_node, dest_addr, packet_buffer, bytes_read);
 		}	
-		free(packet_buffer);
 		return;
 	}
-	// else either RIP data or TEST_DATA to print:	
 	uint32_t src_addr = ip_get_src_addr(packet_buffer);
+
+	if(ip_get_protocol(packet_buffer) == TCP_DATA){
+		//HANDLE WITH TCP -- the tcp_packet_data gets its own reference to the buffer
+		packet_pool_ref(packet_buffer);
+		if(ip_node_read(ip_node, packet_buffer + ip_get_header_length(packet_buffer), packet_data_size, 
+									dest_addr, src_addr, packet_buffer) < 0)
+			puts("Tried to enqueue item into to_read queue after queue destroyed: see ip_node: _handle_selected()");
+		return;
+	}
+
+	// else either RIP data or TEST_DATA to print:	
 	
 	char* packet_unwrapped;// = malloc(sizeof(char)*(packet_data_size+1));
 	int type = ip_unwrap_packet(packet_buffer, &packet_unwrapped, packet_data_size);
@@ -865,14 +1052,6 @@ static void _handle_selected(ip_node_t ip_node, link_interface_t interface){
 			_handle_selected_RIP(ip_node, interface, packet_unwrapped);
 			break;
 	
-		case TCP_DATA:
-			//HANDLE WITH TCP
-				/* enqueue an item into the queue. if the queue has been
-			 	* destroyed, returns -EINVAL */
-			if(ip_node_read(ip_node, packet_unwrapped, packet_data_size, dest_addr, src_addr) == -EINVAL)
-				puts("Tried to enqueue item into to_read queue after queue destroyed: see ip_node: _handle_selected()");
-			break;	
-				
 		case TEST_DATA:
 			packet_unwrapped[packet_data_size] = '\0'; //null terminate string so that it prints nicely
 			printf("TEST_DATA message Received: %s\n", packet_unwrapped);
@@ -883,7 +1062,6 @@ static void _handle_selected(ip_node_t ip_node, link_interface_t interface){
 			printf("Received packet of type:%d, neither RIP nor TEST_DATA: %s\n", type, packet_unwrapped);
 	}
 	//free(packet_unwrapped);
-	free(packet_buffer);
 }
 
 void ip_node_print(ip_node_t ip_node){
@@ -901,6 +1079,10 @@ int ip_node_running(ip_node_t ip_node){
 	return ip_node->running;
 }
 
+timer_wheel_t ip_node_get_timer_wheel(ip_node_t ip_node){
+	return ip_node->timer_wheel;
+}
+
 // returns ip address of remote side of passed in remote ip
 // returns 0 if remote ip unreachable
 uint32_t tcp_ip_node_get_local_ip(ip_node_t ip_node, uint32_t remote_ip){
@@ -7,6 +7,7 @@
 
 #include "ip_utils.h"
 #include "ipsum.h"
+#include "packet_pool.h"
 #include "utils.h"
 
 /****** Structs/Functions for tcp_packet **************************/
@@ -27,12 +28,25 @@ tcp_packet_data_t tcp_packet_data_init(char* packet_data, int packet_data_size,
 	tcp_packet->remote_virt_ip = remote_virt_ip;
 	tcp_packet->packet_size = packet_data_size;
 	tcp_packet->packet = packet_data;
+	tcp_packet->pool_buffer = NULL;
+	tcp_packet->headroom = 0;
+	tcp_packet->payload = NULL;
+	tcp_packet->payload_size = 0;
+	tcp_packet->payload_buffer = NULL;
+	tcp_packet->payload_ring = NULL;
 	
 	return tcp_packet;
 }
 
 void tcp_packet_data_destroy(tcp_packet_data_t* packet_data){
-	free((*packet_data)->packet);
+	if((*packet_data)->pool_buffer)
+		packet_pool_release((*packet_data)->pool_buffer);
+	else
+		free((*packet_data)->packet - (*packet_data)->headroom);
+	if((*packet_data)->payload_buffer)
+		packet_pool_release((*packet_data)->payload_buffer);
+	if((*packet_data)->payload_ring)
+		mirror_buffer_release((*packet_data)->payload_ring);
 	free(*packet_data);
 	*packet_data = NULL;
 }
@@ -62,20 +76,13 @@ int ip_check_valid_packet(char* buffer, int bytes_read){
 
 	struct ip* ip_header = (struct ip*)buffer;
 
-	u_short got_sum = ip_header->ip_sum;
-	ip_header->ip_sum = 0; // !! because we're computing it! 
-
-	u_short expected_sum = ip_sum((char*)ip_header, IP_HEADER_SIZE);
-
-	/* if what you get isn't what they got, then that's not good */
-	if( got_sum != expected_sum ){  
+	/* summing the header checksum and all comes out to 0 if it's right -- so there's 
+		no need to take it out and put it back */
+	if(ip_sum((char*)ip_header, IP_HEADER_SIZE)){  
 		print(("Packet ip_sum != actually checksum"), IP_PRINT);
 		return -1;
 	}
 
-	ip_header->ip_ttl--; 
-	ip_header->ip_sum = ip_sum((char*)ip_header, IP_HEADER_SIZE); // set it back
-
 	u_short ip_len = ntohs(ip_header->ip_len);
 
 	if(bytes_read < ip_len){
@@ -90,16 +97,19 @@ int ip_check_valid_packet(char* buffer, int bytes_read){
 	return data_len;
 }
 
-// decrements packet's TTL.
-// returns -1 if packet needs to be thrown out (if TTL == 0 when received)
+// decrements packet's TTL, and updates the checksum for it (RFC 1624) rather than summing the header again.
+// returns -1 if packet needs to be thrown out (if its TTL runs out)
 int ip_decrement_TTL(char* packet){
-	u_char  ip_ttl;         /* time to live */
 	struct ip *ip_header = (struct ip *)packet;
-	ip_ttl = ip_header->ip_ttl;
-	if(ip_ttl <= 0){
+	uint16_t old_word, new_word;
+	if(ip_header->ip_ttl <= 1){
 		return -1;
 	}
-	ip_header->ip_ttl = ip_ttl - 1;
+	// the TTL shares its 16-bit word with the protocol
+	memcpy(&old_word, &(ip_header->ip_ttl), sizeof(uint16_t));
+	ip_header->ip_ttl--;
+	memcpy(&new_word, &(ip_header->ip_ttl), sizeof(uint16_t));
+	ip_header->ip_sum = ip_sum_update(ip_header->ip_sum, old_word, new_word);
 	return 1;
 }
 
@@ -113,6 +123,14 @@ uint32_t ip_get_dest_addr(char* buffer){
 	struct ip *ip_header = (struct ip *)buffer;
 	return ip_header->ip_dst.s_addr;
 }
+// returns protocol of packet
+int ip_get_protocol(char* buffer){
+	return ((struct ip*)buffer)->ip_p;
+}
+// returns length of the ip header in bytes
+int ip_get_header_length(char* buffer){
+	return ((struct ip*)buffer)->ip_hl*4;
+}
 
 // int is type: RIP vs other  --return -1 if bad packet
 // fills packet_unwrapped with data within packet
@@ -136,23 +154,30 @@ int ip_unwrap_packet(char* buffer, char** packet_unwrapped, int packet_data_size
 	}
 }
 
-// fills wraps ip header around data and sends through interface li
-int ip_wrap_send_packet(void* data, int data_len, int protocol, struct in_addr ip_src, struct in_addr ip_dst, link_interface_t li){
-	
-	if(protocol == TCP_DATA){	
-		//tcp_utils_validate_checksum(data, data_len, ip_src.s_addr, ip_dst.s_addr, protocol);
-	
-//		uint16_t checksum = tcp_checksum(data);
-//		print(("ip_wrap_send_packet: checksum: %u data_len: %d", checksum, data_len), PACKET_PRINT);
-	}
+// wraps ip header around data into a newly malloc()ed *wrapped (caller frees)
+// returns the total length of *wrapped
+int ip_wrap_packet(void* data, int data_len, int protocol, struct in_addr ip_src, struct in_addr ip_dst, char** wrapped){
 	//make sure not to send more than UDP_PACKET_MAX_SIZE
 	if(data_len > (UDP_PACKET_MAX_SIZE - IP_HEADER_SIZE)){
 		data_len = UDP_PACKET_MAX_SIZE - IP_HEADER_SIZE;
 		puts("packet too long -- truncating data");
 	}
 
-	// fill in header
-	struct ip* ip_header = (struct ip*)malloc(IP_HEADER_SIZE);
+	char* to_send = (char*) malloc(sizeof(char)*(data_len + IP_HEADER_SIZE));
+
+	// fill in header -- right at the front of to_send
+	ip_fill_header(to_send, data_len, protocol, ip_src, ip_dst);
+	
+	//copy data in after the header
+	memcpy(to_send+IP_HEADER_SIZE, data, data_len);
+
+	*wrapped = to_send;
+	return data_len+IP_HEADER_SIZE;
+}
+
+// fills in the ip header at buffer for data_len bytes of data following it
+void ip_fill_header(char* buffer, int data_len, int protocol, struct in_addr ip_src, struct in_addr ip_dst){
+	struct ip* ip_header = (struct ip*)buffer;
 	memset(ip_header, 0, IP_HEADER_SIZE);
 	ip_header->ip_v = 4;
 	ip_header->ip_hl = 5;
@@ -166,16 +191,16 @@ int ip_wrap_send_packet(void* data, int data_len, int protocol, struct in_addr i
 	ip_header->ip_ttl = 15;
 
 	ip_header->ip_sum = ip_sum((char *)ip_header, IP_HEADER_SIZE);
-	
-	char* to_send = (char*) malloc(sizeof(char)*(data_len + IP_HEADER_SIZE));
-	//copy header and data into to_send
-	memcpy(to_send, ip_header, IP_HEADER_SIZE);
-	memcpy(to_send+IP_HEADER_SIZE, data, data_len);
+}
+
+// fills wraps ip header around data and sends through interface li
+int ip_wrap_send_packet(void* data, int data_len, int protocol, struct in_addr ip_src, struct in_addr ip_dst, link_interface_t li){
+	char* to_send;
+	int to_send_len = ip_wrap_packet(data, data_len, protocol, ip_src, ip_dst, &to_send);
 
 	// send on link interface
-	link_interface_send_packet(li, to_send, data_len+IP_HEADER_SIZE);
+	link_interface_send_packet(li, to_send, to_send_len);
 	// free packet	
-	free(ip_header);
 	free(to_send);
 	return 1;
 }
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE // for recvmmsg/sendmmsg
 #include "list.h"
 #include "utils.h"
 #include "parselinks.h"
@@ -222,6 +223,118 @@ int link_interface_read_packet(link_interface_t l_i, char* buffer, int buffer_le
 	return bytes_read;
 }
 
+// sends a burst of packets using given link_interface -- same as link_interface_send_packet but
+// hands the kernel up to LINK_INTERFACE_BATCH_SIZE datagrams per sendmmsg call
+// returns number of packets sent, -1 on error/failure
+int link_interface_send_packets(link_interface_t li, void** datas, int* data_lens, int num_packets){
+	struct iovec iovecs[num_packets];
+	int iovcnts[num_packets];
+	int i;
+	for(i=0;i<num_packets;i++){
+		iovecs[i].iov_base = datas[i];
+		iovecs[i].iov_len = data_lens[i];
+		iovcnts[i] = 1;
+	}
+	return link_interface_send_iovecs(li, iovecs, iovcnts, num_packets);
+}
+
+// vectored version of link_interface_send_packets -- packet i is made up of the next iovcnts[i] iovecs
+// returns number of packets sent, -1 on error/failure
+int link_interface_send_iovecs(link_interface_t li, struct iovec* iovecs, int* iovcnts, int num_packets){
+	if(link_interface_up_down(li) < 0){
+		// interface down -- can't send packets
+		return -1;
+	}
+
+	struct mmsghdr msgs[LINK_INTERFACE_BATCH_SIZE];
+	struct sockaddr remoteaddr = li->remote;
+	int i, batch, sent, total_sent = 0;
+	struct iovec* next_iovec = iovecs;
+
+	while(total_sent < num_packets){
+		batch = MIN(num_packets - total_sent, LINK_INTERFACE_BATCH_SIZE);
+		memset(msgs, 0, sizeof(struct mmsghdr)*batch);
+		struct iovec* batch_iovec = next_iovec;
+		for(i=0;i<batch;i++){
+			msgs[i].msg_hdr.msg_iov = batch_iovec;
+			msgs[i].msg_hdr.msg_iovlen = iovcnts[total_sent+i];
+			msgs[i].msg_hdr.msg_name = &remoteaddr;
+			msgs[i].msg_hdr.msg_namelen = sizeof(remoteaddr);
+			batch_iovec += iovcnts[total_sent+i];
+		}
+		sent = sendmmsg(li->sfd, msgs, batch, 0);
+		if(sent < 0){
+			if(errno == EINTR)
+				continue;
+			// interface needs to go down
+			printf("Remote connection %u closed.\n", li->remote_virt_ip);
+			link_interface_bringdown(li);
+			return -1;
+		}
+		for(i=0;i<sent;i++)
+			next_iovec += iovcnts[total_sent+i];
+		total_sent += sent;
+	}
+	return total_sent;
+}
+
+// reads a burst of datagrams into buffers -- only takes what is already sitting on the socket,
+// so it's meant to be called once select/epoll says the socket is readable
+// returns number of datagrams read, or INTERFACE_DOWN/INTERFACE_ERROR_FATAL
+int link_interface_read_packets(link_interface_t l_i, char** buffers, int* lengths, int buffer_len, int max_packets){
+	if(link_interface_up_down(l_i) < 0){
+		puts("link_interface_read_packets: reading but interface down");
+		//interface down -- drop packets
+		return INTERFACE_DOWN;
+	}
+
+	struct mmsghdr msgs[LINK_INTERFACE_BATCH_SIZE];
+	struct iovec iovecs[LINK_INTERFACE_BATCH_SIZE];
+	struct sockaddr remote_addrs_in[LINK_INTERFACE_BATCH_SIZE];
+	struct sockaddr remote_addr = l_i->remote;
+	int i, num_read;
+
+	max_packets = MIN(max_packets, LINK_INTERFACE_BATCH_SIZE);
+	memset(msgs, 0, sizeof(struct mmsghdr)*max_packets);
+	for(i=0;i<max_packets;i++){
+		iovecs[i].iov_base = buffers[i];
+		iovecs[i].iov_len = buffer_len;
+		msgs[i].msg_hdr.msg_iov = &iovecs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = &remote_addrs_in[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr);
+	}
+
+	do{
+		num_read = recvmmsg(l_i->sfd, msgs, max_packets, MSG_DONTWAIT, NULL);
+	} while(num_read < 0 && errno == EINTR);
+
+	if(num_read < 0){
+		if(errno == EAGAIN || errno == EWOULDBLOCK)
+			// nothing waiting after all
+			return 0;
+		link_interface_bringdown(l_i);
+		printf("Error reading from connection to %u.\n", l_i->remote_virt_ip);
+		return INTERFACE_ERROR_FATAL;
+	}
+
+	for(i=0;i<num_read;i++){
+		lengths[i] = msgs[i].msg_len;
+		if(lengths[i] == 0){
+			//link shut down:
+			link_interface_bringdown(l_i);
+			printf("Remote connection %u closed.\n", l_i->remote_virt_ip);
+			return (i ? i : INTERFACE_ERROR_FATAL);
+		}
+		// check that remote_addr port and host match info -- if not, mark it for discarding
+		if(DISCARD_ON_WRONG_ADDRESS &&
+			 compare_remote_addr(&remote_addrs_in[i], &remote_addr) == INTERFACE_ERROR_WRONG_ADDRESS){
+			lengths[i] = INTERFACE_ERROR_WRONG_ADDRESS;
+		}
+	}
+	return num_read;
+}
+
 // returns sfd	
 int link_interface_get_sfd(link_interface_t l_i){
 	return l_i->sfd;
@@ -4,14 +4,13 @@
 #include "routing_table.h"
 #include "ip_utils.h"
 #include "uthash.h"
+#include "timer_wheel.h"
 
 #define HOP_COST 1
 #define RIP_COMMAND_REQUEST 1
 #define RIP_COMMAND_RESPONSE 2
 #define REFRESHED_TIMEOUT 12
 
-#define MIN(a,b) ((a) < (b) ? (a) : (b))
-
 #define LOCAL 0
 #define FOREIGN 1
 
@@ -20,9 +19,13 @@ struct routing_entry {
 	uint32_t cost;
 	uint32_t address;
 	uint32_t next_hop;
-	time_t last_refreshed;
 	int local;
 
+	/* goes off REFRESHED_TIMEOUT seconds after we last heard about this route (never for LOCAL ones),
+		and sets it to INFINITY */
+	wheel_timer_t expiry_timer;
+	routing_table_t rt;
+
 	UT_hash_handle hh;
 };
 typedef struct routing_entry* routing_entry_t;
@@ -30,10 +33,19 @@ typedef struct routing_entry* routing_entry_t;
 
 struct routing_table {	
 	struct routing_entry* route_hash; 
+
+	forwarding_table_t forwarding_table; // so expiring routes can take themselves out of it
+	timer_wheel_t timer_wheel;
 };	
 
+//// static internal functions /////
+static void _set_to_infinity(routing_table_t rt, forwarding_table_t ft, routing_entry_t entry);
+static void _expire(void* arg);
+static void _refresh(routing_entry_t entry);
+
 /* CTORS, DTORS */
-routing_entry_t routing_entry_init(uint32_t next_hop, 
+routing_entry_t routing_entry_init(routing_table_t rt,
+		uint32_t next_hop, 
 		uint32_t cost, 
 		uint32_t address, 
 		int entry_type)
@@ -43,13 +55,16 @@ routing_entry_t routing_entry_init(uint32_t next_hop,
 	entry->cost = cost;
 	entry->address = address;
 	entry->local = entry_type;
-	time(&entry->last_refreshed);
+	entry->rt = rt;
+
+	entry->expiry_timer = NULL;
+	if(entry_type != LOCAL && rt->timer_wheel)
+		entry->expiry_timer = wheel_timer_init(rt->timer_wheel, _expire, entry);
+	_refresh(entry);
+
 	return entry;
 }
 
-//// static internal functions /////
-static void _set_to_infinity(routing_table_t rt, forwarding_table_t ft, routing_entry_t entry);
-
 void routing_entry_print(routing_entry_t entry){
 	char address[INET_ADDRSTRLEN], next_hop[INET_ADDRSTRLEN];
 	inet_ntop(AF_INET, &entry->address, address, INET_ADDRSTRLEN*sizeof(char));
@@ -62,17 +77,22 @@ void routing_entry_print(routing_entry_t entry){
 }
 
 void routing_entry_destroy(routing_entry_t* info){
+	if((*info)->expiry_timer)
+		wheel_timer_destroy(&((*info)->expiry_timer));
 	free(*info);
 	*info = NULL;
 }
 
 void routing_entry_free(routing_entry_t info){
-	free(info);
+	routing_entry_destroy(&info);
 }
 
-routing_table_t routing_table_init(){
+/* timer_wheel can be NULL, in which case routes never expire */
+routing_table_t routing_table_init(forwarding_table_t ft, timer_wheel_t timer_wheel){
 	routing_table_t rt = (struct routing_table*)malloc(sizeof(struct routing_table));
 	rt->route_hash = NULL;
+	rt->forwarding_table = ft;
+	rt->timer_wheel = timer_wheel;
 	
 	return(rt);
 }
@@ -97,17 +117,17 @@ static void _set_to_infinity(routing_table_t rt, forwarding_table_t ft, routing_
 	}
 }
 
-void routing_table_check_timers(routing_table_t rt, forwarding_table_t ft){
-	time_t now;
-	time(&now);		
+/* we just heard about this route, so push back when it expires */
+static void _refresh(routing_entry_t entry){
+	if(entry->expiry_timer)
+		wheel_timer_arm(entry->expiry_timer, REFRESHED_TIMEOUT);
+}
 
-	routing_entry_t entry, tmp;
-	HASH_ITER(hh, rt->route_hash, entry, tmp){
-		if(!(entry->local == LOCAL)){ 
-			if(difftime(now, entry->last_refreshed) > REFRESHED_TIMEOUT)			
-				_set_to_infinity(rt, ft, entry);
-		}
-	}
+/* expiry_timer callback -- runs on whichever thread drives the timer wheel, which is the same
+	one that handles RIP updates, so the table doesn't need locking */
+static void _expire(void* arg){
+	routing_entry_t entry = (routing_entry_t)arg;
+	_set_to_infinity(entry->rt, entry->rt->forwarding_table, entry);
 }
 
 void routing_table_update_entry(routing_table_t rt, routing_entry_t entry){
@@ -145,14 +165,14 @@ void update_routing_table(routing_table_t rt, forwarding_table_t ft, struct rout
 		int type = (information_type == INTERNAL_INFORMATION ? LOCAL : FOREIGN);
 		
 		if(!entry){
-			routing_table_update_entry(rt, routing_entry_init(next_hop, cost, addr, type));
+			routing_table_update_entry(rt, routing_entry_init(rt, next_hop, cost, addr, type));
 			if(cost != INFINITY){
 				forwarding_table_update_entry(ft, addr, next_hop);
 			}
 		}	
 		else if( entry->cost > cost || information_type == INTERNAL_INFORMATION || entry->next_hop==next_hop ){
 				
-			time(&entry->last_refreshed);
+			_refresh(entry);
 			
 			if(cost == htons(INFINITY)){
 				//our entry's source is giving us an update on that entry -- iff that node set entry to INFINITY, we do too
@@ -162,7 +182,7 @@ void update_routing_table(routing_table_t rt, forwarding_table_t ft, struct rout
 				HASH_DEL(rt->route_hash, entry);
 				routing_entry_free(entry);
 	
-				routing_table_update_entry(rt, routing_entry_init(next_hop, cost, addr, type));
+				routing_table_update_entry(rt, routing_entry_init(rt, next_hop, cost, addr, type));
 				forwarding_table_update_entry(ft, addr, next_hop); 
 			}
 		}
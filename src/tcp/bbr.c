@@ -0,0 +1,268 @@
+/* BBR (draft-cardwell-iccrg-bbr, v1) -- instead of backing off whenever something gets lost, keep a model
+	of the path: the bottleneck bandwidth (the most we've seen get delivered per second lately) and the
+	round trip propagation time (the smallest RTT we've seen lately).  Their product is what the path can
+	hold without anything queueing up, so we pace at about the bottleneck bandwidth and keep about two
+	of those in flight.  Losses on a lossy link (ours lose packets on purpose) don't shrink the window
+	the way they do for NewReno and CUBIC, and the forwarders' queues stay short.
+
+	It goes:  STARTUP   double the sending rate every round until the bandwidth stops growing
+	          DRAIN     drain the queue STARTUP just built up
+	          PROBE_BW  cruise at the bottleneck bandwidth, probing for more (and draining) every 8 rounds
+	          PROBE_RTT if the min RTT hasn't been seen again in 10s, back off to 4 segments for a bit to
+	                    let the queues empty and get a fresh look at it */
+#include <stdlib.h>
+#include <string.h>
+
+#include "congestion_control.h"
+#include "utils.h"
+
+#define BBR_STARTUP 0
+#define BBR_DRAIN 1
+#define BBR_PROBE_BW 2
+#define BBR_PROBE_RTT 3
+
+// 2/ln(2) -- the smallest gain that doubles the sending rate every round
+#define BBR_HIGH_GAIN 2.885
+#define BBR_CWND_GAIN 2.0
+// bottleneck bandwidth is the max delivery rate over this many rounds
+#define BBR_BW_ROUNDS 10
+// min RTT is the smallest RTT seen in this many seconds
+#define BBR_MIN_RTT_WINDOW 10.0
+#define BBR_PROBE_RTT_TIME 0.2
+#define BBR_MIN_CWND(mss) (4*(mss))
+// the bandwidth has to go up by a quarter to count as still growing, in this many rounds
+#define BBR_FULL_BW_THRESH 1.25
+#define BBR_FULL_BW_ROUNDS 3
+#define BBR_CYCLE_LENGTH 8
+
+static const double _probe_bw_gains[BBR_CYCLE_LENGTH] = {1.25, 0.75, 1, 1, 1, 1, 1, 1};
+
+struct bbr{
+	int mode;
+	double pacing_gain;
+	double cwnd_gain;
+
+	double btl_bw; // bytes per second
+	double bw_samples[BBR_BW_ROUNDS]; // the max delivery rate from each of the last rounds
+	double min_RTT; // seconds, 0 until there is one
+	double min_RTT_stamp;
+
+	// a round is over once a chunk sent after it started gets acked
+	uint64_t round_count;
+	uint64_t next_round_delivered;
+	int round_start;
+
+	double full_bw;
+	int full_bw_count;
+	int full_pipe; // STARTUP filled the pipe
+
+	int cycle_index;
+	double cycle_stamp;
+
+	double probe_RTT_done; // when PROBE_RTT can be over, 0 if it isn't counting down yet
+	uint32_t prior_cwnd; // cwnd before loss recovery or PROBE_RTT cut it down, to go back to after
+};
+
+static void _bbr_init(congestion_control_t cc){
+	struct bbr* bbr = (struct bbr*)malloc(sizeof(struct bbr));
+	memset(bbr, 0, sizeof(struct bbr));
+	bbr->mode = BBR_STARTUP;
+	bbr->pacing_gain = BBR_HIGH_GAIN;
+	bbr->cwnd_gain = BBR_HIGH_GAIN;
+	cc->priv = bbr;
+}
+
+static void _bbr_destroy(congestion_control_t cc){
+	free(cc->priv);
+	cc->priv = NULL;
+}
+
+// bandwidth-delay product, in bytes
+static uint32_t _bdp(struct bbr* bbr, double gain){
+	return (uint32_t)(gain*bbr->btl_bw*bbr->min_RTT);
+}
+
+static void _update_round(struct bbr* bbr, const struct congestion_control_rate_sample* rs){
+	bbr->round_start = 0;
+	if(rs->prior_delivered >= bbr->next_round_delivered){
+		bbr->next_round_delivered = rs->delivered;
+		bbr->round_count++;
+		bbr->round_start = 1;
+		bbr->bw_samples[bbr->round_count % BBR_BW_ROUNDS] = 0;
+	}
+}
+
+static void _update_btl_bw(struct bbr* bbr, const struct congestion_control_rate_sample* rs){
+	if(rs->delivery_rate <= 0)
+		return;
+	// an app-limited sample only tells us the bandwidth's at least that much
+	if(rs->app_limited && rs->delivery_rate < bbr->btl_bw)
+		return;
+
+	double* sample = &(bbr->bw_samples[bbr->round_count % BBR_BW_ROUNDS]);
+	*sample = MAX(*sample, rs->delivery_rate);
+
+	int i;
+	bbr->btl_bw = 0;
+	for(i=0;i<BBR_BW_ROUNDS;i++)
+		bbr->btl_bw = MAX(bbr->btl_bw, bbr->bw_samples[i]);
+}
+
+static void _enter_probe_bw(struct bbr* bbr, double now){
+	bbr->mode = BBR_PROBE_BW;
+	bbr->cwnd_gain = BBR_CWND_GAIN;
+	// start anywhere in the cycle but the draining phase
+	bbr->cycle_index = (2 + rand() % (BBR_CYCLE_LENGTH-1)) % BBR_CYCLE_LENGTH;
+	bbr->pacing_gain = _probe_bw_gains[bbr->cycle_index];
+	bbr->cycle_stamp = now;
+}
+
+static void _check_cycle_phase(struct bbr* bbr, uint32_t in_flight, double now){
+	if(bbr->mode != BBR_PROBE_BW)
+		return;
+	int next = (now - bbr->cycle_stamp > bbr->min_RTT);
+	// done draining as soon as there's no queue left
+	if(bbr->pacing_gain < 1 && in_flight <= _bdp(bbr, 1))
+		next = 1;
+	if(next){
+		bbr->cycle_index = (bbr->cycle_index + 1) % BBR_CYCLE_LENGTH;
+		bbr->pacing_gain = _probe_bw_gains[bbr->cycle_index];
+		bbr->cycle_stamp = now;
+	}
+}
+
+static void _check_full_pipe(struct bbr* bbr, const struct congestion_control_rate_sample* rs){
+	if(bbr->full_pipe || !bbr->round_start || rs->app_limited)
+		return;
+	if(bbr->btl_bw >= bbr->full_bw*BBR_FULL_BW_THRESH){
+		// still growing
+		bbr->full_bw = bbr->btl_bw;
+		bbr->full_bw_count = 0;
+		return;
+	}
+	if(++(bbr->full_bw_count) >= BBR_FULL_BW_ROUNDS)
+		bbr->full_pipe = 1;
+}
+
+static void _check_drain(struct bbr* bbr, uint32_t in_flight, double now){
+	if(bbr->mode == BBR_STARTUP && bbr->full_pipe){
+		bbr->mode = BBR_DRAIN;
+		bbr->pacing_gain = 1/BBR_HIGH_GAIN;
+		bbr->cwnd_gain = BBR_HIGH_GAIN;
+	}
+	if(bbr->mode == BBR_DRAIN && in_flight <= _bdp(bbr, 1))
+		_enter_probe_bw(bbr, now);
+}
+
+static void _update_min_RTT(congestion_control_t cc, struct bbr* bbr, const struct congestion_control_rate_sample* rs, double now){
+	int expired = (bbr->min_RTT && now > bbr->min_RTT_stamp + BBR_MIN_RTT_WINDOW);
+	if(rs->RTT > 0 && (!bbr->min_RTT || rs->RTT <= bbr->min_RTT || expired)){
+		bbr->min_RTT = rs->RTT;
+		bbr->min_RTT_stamp = now;
+	}
+
+	if(expired && bbr->mode != BBR_PROBE_RTT){
+		bbr->mode = BBR_PROBE_RTT;
+		bbr->pacing_gain = 1;
+		bbr->prior_cwnd = MAX(bbr->prior_cwnd, cc->cwnd);
+		bbr->probe_RTT_done = 0;
+	}
+	if(bbr->mode != BBR_PROBE_RTT)
+		return;
+
+	// wait for what's in flight to get down to the minimum, then hang out there for a bit
+	if(!bbr->probe_RTT_done && rs->in_flight <= BBR_MIN_CWND(cc->mss))
+		bbr->probe_RTT_done = now + BBR_PROBE_RTT_TIME;
+	else if(bbr->probe_RTT_done && now > bbr->probe_RTT_done){
+		bbr->min_RTT_stamp = now;
+		cc->cwnd = MAX(cc->cwnd, bbr->prior_cwnd);
+		bbr->prior_cwnd = 0;
+		if(bbr->full_pipe)
+			_enter_probe_bw(bbr, now);
+		else{
+			bbr->mode = BBR_STARTUP;
+			bbr->pacing_gain = BBR_HIGH_GAIN;
+			bbr->cwnd_gain = BBR_HIGH_GAIN;
+		}
+	}
+}
+
+static void _set_pacing_rate(congestion_control_t cc, struct bbr* bbr){
+	double rate;
+	if(bbr->btl_bw > 0)
+		rate = bbr->pacing_gain*bbr->btl_bw;
+	else if(bbr->min_RTT > 0)
+		// nothing measured yet -- go by the initial window
+		rate = bbr->pacing_gain*CONGESTION_CONTROL_INITIAL_WINDOW(cc->mss)/bbr->min_RTT;
+	else
+		return;
+	// during STARTUP only ever speed up
+	if(bbr->full_pipe || rate > cc->pacing_rate)
+		cc->pacing_rate = rate;
+}
+
+static void _set_cwnd(congestion_control_t cc, struct bbr* bbr, const struct congestion_control_rate_sample* rs){
+	uint32_t target = bbr->btl_bw > 0 && bbr->min_RTT > 0
+		? _bdp(bbr, bbr->cwnd_gain) + 3*cc->mss // (a few more to keep the pipe full through delayed and stretched acks)
+		: CONGESTION_CONTROL_INITIAL_WINDOW(cc->mss);
+
+	if(cc->in_recovery)
+		// packet conservation -- what the recovery left us, but no more than the model
+		cc->cwnd = MIN(cc->cwnd, MAX(target, BBR_MIN_CWND(cc->mss)));
+	else{
+		if(bbr->prior_cwnd && bbr->mode != BBR_PROBE_RTT){
+			// just got out of recovery: back to where we were
+			cc->cwnd = MAX(cc->cwnd, bbr->prior_cwnd);
+			bbr->prior_cwnd = 0;
+		}
+		if(bbr->full_pipe)
+			cc->cwnd = MIN(cc->cwnd + rs->acked, target);
+		else if(cc->cwnd < target || rs->delivered < CONGESTION_CONTROL_INITIAL_WINDOW(cc->mss))
+			cc->cwnd += rs->acked;
+	}
+	cc->cwnd = MAX(cc->cwnd, BBR_MIN_CWND(cc->mss));
+	if(bbr->mode == BBR_PROBE_RTT)
+		cc->cwnd = MIN(cc->cwnd, BBR_MIN_CWND(cc->mss));
+}
+
+static void _bbr_on_rate_sample(congestion_control_t cc, const struct congestion_control_rate_sample* rs){
+	struct bbr* bbr = (struct bbr*)cc->priv;
+	double now = congestion_control_now();
+
+	_update_round(bbr, rs);
+	_update_btl_bw(bbr, rs);
+	_check_cycle_phase(bbr, rs->in_flight, now);
+	_check_full_pipe(bbr, rs);
+	_check_drain(bbr, rs->in_flight, now);
+	_update_min_RTT(cc, bbr, rs, now);
+
+	_set_pacing_rate(cc, bbr);
+	_set_cwnd(cc, bbr, rs);
+}
+
+// everything goes by the model -- see _bbr_on_rate_sample
+static void _bbr_on_ack(congestion_control_t cc, uint32_t acked, uint32_t in_flight, double RTT){
+}
+
+static void _bbr_on_loss(congestion_control_t cc, uint32_t in_flight){
+	struct bbr* bbr = (struct bbr*)cc->priv;
+	// no backing off, just don't send more than leaves the network until recovery's over
+	bbr->prior_cwnd = MAX(bbr->prior_cwnd, cc->cwnd);
+	cc->cwnd = in_flight + cc->mss;
+}
+
+static void _bbr_on_rto(congestion_control_t cc, uint32_t in_flight){
+	struct bbr* bbr = (struct bbr*)cc->priv;
+	bbr->prior_cwnd = MAX(bbr->prior_cwnd, cc->cwnd);
+	cc->cwnd = cc->mss;
+}
+
+const struct congestion_control_ops bbr_ops = {
+	.name = "bbr",
+	.init = _bbr_init,
+	.destroy = _bbr_destroy,
+	.on_ack = _bbr_on_ack,
+	.on_loss = _bbr_on_loss,
+	.on_rto = _bbr_on_rto,
+	.on_rate_sample = _bbr_on_rate_sample,
+};
@@ -0,0 +1,194 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "congestion_control.h"
+#include "utils.h"
+
+// every algorithm we have, for congestion_control_find
+static const struct congestion_control_ops* _algorithms[] = {
+	&newreno_ops,
+	&cubic_ops,
+	&bbr_ops,
+	NULL
+};
+
+// a is at or after b (seqnums wrap)
+#define SEQ_GEQ(a,b) ((int32_t)((a)-(b)) >= 0)
+
+double congestion_control_now(){
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return now.tv_sec + now.tv_usec/1000000.0;
+}
+
+// writes down where cwnd and ssthresh are now, if that's different from last time
+static void _record(congestion_control_t cc){
+	struct congestion_control_sample* last;
+	if(cc->history_count){
+		last = &(cc->history[(cc->history_start + cc->history_count - 1) % CONGESTION_CONTROL_HISTORY]);
+		if(last->cwnd == cc->cwnd && last->ssthresh == cc->ssthresh)
+			return;
+	}
+	if(cc->history_count == CONGESTION_CONTROL_HISTORY)
+		// full -- write over the oldest
+		cc->history_start = (cc->history_start + 1) % CONGESTION_CONTROL_HISTORY;
+	else
+		cc->history_count++;
+
+	last = &(cc->history[(cc->history_start + cc->history_count - 1) % CONGESTION_CONTROL_HISTORY]);
+	last->time = congestion_control_now() - cc->start_time;
+	last->cwnd = cc->cwnd;
+	last->ssthresh = cc->ssthresh;
+}
+
+congestion_control_t congestion_control_init(const struct congestion_control_ops* ops, uint32_t mss){
+	congestion_control_t cc = (congestion_control_t)malloc(sizeof(struct congestion_control));
+	cc->ops = ops;
+	cc->priv = NULL;
+	cc->mss = mss;
+	cc->pacing_rate = 0;
+	cc->cwnd = CONGESTION_CONTROL_INITIAL_WINDOW(mss);
+	cc->ssthresh = (uint32_t)-1; // as big as it gets until the first loss
+	cc->dup_acks = 0;
+	cc->in_recovery = 0;
+	cc->recover = 0;
+	cc->sack = 0;
+	cc->history_start = cc->history_count = 0;
+	cc->start_time = congestion_control_now();
+	if(ops->init)
+		ops->init(cc);
+	_record(cc);
+	return cc;
+}
+
+void congestion_control_destroy(congestion_control_t* cc){
+	if((*cc)->ops->destroy)
+		(*cc)->ops->destroy(*cc);
+	free(*cc);
+	*cc = NULL;
+}
+
+const struct congestion_control_ops* congestion_control_find(const char* name){
+	int i;
+	for(i=0;_algorithms[i];i++){
+		if(!strcmp(_algorithms[i]->name, name))
+			return _algorithms[i];
+	}
+	return NULL;
+}
+
+int congestion_control_on_ack(congestion_control_t cc, uint32_t ack, uint32_t acked, uint32_t in_flight, double RTT){
+	cc->dup_acks = 0;
+	if(!cc->in_recovery){
+		cc->ops->on_ack(cc, acked, in_flight, RTT);
+		_record(cc);
+		return 0;
+	}
+	/* RFC 6582: a full ack -- everything that was out when we started recovering got here -- 
+		deflates the window back down to ssthresh and ends recovery */
+	if(SEQ_GEQ(ack, cc->recover)){
+		cc->in_recovery = 0;
+		cc->cwnd = cc->sack ? cc->ssthresh : MIN(cc->ssthresh, MAX(in_flight, cc->mss) + cc->mss);
+		_record(cc);
+		return 0;
+	}
+	/* with a scoreboard, the send_window knows which holes to fill and what's left the network, 
+		so there's nothing to inflate or deflate */
+	if(cc->sack)
+		return 0;
+	/* a partial ack means the next segment was lost too: retransmit it, and deflate the window
+		by however much got acked, but let one more segment out for the one that just left */
+	cc->cwnd = (cc->cwnd > acked ? cc->cwnd - acked : 0) + cc->mss;
+	_record(cc);
+	return 1;
+}
+
+// fast retransmit, and recover until everything sent so far is acked
+static void _enter_recovery(congestion_control_t cc, uint32_t snd_nxt, uint32_t in_flight){
+	cc->ops->on_loss(cc, in_flight);
+	cc->in_recovery = 1;
+	cc->recover = snd_nxt;
+}
+
+int congestion_control_on_dup_ack(congestion_control_t cc, uint32_t snd_nxt, uint32_t in_flight){
+	cc->dup_acks++;
+	if(cc->in_recovery){
+		// another segment left the network
+		cc->cwnd += cc->mss;
+		_record(cc);
+		return 0;
+	}
+	if(cc->dup_acks != DUP_ACK_THRESHOLD)
+		return 0;
+
+	_enter_recovery(cc, snd_nxt, in_flight);
+	// the three segments that got there after the lost one have left the network
+	cc->cwnd += DUP_ACK_THRESHOLD*cc->mss;
+	_record(cc);
+	return 1;
+}
+
+int congestion_control_enter_recovery(congestion_control_t cc, uint32_t snd_nxt, uint32_t in_flight){
+	if(cc->in_recovery)
+		return 0;
+	_enter_recovery(cc, snd_nxt, in_flight);
+	_record(cc);
+	return 1;
+}
+
+void congestion_control_set_mss(congestion_control_t cc, uint32_t mss){
+	cc->mss = mss;
+	cc->cwnd = CONGESTION_CONTROL_INITIAL_WINDOW(mss);
+	_record(cc);
+}
+
+void congestion_control_set_sack(congestion_control_t cc, int sack){
+	cc->sack = sack;
+}
+
+void congestion_control_on_rto(congestion_control_t cc, uint32_t in_flight){
+	cc->ops->on_rto(cc, in_flight);
+	cc->dup_acks = 0;
+	cc->in_recovery = 0;
+	_record(cc);
+}
+
+void congestion_control_on_rate_sample(congestion_control_t cc, const struct congestion_control_rate_sample* rs){
+	if(!cc->ops->on_rate_sample)
+		return;
+	cc->ops->on_rate_sample(cc, rs);
+	_record(cc);
+}
+
+uint32_t congestion_control_get_cwnd(congestion_control_t cc){
+	return cc->cwnd;
+}
+
+double congestion_control_get_pacing_rate(congestion_control_t cc){
+	return cc->pacing_rate;
+}
+
+void congestion_control_print(congestion_control_t cc){
+	printf("\t congestion control: %s\n\t congestion window: %u\n", cc->ops->name, cc->cwnd);
+	if(cc->ssthresh == (uint32_t)-1)
+		printf("\t slow start threshold: none yet\n");
+	else
+		printf("\t slow start threshold: %u\n", cc->ssthresh);
+	if(cc->pacing_rate > 0)
+		printf("\t pacing rate: %.0f bytes/s\n", cc->pacing_rate);
+	if(cc->in_recovery)
+		printf("\t in fast recovery%s\n", cc->sack ? " (SACK)" : "");
+
+	printf("\t congestion window history (last %d changes):\n", cc->history_count);
+	int i;
+	struct congestion_control_sample* sample;
+	for(i=0;i<cc->history_count;i++){
+		sample = &(cc->history[(cc->history_start + i) % CONGESTION_CONTROL_HISTORY]);
+		printf("\t\t%9.3fs  cwnd %u", sample->time, sample->cwnd);
+		if(sample->ssthresh != (uint32_t)-1)
+			printf("  ssthresh %u", sample->ssthresh);
+		printf("\n");
+	}
+}
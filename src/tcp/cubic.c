@@ -0,0 +1,173 @@
+/* CUBIC (RFC 9438) -- after a loss, cwnd grows as a cubic function of the time since the loss rather
+	than of the number of RTTs, so it gets back up to where it was (W_max) fast, plateaus around there,
+	and then probes past it fast again.  That's what gets a long, fat path full in a reasonable amount
+	of time, where Reno's one segment per RTT would take forever.
+
+	Slow start exits early with HyStart (the delay increase part of RFC 9406): once the smallest RTT
+	seen in a round of slow start is noticeably bigger than the last round's, the queues along the way
+	are filling up, so we stop doubling before we overshoot and lose a whole window's worth. */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "congestion_control.h"
+#include "utils.h"
+
+#define CUBIC_C 0.4
+#define CUBIC_BETA 0.7
+// Reno's additive increase, scaled to what CUBIC's beta would make it (RFC 9438 4.3)
+#define CUBIC_ALPHA (3.0*(1.0-CUBIC_BETA)/(1.0+CUBIC_BETA))
+
+// don't bother with HyStart until cwnd's at least this many segments
+#define HYSTART_LOW_WINDOW 16
+// how many RTT samples a round needs before we trust its smallest one
+#define HYSTART_MIN_SAMPLES 8
+// the RTT has to go up by last round's/8, but at least 4ms and no more than 16ms
+#define HYSTART_MIN_ETA 0.004
+#define HYSTART_MAX_ETA 0.016
+
+struct cubic{
+	/* everything window-ish is in segments */
+	double w_max; // cwnd right before the last reduction
+	double w_last_max; // w_max before that, for fast convergence
+	double w_est; // what Reno would have by now -- never do worse than that
+	double K; // how long after epoch_start the cubic gets back to origin
+	double origin;
+	double epoch_start; // when this congestion avoidance epoch started, 0 if it hasn't yet
+	double min_RTT; // smallest RTT we've seen (0 until there is one)
+
+	/* HyStart: a round is over once everything that was in flight when it started has been acked */
+	uint32_t round_left; // bytes still to be acked this round
+	double round_min_RTT;
+	double last_round_min_RTT;
+	int round_samples;
+};
+
+static void _cubic_init(congestion_control_t cc){
+	struct cubic* cubic = (struct cubic*)malloc(sizeof(struct cubic));
+	memset(cubic, 0, sizeof(struct cubic));
+	cc->priv = cubic;
+}
+
+static void _cubic_destroy(congestion_control_t cc){
+	free(cc->priv);
+	cc->priv = NULL;
+}
+
+/* returns 1 if slow start should be over */
+static int _hystart(congestion_control_t cc, struct cubic* cubic, uint32_t acked, uint32_t in_flight, double RTT){
+	int done = 0;
+
+	if(RTT > 0 && cubic->round_samples < HYSTART_MIN_SAMPLES){
+		if(!cubic->round_samples || RTT < cubic->round_min_RTT)
+			cubic->round_min_RTT = RTT;
+		cubic->round_samples++;
+	}
+	if(cc->cwnd >= HYSTART_LOW_WINDOW*cc->mss && cubic->last_round_min_RTT > 0
+		&& cubic->round_samples >= HYSTART_MIN_SAMPLES){
+		double eta = MIN(HYSTART_MAX_ETA, MAX(HYSTART_MIN_ETA, cubic->last_round_min_RTT/8));
+		if(cubic->round_min_RTT >= cubic->last_round_min_RTT + eta)
+			done = 1;
+	}
+
+	if(acked >= cubic->round_left){
+		// on to the next round
+		if(cubic->round_samples)
+			cubic->last_round_min_RTT = cubic->round_min_RTT;
+		cubic->round_samples = 0;
+		cubic->round_left = MAX(in_flight, cc->mss);
+	}
+	else
+		cubic->round_left -= acked;
+
+	return done;
+}
+
+static void _cubic_update(congestion_control_t cc, struct cubic* cubic, uint32_t acked){
+	double cwnd = cc->cwnd/(double)cc->mss;
+	double now = congestion_control_now();
+
+	if(!cubic->epoch_start){
+		cubic->epoch_start = now;
+		if(cwnd < cubic->w_max){
+			cubic->K = cbrt((cubic->w_max - cwnd)/CUBIC_C);
+			cubic->origin = cubic->w_max;
+		}
+		else{
+			cubic->K = 0;
+			cubic->origin = cwnd;
+		}
+		cubic->w_est = cwnd;
+	}
+
+	// where the cubic will be an RTT from now
+	double t = now - cubic->epoch_start + cubic->min_RTT;
+	double target = cubic->origin + CUBIC_C*(t - cubic->K)*(t - cubic->K)*(t - cubic->K);
+	target = MIN(MAX(target, cwnd), 1.5*cwnd);
+
+	// grow by (target-cwnd)/cwnd per segment acked, so we get to target in about an RTT
+	cc->cwnd += (uint32_t)((target - cwnd)/cwnd*acked);
+
+	cubic->w_est += CUBIC_ALPHA*(acked/(double)cc->mss)/cwnd;
+	if(cubic->w_est*cc->mss > cc->cwnd)
+		cc->cwnd = (uint32_t)(cubic->w_est*cc->mss);
+}
+
+static void _cubic_on_ack(congestion_control_t cc, uint32_t acked, uint32_t in_flight, double RTT){
+	struct cubic* cubic = (struct cubic*)cc->priv;
+
+	if(RTT > 0 && (!cubic->min_RTT || RTT < cubic->min_RTT))
+		cubic->min_RTT = RTT;
+
+	if(cc->cwnd < cc->ssthresh){
+		if(_hystart(cc, cubic, acked, in_flight, RTT))
+			cc->ssthresh = cc->cwnd;
+		else{
+			// slow start
+			cc->cwnd += MIN(acked, cc->mss);
+			return;
+		}
+	}
+	_cubic_update(cc, cubic, acked);
+}
+
+// what every reduction does to w_max and ssthresh
+static void _cubic_reduce(congestion_control_t cc, struct cubic* cubic){
+	double cwnd = cc->cwnd/(double)cc->mss;
+
+	// fast convergence: if we didn't even make it back to the last w_max, let go of some more for newer flows
+	if(cwnd < cubic->w_last_max){
+		cubic->w_last_max = cwnd;
+		cubic->w_max = cwnd*(1.0+CUBIC_BETA)/2;
+	}
+	else
+		cubic->w_last_max = cubic->w_max = cwnd;
+
+	cc->ssthresh = MAX((uint32_t)(cc->cwnd*CUBIC_BETA), 2*cc->mss);
+	cubic->epoch_start = 0;
+}
+
+static void _cubic_on_loss(congestion_control_t cc, uint32_t in_flight){
+	_cubic_reduce(cc, (struct cubic*)cc->priv);
+	cc->cwnd = cc->ssthresh;
+}
+
+static void _cubic_on_rto(congestion_control_t cc, uint32_t in_flight){
+	struct cubic* cubic = (struct cubic*)cc->priv;
+	_cubic_reduce(cc, cubic);
+	// back to slow start, with a fresh HyStart
+	cc->cwnd = cc->mss;
+	cubic->round_left = 0;
+	cubic->round_samples = 0;
+	cubic->last_round_min_RTT = 0;
+}
+
+const struct congestion_control_ops cubic_ops = {
+	.name = "cubic",
+	.init = _cubic_init,
+	.destroy = _cubic_destroy,
+	.on_ack = _cubic_on_ack,
+	.on_loss = _cubic_on_loss,
+	.on_rto = _cubic_on_rto,
+	.on_rate_sample = NULL,
+};
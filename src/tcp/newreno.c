@@ -0,0 +1,34 @@
+/* NewReno (RFC 5681 and RFC 6582) -- slow start up to ssthresh, then one more segment per RTT,
+	and halve on loss.  Fast retransmit/recovery is done for us by congestion_control.c */
+#include "congestion_control.h"
+#include "utils.h"
+
+static void _newreno_on_ack(congestion_control_t cc, uint32_t acked, uint32_t in_flight, double RTT){
+	if(cc->cwnd < cc->ssthresh)
+		// slow start
+		cc->cwnd += MIN(acked, cc->mss);
+	else
+		// congestion avoidance: about a segment per cwnd's worth acked
+		cc->cwnd += MAX(1, cc->mss*cc->mss/cc->cwnd);
+}
+
+static void _newreno_on_loss(congestion_control_t cc, uint32_t in_flight){
+	cc->ssthresh = MAX(in_flight/2, 2*cc->mss);
+	cc->cwnd = cc->ssthresh;
+}
+
+static void _newreno_on_rto(congestion_control_t cc, uint32_t in_flight){
+	cc->ssthresh = MAX(in_flight/2, 2*cc->mss);
+	// loss window -- start over with slow start
+	cc->cwnd = cc->mss;
+}
+
+const struct congestion_control_ops newreno_ops = {
+	.name = "newreno",
+	.init = NULL,
+	.destroy = NULL,
+	.on_ack = _newreno_on_ack,
+	.on_loss = _newreno_on_loss,
+	.on_rto = _newreno_on_rto,
+	.on_rate_sample = NULL,
+};
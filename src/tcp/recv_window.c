@@ -2,60 +2,82 @@
 #include <string.h>
 #include <inttypes.h>
 #include <pthread.h>
+#include <sys/uio.h>
 
 #include "recv_window.h"
-#include "ext_array.h"
-#include "queue.h"
+#include "packet_pool.h"
 
-#define QUEUE_CAPACITY 1024
-
-recv_chunk_t recv_chunk_init(uint32_t seq, void* data, int l){
+recv_chunk_t recv_chunk_init(uint32_t seq, void* data, int l, char* buffer){
 	recv_chunk_t rc = malloc(sizeof(struct recv_chunk));
 	rc->seqnum = seq;
 	rc->data = data;
 	rc->length = l;
+	rc->buffer = buffer;
+	rc->next = NULL;
 	return rc;
 }
 
-// this destroys the data it was holding!!
+// this releases the buffer it was holding!!
 void recv_chunk_destroy(recv_chunk_t* rc){
-	free((*rc)->data);
+	packet_pool_release((*rc)->buffer);
 	free(*rc);
 	*rc=NULL;
 }
-	
-int recv_chunk_compare(recv_chunk_t a, recv_chunk_t b){
-	if(a->seqnum < b->seqnum) return -1;
-	else return 1;
+
+/* a new chunk pointing into buffer, with its own reference to it */
+static recv_chunk_t _recv_chunk_slice(uint32_t seq, void* data, int l, char* buffer){
+	packet_pool_ref(buffer);
+	return recv_chunk_init(seq, data, l, buffer);
 }
 
+/* a contiguous range [left, right) of what's been received past a hole, as the chunks that make it 
+	up, in seqnum order */
+struct recv_range{
+	uint32_t left;
+	uint32_t right;
+	recv_chunk_t first;
+	recv_chunk_t last;
+};
+
 /*
 			RECV WINDOW 
 */
 
 struct recv_window {
-	ext_array_t data_queue;
-	sorted_list_t chunks_received;
-
-	uint16_t size;
-	uint16_t available_size;
+	/* in-order recv_chunks waiting on the application, oldest first, linked through their next -- only 
+		the reader ever takes them off, so what recv_window_peek hands out stays put until it's consumed */
+	recv_chunk_t read_head;
+	recv_chunk_t read_tail;
+	/* what's been received past a hole: the ranges are in seqnum order, and never overlap or touch 
+		(ranges that would get merged), so finding where a segment goes is a binary search.  There's 
+		never more than RECV_WINDOW_MAX_OUT_OF_ORDER chunks in them, so there's never more ranges either */
+	struct recv_range* ranges;
+	int num_ranges;
+	int out_of_order_chunks;
+
+	uint32_t size;
+	uint32_t available_size;
 	uint32_t left;
 	uint32_t read_left;
+	uint32_t last_out_of_order; // seqnum of the last chunk received out of order -- its block gets SACKed first
 //	recv_window_chunk_t* slider;
 	pthread_cond_t read_cond;
 	pthread_mutex_t mutex;
 };
 
-recv_window_t recv_window_init(uint16_t window_size, uint32_t ISN){
+recv_window_t recv_window_init(uint32_t window_size, uint32_t ISN){
 	recv_window_t recv_window = (struct recv_window*)malloc(sizeof(struct recv_window));
-	recv_window->data_queue = ext_array_init(QUEUE_CAPACITY);
-	recv_window->chunks_received = sorted_list_init((comparator_f)recv_chunk_compare);
+	recv_window->read_head = recv_window->read_tail = NULL;
+	recv_window->ranges = malloc(RECV_WINDOW_MAX_OUT_OF_ORDER*sizeof(struct recv_range));
+	recv_window->num_ranges = 0;
+	recv_window->out_of_order_chunks = 0;
 	recv_window->size = window_size;
 	recv_window->available_size = window_size;
 	
 	/* the next byte you're expecting is the one after the 
 		first sequence number */
 	recv_window->read_left = recv_window->left = (ISN+1)%MAX_SEQNUM;
+	recv_window->last_out_of_order = recv_window->read_left;
 
 	/* initialize your cond */
 	pthread_cond_init(&(recv_window->read_cond), NULL);
@@ -152,21 +174,135 @@ uint32_t recv_window_get_ack(recv_window_t recv_window){
 }
 
 /* returns the current size of the window, which is currently dynamic */
-uint16_t recv_window_get_size(recv_window_t recv_window){
+uint32_t recv_window_get_size(recv_window_t recv_window){
 	return recv_window->available_size;
 }
 
+// the first range that doesn't end before seqnum (num_ranges if they all do)
+static int _range_find(recv_window_t recv_window, uint32_t seqnum){
+	int low = 0, high = recv_window->num_ranges, mid;
+	while(low < high){
+		mid = (low + high)/2;
+		if(SEQ_DIFF(recv_window->ranges[mid].right, seqnum) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+/* puts chunk (which doesn't overlap any of the ranges) in before range i, merging it into the ranges
+	on either side if it touches them
+	returns the index of the range it ended up in */
+static int _range_add(recv_window_t recv_window, int i, recv_chunk_t chunk){
+	struct recv_range* ranges = recv_window->ranges;
+	uint32_t left = chunk->seqnum, right = (chunk->seqnum + chunk->length) % MAX_SEQNUM;
+	int joins_left = (i > 0 && ranges[i-1].right == left),
+		joins_right = (i < recv_window->num_ranges && ranges[i].left == right);
+
+	recv_window->out_of_order_chunks++;
+	if(joins_left){
+		ranges[i-1].last->next = chunk;
+		ranges[i-1].last = chunk;
+		ranges[i-1].right = right;
+		if(joins_right){
+			// it filled in the hole between them
+			ranges[i-1].last->next = ranges[i].first;
+			ranges[i-1].last = ranges[i].last;
+			ranges[i-1].right = ranges[i].right;
+			memmove(ranges+i, ranges+i+1, (recv_window->num_ranges-i-1)*sizeof(struct recv_range));
+			recv_window->num_ranges--;
+		}
+		return i-1;
+	}
+	if(joins_right){
+		chunk->next = ranges[i].first;
+		ranges[i].first = chunk;
+		ranges[i].left = left;
+		return i;
+	}
+	memmove(ranges+i+1, ranges+i, (recv_window->num_ranges-i)*sizeof(struct recv_range));
+	recv_window->num_ranges++;
+	ranges[i].left = left;
+	ranges[i].right = right;
+	ranges[i].first = ranges[i].last = chunk;
+	return i;
+}
+
+/* keeps the parts of [seqnum, seqnum+length) (past a hole) that we don't have yet, as slices of buffer 
+	-- unless we're holding onto as many chunks as we're allowed to already */
+static void _range_store(recv_window_t recv_window, void* data, uint32_t length, uint32_t seqnum, char* buffer){
+	uint32_t cur = seqnum, end = (seqnum + length) % MAX_SEQNUM, piece_end;
+	int i = _range_find(recv_window, cur);
+	struct recv_range* ranges = recv_window->ranges;
+
+	// (starts inside of what we've got)
+	if(i < recv_window->num_ranges && SEQ_DIFF(ranges[i].left, cur) <= 0){
+		cur = ranges[i].right;
+		i++;
+	}
+	while(SEQ_DIFF(end, cur) > 0){
+		if(recv_window->out_of_order_chunks == RECV_WINDOW_MAX_OUT_OF_ORDER)
+			return;
+		// up to the next range (which it merges into) or the end
+		piece_end = (i < recv_window->num_ranges && SEQ_DIFF(ranges[i].left, end) < 0) ? ranges[i].left : end;
+		i = _range_add(recv_window, i, 
+			_recv_chunk_slice(cur, data + SEQ_DIFF(cur, seqnum), SEQ_DIFF(piece_end, cur), buffer));
+		recv_window->last_out_of_order = cur;
+		cur = ranges[i].right;
+		i++;
+	}
+}
+
+/* puts chunk at the end of what's waiting to be read */
+static void _to_read_push(recv_window_t recv_window, recv_chunk_t chunk){
+	chunk->next = NULL;
+	if(recv_window->read_tail)
+		recv_window->read_tail->next = chunk;
+	else
+		recv_window->read_head = chunk;
+	recv_window->read_tail = chunk;
+}
+
+/* the first range is at (or before) read_left now: hands the part of it past read_left over to be read */
+static void _range_deliver(recv_window_t recv_window){
+	recv_chunk_t chunk = recv_window->ranges[0].first, next;
+	int overlap;
+
+	recv_window->num_ranges--;
+	memmove(recv_window->ranges, recv_window->ranges+1, recv_window->num_ranges*sizeof(struct recv_range));
+
+	for(;chunk;chunk=next){
+		next = chunk->next;
+		recv_window->out_of_order_chunks--;
+
+		overlap = SEQ_DIFF(recv_window->read_left, chunk->seqnum);
+		if(overlap >= chunk->length){
+			// the in-order data already covered all of it
+			recv_chunk_destroy(&chunk);
+			continue;
+		}
+		chunk->data   += overlap;
+		chunk->length -= overlap;
+		chunk->seqnum  = recv_window->read_left;
+
+		recv_window->read_left 		+= chunk->length;
+		recv_window->available_size -= chunk->length;
+		_to_read_push(recv_window, chunk);
+	}
+}
+
 /* 
 recv_window_receive
 	takes in a window, a pointer, the length associated with the memory pointed to by
 	that pointer, and also the sequence number of the given data (the first octet of that
-	data). This function performs all the necessary sliding window functions, and then returns
-	the ACK number to send back. If there is no such number (ie the window didn't slide at all, 
-	it will return -1.
+	data). This function performs all the necessary sliding window functions.
 
-	stores the data directly, so give it something that it can free!
+	data points into buffer, and nothing is copied: whatever part of data lands in the window
+	is kept as a slice of buffer (a recv_chunk holding its own reference), and only gets copied 
+	once the application reads it
 */
-void recv_window_receive_synchronized(recv_window_t recv_window, void* data, uint32_t length, uint32_t seqnum){
+void recv_window_receive_synchronized(recv_window_t recv_window, void* data, uint32_t length, uint32_t seqnum, char* buffer){
 	int offset = recv_window_validate_seqnum(recv_window, seqnum, length);
 	if(offset<0){
 		LOG(("seqnum %d not accepted. left: %d\n", seqnum, recv_window->left)); 
@@ -184,102 +320,218 @@ void recv_window_receive_synchronized(recv_window_t recv_window, void* data, uin
 		return;
 	}
 
-	/* if the data has a non-zero offset, then we will need to make a new chunk
-		   of data that the recv_chunk can point to so that when it frees that void* 
-		   pointer it actually does something. Let me illustrate:
+	/* rather than copying the data past the offset into a new chunk, just slice it */
+	data += offset;
+	seqnum = (seqnum+offset)%MAX_SEQNUM;
 
-		   void* chunk = malloc(100);
-		   free(chunk+1); // LEAK!
-		   free(chunk);   // good
-	*/
- 	if(offset > 0){
- 		void* new_data = malloc(to_write);
- 		memcpy(new_data, data+offset, to_write);
- 		free(data);
- 		data = new_data;
- 	}
-
-
-	int already_read_overlap = WRAP_DIFF((seqnum+offset)%MAX_SEQNUM, recv_window->read_left, MAX_SEQNUM);
+	int already_read_overlap = SEQ_DIFF(recv_window->read_left, seqnum);
 	if(already_read_overlap >= 0)
 	{
-		to_write -= already_read_overlap;
-
-		ext_array_push(recv_window->data_queue, data+already_read_overlap, to_write);
-		free(data);
+		/* if all of it has already been received, there's nothing new to queue up */
+		if(already_read_overlap < (int)to_write){
+			to_write -= already_read_overlap;
 
-		recv_window->read_left      += to_write;
-		recv_window->available_size -= to_write;
+			_to_read_push(recv_window, _recv_chunk_slice(recv_window->read_left, data+already_read_overlap, to_write, buffer));
 
-		/* then go through and see if this connects to the next received_chunk */
-		recv_chunk_t next_chunk;
-		
-		int overlap;
-		while((next_chunk = sorted_list_peek(recv_window->chunks_received))){		
-
-			/* if the next chunk is farther along then the last byte that's been read, 
-			   then just continue */
-			if(WRAP_DIFF(next_chunk->seqnum, recv_window->read_left, MAX_SEQNUM) < 0) 
-				break;
-			
-			// better be the same!
-			next_chunk = sorted_list_pop(recv_window->chunks_received);
-
-			/* check the overlap between the chunk that you've previously
-			   received and the chunk that was just read */
-			overlap = WRAP_DIFF(next_chunk->seqnum, recv_window->read_left, MAX_SEQNUM);
-
-			/* if the overlap is less than the length of the chunk (ie the 
-			   chunk that was in the received list isn't completely covered
-			   by the chunk taht was just pushed) then push its data */
-			if(overlap < next_chunk->length){
-				ext_array_push(recv_window->data_queue, next_chunk->data+overlap, next_chunk->length-overlap);
-	
-				/* only incremente the read_left/decrement the available size by 
-				   the amount that you actually used from the most recent chunk */
-				recv_window->read_left 		+= next_chunk->length-overlap;
-				recv_window->available_size -= next_chunk->length-overlap;
-			}
-			
-			/* destroy that chunk */
-			recv_chunk_destroy(&next_chunk);
+			recv_window->read_left      += to_write;
+			recv_window->available_size -= to_write;
 		}
+
+		/* then hand over whatever was waiting past the hole this filled in */
+		while(recv_window->num_ranges && SEQ_DIFF(recv_window->ranges[0].left, recv_window->read_left) <= 0)
+			_range_deliver(recv_window);
 	}
 	else
-	{
- 		sorted_list_insert(recv_window->chunks_received, recv_chunk_init(seqnum, data, to_write)); 
-	}	
+		_range_store(recv_window, data, to_write, seqnum, buffer);
 	
 	// inform any interested parties that you just got some new stuff
 	pthread_cond_signal(&(recv_window->read_cond));
 }
   
+void recv_window_receive_buffer(recv_window_t recv_window, void* data, uint32_t length, uint32_t seqnum, char* buffer){
+	/* nothing to slice, so make something */
+	if(!buffer){
+		buffer = packet_pool_alloc_unpooled(length);
+		memcpy(buffer, data, length);
+		recv_window_receive_buffer(recv_window, buffer, length, seqnum, buffer);
+		packet_pool_release(buffer);
+		return;
+	}
+
+	pthread_mutex_lock(&(recv_window->mutex));
+	recv_window_receive_synchronized(recv_window, data, length, seqnum, buffer);
+	pthread_mutex_unlock(&(recv_window->mutex));
+}
+
 void recv_window_receive(recv_window_t recv_window, void* data, uint32_t length, uint32_t seqnum){
+	recv_window_receive_buffer(recv_window, data, length, seqnum, NULL);
+	free(data);
+}
+
+/* puts the block [left, right) in blocks -- first if it has the most recently received chunk in it
+	(RFC 2018 says that one goes first), otherwise after what's there if there's room */
+static int _sack_block(recv_window_t recv_window, uint32_t* blocks, int n, int max, uint32_t left, uint32_t right){
+	if(BETWEEN_WRAP(recv_window->last_out_of_order, left, (right-1)%MAX_SEQNUM)){
+		// make room at the front (letting go of the last one if it's full)
+		memmove(blocks+2, blocks, 2*MIN(n, max-1)*sizeof(uint32_t));
+		blocks[0] = left;
+		blocks[1] = right;
+		return MIN(n+1, max);
+	}
+	if(n == max)
+		return n;
+	blocks[2*n] = left;
+	blocks[2*n+1] = right;
+	return n+1;
+}
+
+/*
+recv_window_get_sack_blocks
+	fills blocks with (up to max) left and right edge pairs for the contiguous blocks of data we've
+	received past a hole, for a SACK option
+
+	returns
+		how many blocks there are, 0 if there's no hole
+*/
+int recv_window_get_sack_blocks_synchronized(recv_window_t recv_window, uint32_t* blocks, int max){
+	int i, n = 0;
+	for(i=0;i<recv_window->num_ranges;i++)
+		n = _sack_block(recv_window, blocks, n, max, recv_window->ranges[i].left, recv_window->ranges[i].right);
+	return n;
+}
+
+int recv_window_get_sack_blocks(recv_window_t recv_window, uint32_t* blocks, int max){
+	pthread_mutex_lock(&(recv_window->mutex));
+	int ret = recv_window_get_sack_blocks_synchronized(recv_window, blocks, max);
+	pthread_mutex_unlock(&(recv_window->mutex));
+	return ret;
+}
+
+/*
+recv_window_consume
+	lets go of the next bytes of in-order data (as many as there are, if there's less), 
+	and of each chunk once it's been gone all the way through 
+
+	returns
+		the number of bytes consumed
+*/
+int recv_window_consume_synchronized(recv_window_t recv_window, int bytes){
+	recv_chunk_t chunk;
+	int consumed = 0, n;
+
+	while(consumed < bytes && (chunk = recv_window->read_head)){
+		n = MIN(bytes-consumed, chunk->length);
+		consumed += n;
+
+		chunk->data    += n;
+		chunk->length  -= n;
+		chunk->seqnum  += n;
+		if(!chunk->length){
+			if(!(recv_window->read_head = chunk->next))
+				recv_window->read_tail = NULL;
+			recv_chunk_destroy(&chunk);
+		}
+	}
+	
+	recv_window->available_size+=consumed;
+	recv_window->left = (recv_window->left+consumed) % MAX_SEQNUM;	
+	return consumed;
+}
+
+int recv_window_consume(recv_window_t recv_window, int bytes){
+	pthread_mutex_lock(&(recv_window->mutex));
+	int ret = recv_window_consume_synchronized(recv_window, bytes);
+	pthread_mutex_unlock(&(recv_window->mutex));
+	return ret;
+}
+
+/*
+recv_window_peek
+	fills iov with (up to max of) the slices of in-order data, as they sit in the packets they came in 
+	-- nothing gets copied or taken out of the window, see recv_window_consume for that
+
+	returns
+		how many slices there are, 0 if there is nothing to read
+*/
+int recv_window_peek_synchronized(recv_window_t recv_window, struct iovec* iov, int max){
+	recv_chunk_t chunk;
+	int n = 0;
+
+	for(chunk=recv_window->read_head; chunk && n < max; chunk=chunk->next, n++){
+		iov[n].iov_base = chunk->data;
+		iov[n].iov_len  = chunk->length;
+	}
+	return n;
+}
+
+int recv_window_peek(recv_window_t recv_window, struct iovec* iov, int max){
+	pthread_mutex_lock(&(recv_window->mutex));
+	int ret = recv_window_peek_synchronized(recv_window, iov, max);
+	pthread_mutex_unlock(&(recv_window->mutex));
+	return ret;
+}
+
+/*
+recv_window_readv
+	copies as much of the in-order data as will fit into the iovcnt buffers in iov (filling 
+	each before going on to the next), straight out of the chunks, then consumes it
+
+	returns
+		the number of bytes copied, 0 if there is nothing
+*/
+int recv_window_readv_synchronized(recv_window_t recv_window, const struct iovec* iov, int iovcnt){
+	recv_chunk_t chunk = recv_window->read_head;
+	int copied = 0, chunk_off = 0, iov_off = 0, i = 0, n;
+
+	while(chunk && i < iovcnt){
+		n = MIN(chunk->length-chunk_off, (int)iov[i].iov_len-iov_off);
+		memcpy(iov[i].iov_base+iov_off, chunk->data+chunk_off, n);
+		copied    += n;
+		chunk_off += n;
+		iov_off   += n;
+
+		if(chunk_off == chunk->length){
+			chunk = chunk->next;
+			chunk_off = 0;
+		}
+		if(iov_off == (int)iov[i].iov_len){
+			i++;
+			iov_off = 0;
+		}
+	}
+	return recv_window_consume_synchronized(recv_window, copied);
+}
+
+int recv_window_readv(recv_window_t recv_window, const struct iovec* iov, int iovcnt){
 	pthread_mutex_lock(&(recv_window->mutex));
-	recv_window_receive_synchronized(recv_window, data, length, seqnum);
+	int ret = recv_window_readv_synchronized(recv_window, iov, iovcnt);
 	pthread_mutex_unlock(&(recv_window->mutex));
+	return ret;
+}
+
+int recv_window_read(recv_window_t recv_window, void* dest, int bytes){
+	struct iovec iov = { .iov_base = dest, .iov_len = MAX(bytes, 0) };
+	return recv_window_readv(recv_window, &iov, 1);
 }
 
 /*
 recv_window_get_next
-	gets the next recv_window_chunk_t from the to_read queue. 
+	same as recv_window_read, but mallocs the memory to read into
 
 	returns
-		recv_window_chunk_t pointing to the next thing that the application
-		should read. Remember when reading from this that there is a field
-		called 'offset' which indicates from what offset to start reading
-		the payload of the window_chunk
+		memchunk_t with the next (up to bytes) bytes the application should read
 		
 		NULL if there is nothing
 */
 memchunk_t recv_window_get_next_synchronized(recv_window_t recv_window, int bytes){
-	memchunk_t got = ext_array_peel(recv_window->data_queue, bytes); 
-	if(!got)
+	int length = MIN(bytes, (int)WRAP_DIFF(recv_window->left, recv_window->read_left, MAX_SEQNUM));
+	if(length <= 0)
 		return NULL;
-	
-	recv_window->available_size+=got->length;
-	recv_window->left = (recv_window->left+got->length) % MAX_SEQNUM;	
-	return got;
+
+	void* data = malloc(length);
+	struct iovec iov = { .iov_base = data, .iov_len = length };
+	length = recv_window_readv_synchronized(recv_window, &iov, 1);
+	return memchunk_init(data, length);
 }
 
 memchunk_t recv_window_get_next(recv_window_t recv_window, int bytes){
@@ -298,8 +550,18 @@ recv_window_destroy
 	be null
 */
 void recv_window_destroy(recv_window_t* recv_window){
-	ext_array_destroy(&((*recv_window)->data_queue));
-	sorted_list_destroy_total(&((*recv_window)->chunks_received), (destructor_f)recv_chunk_destroy);
+	recv_chunk_t chunk, next;
+	int i;
+	for(chunk=(*recv_window)->read_head;chunk;chunk=next){
+		next = chunk->next;
+		recv_chunk_destroy(&chunk);
+	}
+	for(i=0;i<(*recv_window)->num_ranges;i++)
+		for(chunk=(*recv_window)->ranges[i].first;chunk;chunk=next){
+			next = chunk->next;
+			recv_chunk_destroy(&chunk);
+		}
+	free((*recv_window)->ranges);
 
 	pthread_mutex_destroy(&((*recv_window)->mutex));
 	pthread_cond_destroy(&((*recv_window)->read_cond));
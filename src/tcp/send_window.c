@@ -2,96 +2,46 @@
 #include <string.h>
 #include <time.h>
 #include <pthread.h>
+#include <math.h>
 
-#include "queue.h"
-#include "ext_array.h"
+#include "packet_pool.h"
+#include "mirror_buffer.h"
 #include "send_window.h"
 #include "utils.h"
-#include "list.h"
 
-#define QUEUE_CAPACITY 1024
+// how many chunks the ring of sent chunks starts off with room for (it doubles whenever it fills up)
+#define CHUNKS_INITIAL_CAPACITY 64
 
-#define wrap_src_memcpy(dst, src, src_offset, size, modulo)	\
-do{															\
-	int write_right = MIN((modulo) - (src_offset), size);	\
-	memcpy(dst, (src)+(src_offset), write_right);			\
-	memcpy((dst)+write_right, (src)+0, (size)-write_right);	\
-} 															\
-while(0)
+/* next_timeout when the retransmission timer isn't running */
+#define TIMEOUT_NONE -1
+// how many chunks' worth of sending a late pacing timer can catch up on at once
+#define PACING_BURST 2
 
-#define send_window_memcpy(win, src, length) 					\
-do{																\
-	int write_right = MIN(((win)->size+1) - (((win)->right)%((win)->size+1)), length);\
-	memcpy(((win)->slider)+(((win)->right)%((win)->size+1)), 	\
-			(src), write_right);								\
-	memcpy(((win)->slider)+0, (src)+write_right, (length)-write_right);\
-} 																\
-while(0)
-
-#define send_window_get_seqnum(send_window, offset)\
-	((send_window->wrap_count)*((send_window->size)+1)+(offset)) % MAX_SEQNUM 
-
-typedef struct timed_chunk* timed_chunk_t;
-
-/////////////// AUXILIARY DATA STRUCTURES /////////////////////////
-
-///////////// WINDOW CHUNK ////////////
-
-/* gets data from left all the way up to (but NOT including) right */
-send_window_chunk_t send_window_chunk_init(send_window_t send_window, void* data, int length, uint32_t seqnum){
-	send_window_chunk_t send_window_chunk = malloc(sizeof(struct send_window_chunk));
-	
-	gettimeofday(&(send_window_chunk->send_time), NULL);
-	send_window_chunk->resending = 0;
-	send_window_chunk->data   = data;
-	send_window_chunk->seqnum = seqnum;
-	send_window_chunk->length = length;
-	send_window_chunk->resent = 0;
-	send_window_chunk->offset = 0;
-	
-	return send_window_chunk;
-}
-
-void send_window_chunk_destroy(send_window_chunk_t* wc){ 
-	free(*wc); 
-	*wc = NULL;
-}
-
-void send_window_chunk_destroy_total(send_window_chunk_t* wc, destructor_f destructor){
-	destructor(&((*wc)->data));
-	send_window_chunk_destroy(wc);
-}	
-
-void send_window_chunk_destroy_free(send_window_chunk_t* wc){
-	free((*wc)->data);
-	send_window_chunk_destroy(wc);
-}
-
-
-/////////////////////////
-/* RFC:     An Example Retransmission Timeout Procedure
-
-      Measure the elapsed time between sending a data octet with a
-      particular sequence number and receiving an acknowledgment that
-      covers that sequence number (segments sent do not have to match
-      segments received).  This measured elapsed time is the Round Trip
-      Time (RTT).  Next compute a Smoothed Round Trip Time (SRTT) as:
-
-        SRTT = ( ALPHA * SRTT ) + ((1-ALPHA) * RTT)
-
-      and based on this, compute the retransmission timeout (RTO) as:
-
-        RTO = min[UBOUND,max[LBOUND,(BETA*SRTT)]]
-
-      where UBOUND is an upper bound on the timeout (e.g., 1 minute),
-      LBOUND is a lower bound on the timeout (e.g., 1 second), ALPHA is
-      a smoothing factor (e.g., .8 to .9), and BETA is a delay variance
-      factor (e.g., 1.3 to 2.0). */
 ///////////// WINDOW //////////////////
 struct send_window{
-	ext_array_t data_queue;
-	plain_list_t sent_list;
-	queue_t timed_out_chunks;
+	/* the send buffer: a mirror_buffer that push copies the app's data straight into, holding everything
+		pushed and not acked yet -- what's in flight (the chunks, in order) and then the unsent bytes.  
+		A chunk is just a slice of it, so once they've been pushed the bytes are never copied again, and
+		fresh packets point right into it too (see get_next_data).  It's only made on the first push, 
+		and has a fixed capacity: push takes no more than brings it up to buffer_size (or that, if 
+		buffer_size has grown since -- it's only remade bigger once it's empty), and writers waiting 
+		on room are told to go ahead once it's back down to low_watermark */
+	mirror_buffer_t ring;
+	uint32_t unsent;
+	uint32_t buffer_size;
+	uint32_t low_watermark;
+
+	/* what's been sent and not acked yet: a ring of chunks in seqnum order, the oldest (the one at
+		the left of the window) at head.  An ack just moves head up past what it acked, and finding
+		the chunk with a given seqnum is a binary search.  It doubles in size whenever it fills up */
+	struct send_window_chunk* chunks;
+	uint32_t chunks_capacity; // a power of 2
+	uint32_t head;
+	uint32_t count;
+	/* how many of those are waiting to be resent (resending or fast_retransmit) -- there are none 
+		before resend_hint (counting from head), so get_next doesn't have to look at those again */
+	uint32_t to_resend;
+	uint32_t resend_hint;
 
 	uint32_t sent_left;	
 	uint32_t size;
@@ -102,35 +52,177 @@ struct send_window{
 		synchronizes over all functions */
 	pthread_mutex_t mutex;
 	
-	/* for calculating RTO */	
+	/* for calculating RTO (RFC 6298, see send_window.h) */	
 	double RTO;
 	double SRTT;
+	double RTTVAR;
 	double ALPHA;
 	double BETA;
 	double UBOUND; //upper bound
 	double LBOUND; //lower bound
+
+	/* the retransmission timer: when (in gettimeofday seconds) it goes off, TIMEOUT_NONE if it isn't running */
+	double next_timeout;
+
+	/* congestion control: no more than cwnd bytes out on the network at once.  What's
+		out on the network is what's been sent and not acked, less what timed out and is 
+		waiting to be resent (lost) */
+	congestion_control_t cc;
+	uint32_t lost;
+	uint32_t last_ack_size; // the peer's window as of the last ack, to tell duplicate acks from window updates
+
+	/* delivery rate estimation: how many bytes have been acked so far and when the last of them
+		were, when the chunk that got acked most recently was sent, and -- if we ran out of things
+		to send -- what delivered will be once everything sent up until then is acked.  Samples
+		from before then only say how fast we were sending, not how fast the path is */
+	uint64_t delivered;
+	double delivered_time;
+	double first_sent_time;
+	uint64_t app_limited;
+
+	/* pacing: when congestion control gives us a pacing rate, chunks go out no sooner than
+		next_send_time.  paced is set if get_next held something back for it */
+	double next_send_time;
+	int paced;
+
+	/* SACK (RFC 2018/6675): if the peer does it, sacked is how many bytes of what's in flight it's 
+		told us it has (each of those chunks is marked sacked).  That's the scoreboard -- those 
+		never get resent, and the holes below them are what get presumed lost.  The first sack_done 
+		chunks (counting from head) are all either SACKed or already presumed lost, so loss detection
+		doesn't have to look at them again */
+	int sack;
+	uint32_t sacked;
+	uint32_t sack_done;
+
+	/* holding back segments smaller than a chunk: nagle holds one back while anything's unacked 
+		(RFC 896), cork holds it back until it's turned off, and flushing (nothing more is coming) 
+		overrides them both */
+	int nagle;
+	int cork;
+	int flushing;
 };
-// recalculates SRTT and RTO and returns new RTO
-double _recalculate_RTO(send_window_t send_window, double RTT){
-	/* RFC:       SRTT = ( ALPHA * SRTT ) + ((1-ALPHA) * RTT)
-					 and based on this, compute the retransmission timeout (RTO) as:
-				  RTO = min[UBOUND,max[LBOUND,(BETA*SRTT)]] 
-	*/
-	if((send_window->SRTT == 0) && (RTT != 0)){
+
+// bytes sent and not acked yet
+#define _in_flight(send_window) WRAP_DIFF((send_window)->left, (send_window)->sent_left, MAX_SEQNUM)
+// everything that's been pushed and not acked yet
+#define _buffered(send_window) ((send_window)->ring ? (uint32_t)mirror_buffer_size((send_window)->ring) : 0)
+
+// what congestion control counts against cwnd: what's in flight and hasn't been lost or SACKed
+static uint32_t _pipe(send_window_t send_window){
+	uint32_t in_flight = _in_flight(send_window), gone = send_window->lost + send_window->sacked;
+	return in_flight > gone ? in_flight - gone : 0;
+}
+
+static double _now(){
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return now.tv_sec + now.tv_usec/1000000.0;
+}
+
+// the i'th chunk that's out, counting from the oldest
+#define _chunk(send_window, i) (&((send_window)->chunks[((send_window)->head + (i)) & ((send_window)->chunks_capacity - 1)]))
+
+// adds a chunk to the newest end of the ring (making room if it's full)
+static send_window_chunk_t _chunk_push(send_window_t send_window, void* data, int length, uint32_t seqnum){
+	if(send_window->count == send_window->chunks_capacity){
+		struct send_window_chunk* chunks = malloc(2*send_window->chunks_capacity*sizeof(struct send_window_chunk));
+		uint32_t i;
+		for(i=0;i<send_window->count;i++)
+			chunks[i] = *_chunk(send_window, i);
+		free(send_window->chunks);
+		send_window->chunks = chunks;
+		send_window->chunks_capacity *= 2;
+		send_window->head = 0;
+	}
+
+	send_window_chunk_t chunk = _chunk(send_window, send_window->count);
+	memset(chunk, 0, sizeof(struct send_window_chunk));
+	gettimeofday(&(chunk->send_time), NULL);
+	chunk->data = data;
+	chunk->seqnum = seqnum;
+	chunk->length = length;
+	send_window->count++;
+	return chunk;
+}
+
+// lets go of the oldest chunk (and its bytes in the send buffer) -- it's been acked
+static void _chunk_pop(send_window_t send_window){
+	send_window_chunk_t chunk = _chunk(send_window, 0);
+	if(chunk->sacked)
+		send_window->sacked -= chunk->length;
+	else if(chunk->resending)
+		send_window->lost -= chunk->length;
+	if(chunk->resending || chunk->fast_retransmit)
+		send_window->to_resend--;
+	mirror_buffer_consume(send_window->ring, chunk->length);
+
+	send_window->head++;
+	send_window->count--;
+	if(send_window->resend_hint)
+		send_window->resend_hint--;
+	if(send_window->sack_done)
+		send_window->sack_done--;
+}
+
+/* which chunk (counting from the oldest) is the first that doesn't start before seqnum 
+	-- count if they all do */
+static uint32_t _chunk_find(send_window_t send_window, uint32_t seqnum){
+	uint32_t low = 0, high = send_window->count, mid;
+	while(low < high){
+		mid = (low + high)/2;
+		if(SEQ_DIFF(_chunk(send_window, mid)->seqnum, seqnum) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+// the i'th chunk goes on the list of ones to resend (resending or fast_retransmit has just been set)
+static void _chunk_resend(send_window_t send_window, uint32_t i){
+	send_window->to_resend++;
+	send_window->resend_hint = MIN(send_window->resend_hint, i);
+}
+
+/* a chunk just went out: starts the retransmission timer if it isn't running already, remembers where 
+	delivery was at for its rate sample, and pushes back when the next one can go out if we're pacing */
+static void _chunk_sent(send_window_t send_window, send_window_chunk_t chunk){
+	double now = _now();
+	if(send_window->next_timeout == TIMEOUT_NONE)
+		send_window->next_timeout = now + send_window->RTO;
+
+	// nothing else out there: the sample starts now
+	if(_pipe(send_window) <= (uint32_t)chunk->length)
+		send_window->first_sent_time = send_window->delivered_time = now;
+	chunk->delivered = send_window->delivered;
+	chunk->delivered_time = send_window->delivered_time;
+	chunk->first_sent_time = send_window->first_sent_time;
+	chunk->app_limited = (send_window->app_limited != 0);
+
+	send_window->paced = 0;
+	double rate = congestion_control_get_pacing_rate(send_window->cc);
+	if(rate > 0)
+		/* (a timer that went off late can make up for a little lost time, but not turn into a burst) */
+		send_window->next_send_time = MAX(send_window->next_send_time, now - PACING_BURST*send_window->send_size/rate) 
+										+ chunk->length/rate;
+}
+// recalculates SRTT, RTTVAR and RTO from a new RTT measurement and returns new RTO
+static double _recalculate_RTO(send_window_t send_window, double RTT){
+	if(send_window->SRTT == 0){
 		//let's set our first SRTT value as this first RTT value
 		send_window->SRTT = RTT;
+		send_window->RTTVAR = RTT/2;
 	}
 	else{
-		send_window->SRTT = ((send_window->ALPHA)*(send_window->SRTT)) + ((1-send_window->ALPHA)*RTT);
+		// (RTTVAR goes by the old SRTT)
+		send_window->RTTVAR = (1-send_window->BETA)*(send_window->RTTVAR) + (send_window->BETA)*fabs(send_window->SRTT - RTT);
+		send_window->SRTT = (1-send_window->ALPHA)*(send_window->SRTT) + (send_window->ALPHA)*RTT;
 	}
 	
-	if(send_window->SRTT == 0){
-		send_window->RTO = 1.0;
-		return 1.0;
-	}
-	send_window->RTO = MIN(send_window->UBOUND, MAX(send_window->LBOUND, (send_window->BETA)*(send_window->SRTT)));
+	send_window->RTO = send_window->SRTT + MAX(WINDOW_GRANULARITY, WINDOW_K*(send_window->RTTVAR));
+	send_window->RTO = MIN(send_window->UBOUND, MAX(send_window->LBOUND, send_window->RTO));
 	
-	print(("new RTT: %f, new SRTT: %f, new RTO: %f", RTT, send_window->SRTT, send_window->RTO), SEND_WINDOW_PRINT);
+	print(("new RTT: %f, new SRTT: %f, new RTTVAR: %f, new RTO: %f", RTT, send_window->SRTT, send_window->RTTVAR, send_window->RTO), SEND_WINDOW_PRINT);
 	
 	return send_window->RTO;
 }
@@ -139,9 +231,14 @@ send_window_t send_window_init(int window_size, int send_size, int ISN,
 								double ALPHA, double BETA, double UBOUND, double LBOUND){
 	send_window_t send_window = (send_window_t)malloc(sizeof(struct send_window));
 
-	send_window->data_queue 	  = ext_array_init(QUEUE_CAPACITY);
-	send_window->sent_list		  = plain_list_init();
-	send_window->timed_out_chunks = queue_init();
+	send_window->buffer_size = DEFAULT_SEND_BUFFER_SIZE;
+	send_window->low_watermark = DEFAULT_SEND_LOW_WATERMARK;
+	send_window->ring = NULL;
+	send_window->unsent = 0;
+	send_window->chunks = malloc(CHUNKS_INITIAL_CAPACITY*sizeof(struct send_window_chunk));
+	send_window->chunks_capacity = CHUNKS_INITIAL_CAPACITY;
+	send_window->head = send_window->count = 0;
+	send_window->to_resend = send_window->resend_hint = 0;
 
 	send_window->send_size  = send_size;
 	send_window->size = window_size;
@@ -153,24 +250,83 @@ send_window_t send_window_init(int window_size, int send_size, int ISN,
 	send_window->BETA = BETA;
 	send_window->UBOUND = UBOUND;
 	send_window->LBOUND = LBOUND;
-	send_window->RTO = 0;
+	// no measurements yet
+	send_window->RTO = WINDOW_INITIAL_RTO;
 	send_window->SRTT = 0;
-	_recalculate_RTO(send_window, 0);
+	send_window->RTTVAR = 0;
+	send_window->next_timeout = TIMEOUT_NONE;
+
+	send_window->cc = congestion_control_init(congestion_control_find(CONGESTION_CONTROL_DEFAULT), send_size);
+	send_window->lost = 0;
+	send_window->last_ack_size = window_size;
+
+	send_window->delivered = 0;
+	send_window->delivered_time = send_window->first_sent_time = _now();
+	send_window->app_limited = 0;
+	send_window->next_send_time = 0;
+	send_window->paced = 0;
+
+	send_window->sack = 0;
+	send_window->sacked = 0;
+	send_window->sack_done = 0;
+	send_window->nagle = 1;
+	send_window->cork = 0;
+	send_window->flushing = 0;
 	
 	return send_window;
 }
 
 void send_window_destroy(send_window_t* send_window){
-	ext_array_destroy(&((*send_window)->data_queue));
-
-	plain_list_destroy_total(&((*send_window)->sent_list), (destructor_f)send_window_chunk_destroy_free);
-	queue_destroy(&((*send_window)->timed_out_chunks));
+	// (packets still on their way out have their own references to the send buffer)
+	if((*send_window)->ring)
+		mirror_buffer_destroy(&((*send_window)->ring));
+	free((*send_window)->chunks);
+	congestion_control_destroy(&((*send_window)->cc));
 	pthread_mutex_destroy(&((*send_window)->mutex));
 
 	free(*send_window);
 	*send_window = NULL;
 }
 
+/* everything but the socket options (the send buffer's size, nagle and cork) goes back to how init
+	left it, with the same congestion control starting over from scratch */
+void send_window_reset(send_window_t send_window, int window_size, int send_size, int ISN){
+	pthread_mutex_lock(&(send_window->mutex));
+	// (packets still on their way out have their own references to the send buffer)
+	if(send_window->ring)
+		mirror_buffer_destroy(&(send_window->ring));
+	send_window->unsent = 0;
+	send_window->head = send_window->count = 0;
+	send_window->to_resend = send_window->resend_hint = 0;
+
+	send_window->send_size = send_size;
+	send_window->size = window_size;
+	send_window->left = send_window->sent_left = ISN;
+
+	send_window->RTO = WINDOW_INITIAL_RTO;
+	send_window->SRTT = 0;
+	send_window->RTTVAR = 0;
+	send_window->next_timeout = TIMEOUT_NONE;
+
+	const struct congestion_control_ops* ops = send_window->cc->ops;
+	congestion_control_destroy(&(send_window->cc));
+	send_window->cc = congestion_control_init(ops, send_size);
+	send_window->lost = 0;
+	send_window->last_ack_size = window_size;
+
+	send_window->delivered = 0;
+	send_window->delivered_time = send_window->first_sent_time = _now();
+	send_window->app_limited = 0;
+	send_window->next_send_time = 0;
+	send_window->paced = 0;
+
+	send_window->sack = 0;
+	send_window->sacked = 0;
+	send_window->sack_done = 0;
+	send_window->flushing = 0;
+	pthread_mutex_unlock(&(send_window->mutex));
+}
+
 double send_window_get_RTO(send_window_t send_window){
 	return send_window->RTO;
 }
@@ -192,18 +348,58 @@ int send_window_validate_ack(send_window_t send_window, uint32_t ack){
 	return -1;
 }
 
-void send_window_push_synchronized(send_window_t send_window, void* data, int length){
-	ext_array_push(send_window->data_queue, data, length);
+int send_window_push_synchronized(send_window_t send_window, void* data, int length){
+	mirror_buffer_t ring = send_window->ring;
+	if(!ring || (!mirror_buffer_size(ring) && (uint32_t)mirror_buffer_capacity(ring) < send_window->buffer_size)){
+		if(ring)
+			mirror_buffer_destroy(&ring);
+		ring = send_window->ring = mirror_buffer_init(send_window->buffer_size);
+	}
+
+	uint32_t buffered = mirror_buffer_size(ring);
+	if(buffered >= send_window->buffer_size)
+		return 0;
+	length = mirror_buffer_push(ring, data, MIN((uint32_t)length, send_window->buffer_size - buffered));
+	send_window->unsent += length;
+	return length;
+}
+
+int send_window_pushv(send_window_t send_window, const struct iovec* iov, int iovcnt){
+	int i, pushed = 0, n;
+	pthread_mutex_lock(&(send_window->mutex));
+	for(i=0;i<iovcnt;i++){
+		n = send_window_push_synchronized(send_window, iov[i].iov_base, iov[i].iov_len);
+		pushed += n;
+		if(n < (int)iov[i].iov_len)
+			break;
+	}
+	pthread_mutex_unlock(&(send_window->mutex));
+	return pushed;
+}
+
+void send_window_set_buffer(send_window_t send_window, uint32_t size, uint32_t low_watermark){
+	pthread_mutex_lock(&(send_window->mutex));
+	send_window->buffer_size = size;
+	send_window->low_watermark = MIN(low_watermark, size);
+	pthread_mutex_unlock(&(send_window->mutex));
+}
+
+int send_window_writable(send_window_t send_window){
+	pthread_mutex_lock(&(send_window->mutex));
+	int ret = (_buffered(send_window) <= send_window->low_watermark);
+	pthread_mutex_unlock(&(send_window->mutex));
+	return ret;
 }
 
 void send_window_set_seq(send_window_t send_window, uint32_t seq){
      send_window->left = send_window->sent_left = seq;
 }
      
-void send_window_push(send_window_t sw, void* d, int l){
+int send_window_push(send_window_t sw, void* d, int l){
 	pthread_mutex_lock(&(sw->mutex));
-	send_window_push_synchronized(sw, d, l);
+	int ret = send_window_push_synchronized(sw, d, l);
 	pthread_mutex_unlock(&(sw->mutex));
+	return ret;
 }
 
 // just add a function for getting the next sequence number
@@ -219,12 +415,43 @@ uint32_t send_window_get_next_seq(send_window_t send_window){
 	return ret;
 }
 
+int send_window_get_unsent(send_window_t send_window){
+	pthread_mutex_lock(&(send_window->mutex));
+	int ret = send_window->unsent;
+	pthread_mutex_unlock(&(send_window->mutex));
+	return ret;
+}
+
 send_window_chunk_t send_window_get_next_synchronized(send_window_t send_window){
 	send_window_chunk_t sw_chunk;
-	if((sw_chunk=(send_window_chunk_t)queue_pop(send_window->timed_out_chunks)) != NULL){
-		/* restart its timer (it's still on the sent list!) */
+	uint32_t cwnd = congestion_control_get_cwnd(send_window->cc);
+
+	if(congestion_control_get_pacing_rate(send_window->cc) > 0 && _now() < send_window->next_send_time){
+		if(send_window->to_resend || send_window->unsent)
+			send_window->paced = 1;
+		return NULL;
+	}
+
+	/* resends first, oldest first */
+	if(send_window->to_resend){
+		uint32_t i;
+		for(i=send_window->resend_hint;i<send_window->count;i++)
+			if((sw_chunk = _chunk(send_window, i))->resending || sw_chunk->fast_retransmit)
+				break;
+		send_window->resend_hint = i;
+
+		// fast retransmits go out no matter what, everything else waits on the congestion window
+		if(!sw_chunk->fast_retransmit && _pipe(send_window) + sw_chunk->length > cwnd)
+			return NULL;
+
+		if(sw_chunk->resending)
+			send_window->lost -= sw_chunk->length; // back out on the network
+		/* restart its timer */
 		gettimeofday(&(sw_chunk->send_time), NULL);
 		sw_chunk->resending = 0;
+		sw_chunk->fast_retransmit = 0;
+		send_window->to_resend--;
+		_chunk_sent(send_window, sw_chunk);
 		return sw_chunk;
 	}
 
@@ -241,19 +468,33 @@ send_window_chunk_t send_window_get_next_synchronized(send_window_t send_window)
 	if(to_send <= 0) {
 	 	return NULL;
 	}
+	/* a sliver waits for more to be pushed if it can */
+	int unsent = send_window->unsent;
+	if(unsent && unsent < (int)send_window->send_size && !send_window->flushing
+		&& (send_window->cork || (send_window->nagle && _in_flight(send_window))))
+		return NULL;
 
-	memchunk_t chunk = ext_array_peel(send_window->data_queue, to_send);
-	if(!chunk || chunk->length==0)	
+	/* only whole chunks go out against the congestion window (unless nothing's out at all), 
+		so that it doesn't get filled up with slivers */
+	uint32_t pipe = _pipe(send_window);
+	if(pipe && pipe + to_send > cwnd)
 		return NULL;
 
-	/* generate the chunk to send and add it to the sent_list */
-	sw_chunk = send_window_chunk_init(send_window, chunk->data, chunk->length, sent_left);
-	plain_list_append(send_window->sent_list, sw_chunk);
+	int length = MIN(to_send, unsent);
+	if(length == 0){
+		// we've got room to send but nothing to send: rate samples are app-limited until what's out gets acked
+		send_window->app_limited = MAX(send_window->delivered + _in_flight(send_window), 1);
+		return NULL;
+	}
+	// the chunk is the first of the unsent bytes in the send buffer, where they already are
+	sw_chunk = _chunk_push(send_window, mirror_buffer_data(send_window->ring) + mirror_buffer_size(send_window->ring) - unsent, 
+							length, sent_left);
+	send_window->unsent -= length;
 
 	/* increment the sent_left */
-	send_window->sent_left = (sent_left + chunk->length) % MAX_SEQNUM;
+	send_window->sent_left = (sent_left + length) % MAX_SEQNUM;
+	_chunk_sent(send_window, sw_chunk);
 
-	free(chunk);
 	return sw_chunk;
 }
 
@@ -264,12 +505,152 @@ send_window_chunk_t send_window_get_next(send_window_t send_window){
 	return chunk;
 }
 
-void send_window_ack_synchronized(send_window_t send_window, int seqnum){
+/* takes the reference to the chunk's data while we still hold the lock -- once we let go
+	an ack can come in and free the chunk.  A chunk going out for the first time can just point into 
+	the send buffer: its bytes can't be acked (and so written over) before it's even been sent.  A resend
+	can, if the original turns up in the meantime, so it gets a copy of its own */
+int send_window_get_next_data(send_window_t send_window, uint32_t* seqnum, char** data, char** buffer, mirror_buffer_t* ring){
+	int length = 0;
+	pthread_mutex_lock(&(send_window->mutex));
+	send_window_chunk_t chunk = send_window_get_next_synchronized(send_window);
+	if(chunk){
+		*seqnum = chunk->seqnum;
+		length = chunk->length;
+		if(chunk->resent){
+			*buffer = packet_pool_alloc_unpooled(length);
+			memcpy(*buffer, chunk->data, length);
+			*data = *buffer;
+			*ring = NULL;
+		}
+		else{
+			mirror_buffer_ref(send_window->ring);
+			*ring = send_window->ring;
+			*data = chunk->data;
+			*buffer = NULL;
+		}
+	}
+	pthread_mutex_unlock(&(send_window->mutex));
+	return length;
+}
+
+/* queues up the chunk at the left of the window to be resent right away */
+static void _fast_retransmit(send_window_t send_window){
+	if(!send_window->count)
+		return;
+	send_window_chunk_t chunk = _chunk(send_window, 0);
+	if(!chunk->resending && !chunk->fast_retransmit){
+		print(("------------fast retransmit---------------"), SEND_WINDOW_PRINT);
+		chunk->fast_retransmit = 1;
+		chunk->sack_lost = 1; // (it's being seen to, the scoreboard doesn't need to as well)
+		chunk->resent = (chunk->resent) + 1;
+		_chunk_resend(send_window, 0);
+	}
+}
+
+/* RFC 6675: a chunk that hasn't been SACKed is presumed lost once DUP_ACK_THRESHOLD chunks after it
+	have been, or more than DUP_ACK_THRESHOLD-1 chunks' worth of bytes after it have.  Those get queued up 
+	to be resent, oldest first, as the pipe lets them, and the first one starts fast recovery.  Each
+	chunk only gets this once -- if the resend gets lost too, that's for the RTO */
+static void _sack_detect_loss(send_window_t send_window){
+	send_window_chunk_t chunk, oldest_lost = NULL;
+	uint32_t sacked_above = 0, i;
+	int sacked_count = 0;
+
+	// nothing SACKed, nothing to presume lost
+	if(!send_window->sacked)
+		return;
+
+	/* (newest first, so everything SACKed above a chunk has been counted by the time we get to it)  
+		a chunk that's already been presumed lost is skipped, not stopped at: one below it that was 
+		waiting on an RTO resend back then still needs looking at once that's gone out */
+	for(i=send_window->count;i-- > send_window->sack_done;){
+		chunk = _chunk(send_window, i);
+		if(chunk->sacked){
+			sacked_above += chunk->length;
+			sacked_count++;
+			continue;
+		}
+		if(chunk->sack_lost || chunk->resending || chunk->fast_retransmit)
+			continue;
+		if(sacked_count < DUP_ACK_THRESHOLD && sacked_above <= (DUP_ACK_THRESHOLD-1)*send_window->send_size)
+			continue;
+
+		chunk->sack_lost = 1;
+		chunk->resending = 1;
+		chunk->resent = (chunk->resent) + 1;
+		send_window->lost += chunk->length;
+		_chunk_resend(send_window, i);
+		oldest_lost = chunk;
+	}
+	// nothing left to do for any of the oldest ones that are SACKed or presumed lost by now
+	while(send_window->sack_done < send_window->count 
+			&& ((chunk = _chunk(send_window, send_window->sack_done))->sacked || chunk->sack_lost))
+		send_window->sack_done++;
+
+	if(oldest_lost && congestion_control_enter_recovery(send_window->cc, send_window->sent_left, _in_flight(send_window))){
+		print(("------------SACK recovery---------------"), SEND_WINDOW_PRINT);
+		// the first retransmission goes out right away
+		oldest_lost->fast_retransmit = 1;
+	}
+}
+
+/*
+send_window_sack
+	marks everything that blocks (n left and right edge pairs, from the peer's SACK option) covers 
+	as SACKed
+*/
+void send_window_sack_synchronized(send_window_t send_window, uint32_t* blocks, int n){
+	send_window_chunk_t chunk;
+	uint32_t left, right, j;
+	int i;
+
+	for(i=0;i<n;i++){
+		left = blocks[2*i];
+		right = blocks[2*i+1];
+		// only blocks of what's in flight mean anything
+		if(SEQ_DIFF(left, send_window->left) <= 0 || SEQ_DIFF(right, left) <= 0 || SEQ_DIFF(right, send_window->sent_left) > 0)
+			continue;
+
+		for(j=_chunk_find(send_window, left);j<send_window->count;j++){
+			chunk = _chunk(send_window, j);
+			if(SEQ_DIFF(chunk->seqnum+chunk->length, right) > 0)
+				break;
+			if(chunk->sacked)
+				continue;
+			chunk->sacked = 1;
+			send_window->sacked += chunk->length;
+			// it's not lost after all
+			if(chunk->resending)
+				send_window->lost -= chunk->length;
+			if(chunk->resending || chunk->fast_retransmit)
+				send_window->to_resend--;
+			chunk->resending = chunk->fast_retransmit = 0;
+		}
+	}
+}
+
+void send_window_sack(send_window_t sw, uint32_t* blocks, int n){
+	pthread_mutex_lock(&(sw->mutex));
+	send_window_sack_synchronized(sw, blocks, n);
+	pthread_mutex_unlock(&(sw->mutex));
+}
+
+void send_window_ack_synchronized(send_window_t send_window, int seqnum, int seg_len){
 	int send_window_min = send_window->left,
 		send_window_max = (send_window->left+send_window->size) % MAX_SEQNUM;
 	
 	//if(seqnum==send_window->left || seqnum==(send_window->left+send_window->size+1)%MAX_SEQNUM)
 	if(seqnum==send_window->left){
+		/* a duplicate ack (rather than just a window update, or the peer's own data going the other 
+			way with the same ack on it) means something after the left of the window got there, and 
+			the left of the window probably didn't -- with SACK, the scoreboard says exactly what did */
+		if(send_window->sack)
+			_sack_detect_loss(send_window);
+		else if(_in_flight(send_window) && !seg_len && send_window->size == send_window->last_ack_size){
+			if(congestion_control_on_dup_ack(send_window->cc, send_window->sent_left, _in_flight(send_window)))
+				_fast_retransmit(send_window);
+		}
+		send_window->last_ack_size = send_window->size;
 		return;
 	}
 
@@ -278,97 +659,130 @@ void send_window_ack_synchronized(send_window_t send_window, int seqnum){
 		return; 
 	}
 
+	uint32_t old_left = send_window->left;
 	send_window->left = seqnum;
+	send_window->last_ack_size = send_window->size;
 	
-	plain_list_t list = send_window->sent_list;
-	plain_list_el_t el;
 	send_window_chunk_t chunk;
 	
-	double RTT;
+	double RTT, RTT_sample = 0;
 	struct timeval now, chunk_timer;
 	gettimeofday(&now, NULL);
+	/* the rate sample comes from the most recently sent chunk this acks (some of) */
+	struct congestion_control_rate_sample rs;
+	double newest_sent = 0, prior_time = 0, first_sent_time = 0, sent;
 	
-	uint32_t toCheck=seqnum-1;
-	PLAIN_LIST_ITER(list, el)
-		chunk = (send_window_chunk_t)el->data;
-		if(BETWEEN_WRAP(toCheck, chunk->seqnum, (chunk->seqnum+chunk->length)%MAX_SEQNUM)){
-			/* this is the chunk containing the ack, so move the pointer of 
-				chunk up until its pointing to the as-of-yet unsent data */ 
-			chunk->offset += WRAP_DIFF(chunk->seqnum, seqnum, MAX_SEQNUM);
+	int acked;
+	// everything that starts before the ack, oldest first
+	while(send_window->count && SEQ_DIFF((chunk = _chunk(send_window, 0))->seqnum, seqnum) < 0){
+		sent = chunk->send_time.tv_sec + chunk->send_time.tv_usec/1000000.0;
+		if(!newest_sent || sent > newest_sent){
+			newest_sent = sent;
+			rs.prior_delivered = chunk->delivered;
+			rs.app_limited = chunk->app_limited;
+			prior_time = chunk->delivered_time;
+			first_sent_time = chunk->first_sent_time;
+		}
 
+		acked = WRAP_DIFF(chunk->seqnum, seqnum, MAX_SEQNUM);
+		if(acked <= chunk->length){
+			// this is the chunk containing the ack
 			if(!chunk->resent){
 				chunk_timer = chunk->send_time;
 				RTT = now.tv_sec - chunk_timer.tv_sec;
 				RTT += now.tv_usec/1000000.0 - chunk_timer.tv_usec/1000000.0;
 				_recalculate_RTO(send_window, RTT);	
+				RTT_sample = RTT;
 				chunk->resent = 1; //don't want to reuse the timer					
 			}
-			
-			if(chunk->offset==chunk->length){
-				//print(("chunk->offset==chunk->length: %d", chunk->offset), SEND_WINDOW_PRINT);
-
-				free(chunk->data);
-				free(chunk);
-				plain_list_remove(list, el);
+			if(acked < chunk->length){
+				/* only some of it got there: the chunk's just what's left, so a resend doesn't send 
+					the peer what it's already got, and the rest goes the same way as a whole chunk */
+				if(chunk->sacked)
+					send_window->sacked -= acked;
+				else if(chunk->resending)
+					send_window->lost -= acked;
+				mirror_buffer_consume(send_window->ring, acked);
+				chunk->data = (char*)chunk->data + acked;
+				chunk->length -= acked;
+				chunk->seqnum = (chunk->seqnum + acked) % MAX_SEQNUM;
+				break;
 			}
-			break;
 		}
 
-		/* you can free this chunk because it's been acked (all data has 
+		/* you can let go of this chunk because it's been acked (all data has 
 			been received UP TO the given seqnum */
-		free(chunk->data);
-		free(chunk);
-	
-		/* you can delete this link in the list */
-		//print(("removing from sentlist: %p\n", chunk), SEND_WINDOW_PRINT);
-		plain_list_remove(list, el);
-	PLAIN_LIST_ITER_DONE(list);
+		_chunk_pop(send_window);
+	}
 
-	return;
+	uint32_t newly_acked = WRAP_DIFF(old_left, seqnum, MAX_SEQNUM);
+	send_window->delivered += newly_acked;
+	send_window->delivered_time = now.tv_sec + now.tv_usec/1000000.0;
+	if(send_window->app_limited && send_window->delivered > send_window->app_limited)
+		send_window->app_limited = 0;
+
+	/* new data got acked: restart the retransmission timer for what's still out there (with the new RTO, 
+		which a measurement may have brought back down from a backoff), or stop it if nothing is */
+	if(_in_flight(send_window))
+		send_window->next_timeout = send_window->delivered_time + send_window->RTO;
+	else
+		send_window->next_timeout = TIMEOUT_NONE;
+
+	if(congestion_control_on_ack(send_window->cc, seqnum, newly_acked, _in_flight(send_window), RTT_sample))
+		_fast_retransmit(send_window);
+	if(send_window->sack)
+		_sack_detect_loss(send_window);
+
+	if(!newest_sent)
+		return;
+	/* the delivery rate is over whichever was longer: sending the data that got delivered in between, 
+		or getting it acked (so that neither acks bunching up nor bursty sending inflates it) */
+	send_window->first_sent_time = newest_sent;
+	rs.delivered = send_window->delivered;
+	rs.interval = MAX(newest_sent - first_sent_time, send_window->delivered_time - prior_time);
+	rs.delivery_rate = rs.interval > 0 ? (rs.delivered - rs.prior_delivered)/rs.interval : 0;
+	rs.acked = newly_acked;
+	rs.in_flight = _in_flight(send_window);
+	rs.RTT = RTT_sample;
+	congestion_control_on_rate_sample(send_window->cc, &rs);
 }	
 
-void send_window_ack(send_window_t sw, int seqnum){
+void send_window_ack(send_window_t sw, int seqnum, int seg_len){
 	pthread_mutex_lock(&(sw->mutex));
-	send_window_ack_synchronized(sw, seqnum);
+	send_window_ack_synchronized(sw, seqnum, seg_len);
 	pthread_mutex_unlock(&(sw->mutex));
 }
 
-/* Will handle going through all the timers and for the ones who have 
-   timers that have elapsed time > timeout, adds these to the to_send
-   queue and resets the timer. 
+/* checks the retransmission timer, and if it's gone off, queues up everything outstanding to be
+	resent and backs off the RTO.  The timer starts again when the first of those goes back out.
    
    ALEX gave this a return value -- I think it returns number of outstanding segments, let me know if wrong
    */
 int send_window_check_timers_synchronized(send_window_t send_window){
-
-	/* get the time */
-	struct timeval now, chunk_timer;
-	gettimeofday(&now, NULL);
-	float time_elapsed;
-	
-	plain_list_t list = send_window->sent_list;
-	plain_list_el_t el;
 	send_window_chunk_t chunk;
+	uint32_t i;
+
+	if(send_window->next_timeout == TIMEOUT_NONE || _now() <= send_window->next_timeout)
+		return send_window->count;
 	
-	int i = 0;
-	PLAIN_LIST_ITER(list, el)
-		i++;
-		chunk = (send_window_chunk_t)el->data;
-		chunk_timer = chunk->send_time;
-		
-		time_elapsed = now.tv_sec - chunk_timer.tv_sec;
-		time_elapsed += now.tv_usec/1000000.0 - chunk_timer.tv_usec/1000000.0;
-		
-		if(!chunk->resending && time_elapsed > send_window->RTO){
-			print(("------------resending---------------"), SEND_WINDOW_PRINT);
-			chunk->resent = (chunk->resent) + 1;
-			chunk->resending = 1;
-			queue_push(send_window->timed_out_chunks, (void*)chunk);
-		}
-		
-	PLAIN_LIST_ITER_DONE(list);
+	/* go back N: everything out there is presumed lost, and gets resent oldest first as fast as the 
+		(now tiny) congestion window lets it.  Resending them one at a time as each one times out 
+		was a retransmission storm */
+	print(("------------resending---------------"), SEND_WINDOW_PRINT);
+	send_window->RTO = MIN(send_window->UBOUND, 2*(send_window->RTO));
+	congestion_control_on_rto(send_window->cc, _in_flight(send_window));
+	for(i=0;i<send_window->count;i++){
+		chunk = _chunk(send_window, i);
+		if(chunk->resending || chunk->fast_retransmit || chunk->sacked)
+			continue; // already queued up (or SACKed, so not going anywhere)
+		chunk->resent = (chunk->resent) + 1;
+		chunk->resending = 1;
+		send_window->lost += chunk->length;
+		_chunk_resend(send_window, i);
+	}
+	send_window->next_timeout = TIMEOUT_NONE;
 
-	return i;
+	return send_window->count;
 }
 
 /* Alex wants to be able to use this for closing purposes as well
@@ -383,11 +797,75 @@ int send_window_check_timers(send_window_t sw){
 	return ret;
 }
 
+double send_window_get_next_timeout(send_window_t sw){
+	pthread_mutex_lock(&(sw->mutex));
+	double ret = sw->next_timeout;
+	pthread_mutex_unlock(&(sw->mutex));
+	return ret == TIMEOUT_NONE ? 0 : ret;
+}
+
+double send_window_get_next_send_time(send_window_t sw){
+	pthread_mutex_lock(&(sw->mutex));
+	double ret = sw->paced ? sw->next_send_time : 0;
+	pthread_mutex_unlock(&(sw->mutex));
+	return ret;
+}
+
 // needed for driver window_cmd
 int send_window_get_size(send_window_t send_window){
 	return send_window->size;
 }
 
+uint32_t send_window_get_cwnd(send_window_t send_window){
+	return congestion_control_get_cwnd(send_window->cc);
+}
+
+void send_window_set_congestion_control(send_window_t send_window, const struct congestion_control_ops* ops){
+	pthread_mutex_lock(&(send_window->mutex));
+	congestion_control_destroy(&(send_window->cc));
+	send_window->cc = congestion_control_init(ops, send_window->send_size);
+	congestion_control_set_sack(send_window->cc, send_window->sack);
+	pthread_mutex_unlock(&(send_window->mutex));
+}
+
+void send_window_set_sack(send_window_t send_window, int sack){
+	pthread_mutex_lock(&(send_window->mutex));
+	send_window->sack = sack;
+	congestion_control_set_sack(send_window->cc, sack);
+	pthread_mutex_unlock(&(send_window->mutex));
+}
+
+void send_window_set_mss(send_window_t send_window, int mss){
+	pthread_mutex_lock(&(send_window->mutex));
+	send_window->send_size = mss;
+	congestion_control_set_mss(send_window->cc, mss);
+	pthread_mutex_unlock(&(send_window->mutex));
+}
+
+void send_window_set_nagle(send_window_t send_window, int nagle){
+	pthread_mutex_lock(&(send_window->mutex));
+	send_window->nagle = nagle;
+	pthread_mutex_unlock(&(send_window->mutex));
+}
+
+void send_window_set_cork(send_window_t send_window, int cork){
+	pthread_mutex_lock(&(send_window->mutex));
+	send_window->cork = cork;
+	pthread_mutex_unlock(&(send_window->mutex));
+}
+
+void send_window_flush(send_window_t send_window){
+	pthread_mutex_lock(&(send_window->mutex));
+	send_window->flushing = 1;
+	pthread_mutex_unlock(&(send_window->mutex));
+}
+
+void send_window_print_congestion_control(send_window_t send_window){
+	pthread_mutex_lock(&(send_window->mutex));
+	congestion_control_print(send_window->cc);
+	pthread_mutex_unlock(&(send_window->mutex));
+}
+
 void send_window_print(send_window_t send_window){
 	print(("Left: %d\nsize: %d\nSent_left: %d\n", send_window->left, send_window->size, send_window->sent_left), SEND_WINDOW_PRINT);
 }
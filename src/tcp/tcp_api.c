@@ -8,6 +8,9 @@
 #include "tcp_connection_state_machine_handle.h"
 #include "recv_window.h" // for the read function
 
+// how many slices of the recv_window recvfile writes out at a time
+#define RECVFILE_IOV 64
+
 /* args */
 
 tcp_api_args_t tcp_api_args_init(){
@@ -67,7 +70,9 @@ while(0)
 /* connects a socket to an address (active OPEN in the RFC)
 returns 0 on success or a negative number on failure */
 
-int tcp_api_connect(tcp_node_t tcp_node, int socket, struct in_addr* addr, uint16_t port){
+/* the non-blocking part of tcp_api_connect: gets the connection a port and ips and sends off the SYN
+returns whatever tcp_connection_active_open did (1 on success), or a negative number on failure */
+int tcp_api_connect_start(tcp_node_t tcp_node, int socket, struct in_addr* addr, uint16_t port){
 
 	tcp_connection_t connection = tcp_node_get_connection_by_socket(tcp_node, socket);
 	if(!connection)	
@@ -94,6 +99,15 @@ int tcp_api_connect(tcp_node_t tcp_node, int socket, struct in_addr* addr, uint1
 		// then just return that result (well maybe lets return EBADF, is that right?);
 		return -EBADF;//INVALID_TRANSITION;
 	}
+	return ret;
+}
+
+int tcp_api_connect(tcp_node_t tcp_node, int socket, struct in_addr* addr, uint16_t port){
+
+	int ret = tcp_api_connect_start(tcp_node, socket, addr, port);
+	if(ret < 0)
+		return ret;
+	tcp_connection_t connection = tcp_node_get_connection_by_socket(tcp_node, socket);
 	
 	/* Now wait until connection ESTABLISHED or timed out -- ret value will indicate */
 	int transition_result = tcp_connection_api_result(connection); // will block until it gets the result
@@ -125,6 +139,29 @@ int tcp_api_write(tcp_node_t tcp_node, int socket, const unsigned char* to_write
 	return ret;
 }
 
+/* write the iovcnt buffers in iov, one after the other, on an open socket
+return num bytes written or negative number on failure */
+int tcp_api_writev(tcp_node_t tcp_node, int socket, const struct iovec* iov, int iovcnt){
+
+	tcp_connection_t connection = tcp_node_get_connection_by_socket(tcp_node, socket);
+	if(!connection)	
+		return -EBADF;
+	if(iovcnt < 0)
+		return -EINVAL;
+	
+	return tcp_connection_send_datav(connection, iov, iovcnt, 0);
+}
+
+int tcp_api_write_nonblocking(tcp_node_t tcp_node, int socket, const unsigned char* to_write, uint32_t num_bytes){
+
+	tcp_connection_t connection = tcp_node_get_connection_by_socket(tcp_node, socket);
+	if(!connection)	
+		return -EBADF;
+	
+	struct iovec iov = { .iov_base = (void*)to_write, .iov_len = num_bytes };
+	return tcp_connection_send_datav(connection, &iov, 1, 1);
+}
+
 void* tcp_api_sendfile_entry(void* _args){
 	tcp_api_args_t args = (tcp_api_args_t) _args;
 	
@@ -175,6 +212,21 @@ void* tcp_api_sendfile_entry(void* _args){
 	return NULL;
 }
 
+/* writes everything there is to read in window to f, straight out of the packets it came in */
+static void _recvfile_drain(recv_window_t window, FILE* f){
+	struct iovec iov[RECVFILE_IOV];
+	int n, i, length;
+	while((n = recv_window_peek(window, iov, RECVFILE_IOV))){
+		length = 0;
+		for(i=0;i<n;i++){
+			fwrite(iov[i].iov_base, iov[i].iov_len, 1, f);
+			length += iov[i].iov_len;
+		}
+		recv_window_consume(window, length);
+	}
+	fflush(f);
+}
+
 void* tcp_api_recvfile_entry(void* _args){
 	tcp_api_args_t args = (tcp_api_args_t) _args;
 
@@ -242,25 +294,19 @@ void* tcp_api_recvfile_entry(void* _args){
 	}	
 
 	recv_window_t reading_window 	   = tcp_connection_get_recv_window(new_connection);
-	memchunk_t got;
 	while(tcp_node_running(args->node) && tcp_connection_get_state(new_connection) != CLOSE_WAIT){
 	
-		while((got = recv_window_get_next(reading_window, BUFFER_SIZE))){
-			fwrite(got->data, got->length, 1, f);
-			fflush(f);
-			memchunk_destroy_total(&got, util_free);
-		}
+		_recvfile_drain(reading_window, f);
 		if(tcp_node_running(args->node) && tcp_connection_get_state(new_connection) != CLOSE_WAIT){
 			int result = tcp_connection_api_result(new_connection); // will block until it gets the result
-		while((got = recv_window_get_next(reading_window, BUFFER_SIZE))){
-			fwrite(got->data, got->length, 1, f);
-			fflush(f);
-			memchunk_destroy_total(&got, util_free);
-		}				
+			_recvfile_drain(reading_window, f);
 			if(result<0)
 				break;
 		}
 	}
+	/* the FIN only comes after everything before it, but whatever came in between the last drain 
+		and seeing CLOSE_WAIT is still in the window */
+	_recvfile_drain(reading_window, f);
 
 /* CLEAN UP */
 	// close and remove the connections
@@ -344,6 +390,47 @@ int tcp_api_bind(tcp_node_t tcp_node, int socket, struct in_addr* addr, uint16_t
 	return 0;
 }
 
+int tcp_api_setsockopt(tcp_node_t tcp_node, int socket, int option, int value){
+	tcp_connection_t connection = tcp_node_get_connection_by_socket(tcp_node, socket);
+	if(connection == NULL)
+		return -EBADF; 	//socket is not a valid descriptor
+
+	if(option == TCP_NODELAY)
+		tcp_connection_set_nodelay(connection, value != 0);
+	else if(option == TCP_CORK)
+		tcp_connection_set_cork(connection, value != 0);
+	else if(option == SO_SNDBUF || option == SO_SNDLOWAT){
+		if(value < 0 || (value == 0 && option == SO_SNDBUF))
+			return -EINVAL;
+		// (a smaller buffer brings the low watermark down to no more than half of it)
+		if(option == SO_SNDBUF)
+			tcp_connection_set_send_buffer(connection, value, MIN((uint32_t)value/2, tcp_connection_get_send_low_watermark(connection)));
+		else
+			tcp_connection_set_send_buffer(connection, tcp_connection_get_send_buffer(connection), value);
+	}
+	else
+		return -ENOPROTOOPT;
+	return 0;
+}
+
+int tcp_api_getsockopt(tcp_node_t tcp_node, int socket, int option, int* value){
+	tcp_connection_t connection = tcp_node_get_connection_by_socket(tcp_node, socket);
+	if(connection == NULL)
+		return -EBADF; 	//socket is not a valid descriptor
+
+	if(option == TCP_NODELAY)
+		*value = tcp_connection_get_nodelay(connection);
+	else if(option == TCP_CORK)
+		*value = tcp_connection_get_cork(connection);
+	else if(option == SO_SNDBUF)
+		*value = tcp_connection_get_send_buffer(connection);
+	else if(option == SO_SNDLOWAT)
+		*value = tcp_connection_get_send_low_watermark(connection);
+	else
+		return -ENOPROTOOPT;
+	return 0;
+}
+
 // returns port that connection is listening on, negative number on failure
 int tcp_api_listen(tcp_node_t tcp_node, int socket){
 
@@ -372,8 +459,10 @@ int tcp_api_listen(tcp_node_t tcp_node, int socket){
 /* read on an open socket (RECEIVE in the RFC)
 return num bytes read or negative number on failure or 0 on eof */
 //int v read(int socket, unsigned char *buf, uint32 t nbyte);
-int tcp_api_read(tcp_node_t tcp_node, int socket, char *buffer, uint32_t nbyte){
-	print(("tcp_api_read 0"), ALEX_PRINT);
+/* finds the recv_window for reading on socket, for all the reading calls
+returns 1 and sets *window if there's something to read from, otherwise what the reading call should return:
+0 on eof or negative number on failure */
+static int _reading_window(tcp_node_t tcp_node, int socket, recv_window_t* window){
 	tcp_connection_t connection = tcp_node_get_connection_by_socket(tcp_node, socket);
 	if(connection == NULL)
 		return -EBADF;
@@ -390,25 +479,49 @@ int tcp_api_read(tcp_node_t tcp_node, int socket, char *buffer, uint32_t nbyte){
 	if(state == CLOSED || state == LAST_ACK){
 		return 0;
 	}
+
+	*window = tcp_connection_get_recv_window(connection);
+	return 1;
+}
+
+int tcp_api_read(tcp_node_t tcp_node, int socket, char *buffer, uint32_t nbyte){
+	print(("tcp_api_read 0"), ALEX_PRINT);
+	recv_window_t window;
+	int ret = _reading_window(tcp_node, socket, &window);
+	if(ret <= 0)
+		return ret;
 	
-	memchunk_t chunk = recv_window_get_next(tcp_connection_get_recv_window(connection), nbyte);
-	if(!chunk){
-		return 0;
-	}	
+	// straight from the window into the user's buffer
+	return recv_window_read(window, buffer, nbyte);
+}
 
-	int read = nbyte;
-	if(chunk->length > nbyte){
-		puts("Error: Alex and Neil go debug tcp_api_read");
-		exit(-1);
-	}
+int tcp_api_readv(tcp_node_t tcp_node, int socket, const struct iovec* iov, int iovcnt){
+	recv_window_t window;
+	int ret = _reading_window(tcp_node, socket, &window);
+	if(ret <= 0)
+		return ret;
+	if(iovcnt < 0)
+		return -EINVAL;
+	
+	return recv_window_readv(window, iov, iovcnt);
+}
 
-	if(chunk->length < nbyte)
-		read = chunk->length;
+int tcp_api_peek(tcp_node_t tcp_node, int socket, struct iovec* iov, int max){
+	recv_window_t window;
+	int ret = _reading_window(tcp_node, socket, &window);
+	if(ret <= 0)
+		return ret;
 	
-	memcpy(buffer, chunk->data, read); 
-	//clean up
-	memchunk_destroy_total(&chunk, util_free);
-	return read;
+	return recv_window_peek(window, iov, max);
+}
+
+int tcp_api_consume(tcp_node_t tcp_node, int socket, uint32_t nbyte){
+	recv_window_t window;
+	int ret = _reading_window(tcp_node, socket, &window);
+	if(ret <= 0)
+		return ret;
+	
+	return recv_window_consume(window, nbyte);
 }
 
 void* tcp_api_read_entry(void* _args){
@@ -0,0 +1,342 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "tcp_async.h"
+#include "tcp_connection.h"
+#include "tcp_connection_state_machine_handle.h"
+#include "ring_queue.h"
+
+struct tcp_async_op{
+	struct tcp_async_sqe sqe;
+	tcp_async_t async;
+	int result;
+
+	int accepting; // for ACCEPT: the new socket once we're waiting on its handshake, -1 until then
+	/* cleaning up a connection can mean waiting on its worker, which is probably who completed us,
+		so it gets put off until we're reaped */
+	int remove_socket; // socket to take out of the kernal when reaped, -1 for none
+	int close_socket; // socket to (asynchronously) close when reaped, -1 for none
+	int internal; // issued by us rather than the application -- nobody gets a cqe for it
+
+	struct tcp_async_op* next_free;
+};
+
+struct tcp_async{
+	tcp_node_t tcp_node;
+	int entries;
+
+	struct tcp_async_op* ops; // all `entries` of them
+	struct tcp_async_op* free_ops; // the ones that aren't in flight (only the application thread touches this)
+	struct tcp_async_op** pending; // gotten but not submitted yet
+	int num_pending;
+	int in_flight; // submitted but not reaped yet
+
+	ring_queue_t completions; // done ops -- the workers complete them, the application reaps them
+};
+
+tcp_async_t tcp_async_init(tcp_node_t tcp_node, int entries){
+	tcp_async_t async = (tcp_async_t)malloc(sizeof(struct tcp_async));
+	async->tcp_node = tcp_node;
+	async->entries = entries;
+	async->ops = (struct tcp_async_op*)malloc(sizeof(struct tcp_async_op)*entries);
+	async->pending = (struct tcp_async_op**)malloc(sizeof(struct tcp_async_op*)*entries);
+	async->num_pending = 0;
+	async->in_flight = 0;
+	async->completions = ring_queue_init(entries, RING_QUEUE_MPSC);
+
+	async->free_ops = NULL;
+	int i;
+	for(i=entries-1;i>=0;i--){
+		async->ops[i].async = async;
+		async->ops[i].next_free = async->free_ops;
+		async->free_ops = &(async->ops[i]);
+	}
+	return async;
+}
+
+void tcp_async_destroy(tcp_async_t* async){
+	if((*async)->in_flight)
+		printf("tcp_async_destroy: %d ops still in flight\n", (*async)->in_flight);
+	ring_queue_destroy(&((*async)->completions));
+	free((*async)->pending);
+	free((*async)->ops);
+	free(*async);
+	*async = NULL;
+}
+
+static struct tcp_async_op* _op_get(tcp_async_t async){
+	struct tcp_async_op* op = async->free_ops;
+	if(!op)
+		return NULL;
+	async->free_ops = op->next_free;
+
+	memset(&(op->sqe), 0, sizeof(struct tcp_async_sqe));
+	op->result = 0;
+	op->accepting = -1;
+	op->remove_socket = -1;
+	op->close_socket = -1;
+	op->internal = 0;
+	return op;
+}
+
+static void _op_put(tcp_async_t async, struct tcp_async_op* op){
+	op->next_free = async->free_ops;
+	async->free_ops = op;
+}
+
+// can't fail -- there's room on the completion queue for every op there is
+static void _complete(struct tcp_async_op* op, int result){
+	op->result = result;
+	ring_queue_enqueue(op->async->completions, op);
+}
+
+/* each of these returns 1 if the op is done, 0 if it should be parked on (or stay parked on) connection,
+	and -1 if it got parked on some other connection */
+
+static int _read(struct tcp_async_op* op, tcp_connection_t connection){
+	int ret = tcp_api_read(op->async->tcp_node, op->sqe.socket, op->sqe.buffer, op->sqe.length);
+	if(ret != 0){
+		_complete(op, ret);
+		return 1;
+	}
+	// was there nothing to read, or did connection close?
+	state_e state = tcp_connection_get_state(connection);
+	if(state == CLOSED || state == CLOSE_WAIT || state == LAST_ACK){
+		_complete(op, 0);
+		return 1;
+	}
+	return 0;
+}
+
+static int _read_event(struct tcp_async_op* op, tcp_connection_t connection, int event){
+	if(event == REMOTE_CONNECTION_CLOSED){
+		// there might still be something left to read though
+		if(!_read(op, connection))
+			_complete(op, 0);
+		return 1;
+	}
+	if(event < 0){
+		_complete(op, event);
+		return 1;
+	}
+	return _read(op, connection);
+}
+
+/* waiting on the listening connection for a SYN to show up on its accept queue -- once one does, the
+	op moves over to the new connection to wait on it getting ESTABLISHED */
+static int _accept(struct tcp_async_op* op, tcp_connection_t listening_connection){
+	if(tcp_connection_get_close_boolean(listening_connection)){
+		_complete(op, -ECONNABORTED);
+		return 1;
+	}
+	/* listening connection must actually be listening */
+	if(tcp_connection_get_state(listening_connection) != LISTEN){
+		_complete(op, -EINVAL);
+		return 1;
+	}
+	accept_queue_data_t data = tcp_connection_accept_queue_trydequeue(listening_connection);
+	if(data == NULL)
+		return 0;
+
+	tcp_connection_t new_connection = tcp_node_connection_accept_data(op->async->tcp_node, listening_connection, data);
+	if(new_connection == NULL){
+		_complete(op, -ENFILE);	//The system limit on the total number of open files has been reached.
+		return 1;
+	}
+	op->accepting = tcp_connection_get_socket(new_connection);
+
+	// set state of this new_connection to LISTEN so that we can send it through transition LISTEN_to_SYN_RECEIVED
+	tcp_connection_set_state(new_connection, LISTEN);
+	tcp_connection_async_lock(new_connection);
+	tcp_connection_async_park(new_connection, op);
+	tcp_connection_state_machine_transition(new_connection, receiveSYN);
+	tcp_connection_async_unlock(new_connection);
+	return -1;
+}
+
+static int _accept_event(struct tcp_async_op* op, tcp_connection_t connection, int event){
+	if(op->accepting < 0)
+		return _accept(op, connection);
+
+	if(event >= 0){
+		state_e state = tcp_connection_get_state(connection);
+		if(state == LISTEN || state == SYN_RECEIVED)
+			return 0;
+		_complete(op, op->accepting);
+		return 1;
+	}
+	if(event == API_TIMEOUT || event == REMOTE_CONNECTION_CLOSED)
+		// changing from SYN_RECEIVED to ESTABLISHED timed out or instead of sending back ack they sent back fin
+		op->close_socket = op->accepting;
+	else
+		op->remove_socket = op->accepting;
+	_complete(op, -ECONNABORTED);
+	return 1;
+}
+
+static int _connect_event(struct tcp_async_op* op, tcp_connection_t connection, int event){
+	if(event >= 0){
+		_complete(op, 0);
+		return 1;
+	}
+	// error or timeout so lets get rid of this
+	op->remove_socket = op->sqe.socket;
+	_complete(op, (event == CONNECTION_RESET) ? -ECONNREFUSED : event);
+	return 1;
+}
+
+static int _close_event(struct tcp_async_op* op, tcp_connection_t connection, int event){
+	if(event == 0 || tcp_connection_get_state(connection) == CLOSED){
+		_complete(op, 0);
+		return 1;
+	}
+	if(event < 0 && event != REMOTE_CONNECTION_CLOSED){
+		_complete(op, event);
+		return 1;
+	}
+	return 0;
+}
+
+int tcp_async_op_event(struct tcp_async_op* op, struct tcp_connection* connection, int event){
+	if(event == SIGNAL_DESTROYING){
+		_complete(op, -ECANCELED);
+		return 1;
+	}
+	switch(op->sqe.opcode){
+		case TCP_ASYNC_READ:
+			return _read_event(op, connection, event);
+		case TCP_ASYNC_ACCEPT:
+			return _accept_event(op, connection, event) != 0;
+		case TCP_ASYNC_CONNECT:
+			return _connect_event(op, connection, event);
+		case TCP_ASYNC_CLOSE:
+			return _close_event(op, connection, event);
+	}
+	return 1;
+}
+
+/* starts op off -- everything that has to wait gets parked with the connection's async lock held
+	from before it first looks until it's parked, so it can't miss the event it's waiting on */
+static void _issue(tcp_async_t async, struct tcp_async_op* op){
+	tcp_connection_t connection = tcp_node_get_connection_by_socket(async->tcp_node, op->sqe.socket);
+	if(connection == NULL){
+		_complete(op, -EBADF);
+		return;
+	}
+	int ret = 1;
+
+	switch(op->sqe.opcode){
+		case TCP_ASYNC_WRITE:
+			_complete(op, tcp_api_write_nonblocking(async->tcp_node, op->sqe.socket, (unsigned char*)op->sqe.buffer, op->sqe.length));
+			return;
+
+		case TCP_ASYNC_READ:
+			tcp_connection_async_lock(connection);
+			ret = _read(op, connection);
+			break;
+
+		case TCP_ASYNC_ACCEPT:
+			tcp_connection_async_lock(connection);
+			ret = _accept(op, connection);
+			break;
+
+		case TCP_ASYNC_CONNECT:
+			tcp_connection_async_lock(connection);
+			ret = tcp_api_connect_start(async->tcp_node, op->sqe.socket, &(op->sqe.addr), op->sqe.port);
+			if(ret < 0)
+				_complete(op, ret);
+			ret = (ret < 0);
+			break;
+
+		case TCP_ASYNC_CLOSE:
+			// sets the closing boolean now so that a waiting accept gives up
+			tcp_connection_set_close(connection);
+			tcp_connection_async_lock(connection);
+			// invalidate socket once we're done, no matter what
+			op->remove_socket = op->sqe.socket;
+			ret = tcp_api_shutdown(async->tcp_node, op->sqe.socket, SHUTDOWN_BOTH);
+			if(ret < 0)
+				_complete(op, ret);
+			else if(tcp_connection_get_state(connection) == CLOSED)
+				_complete(op, 0);
+			else
+				ret = 0;
+			ret = (ret != 0);
+			break;
+
+		default:
+			_complete(op, -EINVAL);
+			return;
+	}
+	if(!ret)
+		tcp_connection_async_park(connection, op);
+	tcp_connection_async_unlock(connection);
+}
+
+struct tcp_async_sqe* tcp_async_get_sqe(tcp_async_t async){
+	struct tcp_async_op* op = _op_get(async);
+	if(!op)
+		return NULL;
+	async->pending[async->num_pending++] = op;
+	return &(op->sqe);
+}
+
+int tcp_async_submit(tcp_async_t async){
+	int i, submitted = async->num_pending;
+	async->num_pending = 0;
+	for(i=0;i<submitted;i++){
+		async->in_flight++;
+		_issue(async, async->pending[i]);
+	}
+	return submitted;
+}
+
+// does whatever cleanup op put off until now.  returns 1 if the application gets a cqe for it
+static int _reaped(tcp_async_t async, struct tcp_async_op* op){
+	async->in_flight--;
+	int internal = op->internal;
+
+	if(op->remove_socket >= 0){
+		tcp_connection_t connection = tcp_node_get_connection_by_socket(async->tcp_node, op->remove_socket);
+		if(connection)
+			tcp_node_remove_connection_kernal(async->tcp_node, connection);
+	}
+	if(op->close_socket >= 0){
+		// want to close it but don't want to block -- so it gets closed the same way anything else does
+		int socket = op->close_socket;
+		memset(&(op->sqe), 0, sizeof(struct tcp_async_sqe));
+		op->sqe.opcode = TCP_ASYNC_CLOSE;
+		op->sqe.socket = socket;
+		op->accepting = op->remove_socket = op->close_socket = -1;
+		op->internal = 1;
+		async->in_flight++;
+		_issue(async, op);
+		return !internal;
+	}
+	_op_put(async, op);
+	return !internal;
+}
+
+int tcp_async_reap(tcp_async_t async, struct tcp_async_cqe* cqes, int max, const struct timespec* abs_timeout){
+	struct tcp_async_op* op;
+	int reaped = 0;
+
+	while(reaped < max && async->in_flight){
+		// only block until the first one
+		if(!reaped){
+			if(ring_queue_timed_dequeue_abs(async->completions, (void**)&op, abs_timeout))
+				break;
+		}
+		else if(ring_queue_trydequeue(async->completions, (void**)&op))
+			break;
+
+		// (copy it out first -- _reaped might reuse op)
+		cqes[reaped].user_data = op->sqe.user_data;
+		cqes[reaped].result = op->result;
+		if(_reaped(async, op))
+			reaped++;
+	}
+	return reaped;
+}
@@ -19,11 +19,25 @@
 #include "tcp_node.h" // in tcp_node.h #include "tcp_connection.h"
 #include "tcp_utils.h"
 #include "tcp_connection_state_machine_handle.h"
+#include "tcp_async.h"
 
 
 // all those fancy things we defined here are now located in tcp_utils so they can also 
 // be shared with tcp_connection_state_handle
 
+static void _timer_fired(void* connection);
+static void _async_event(tcp_connection_t connection, int event);
+static send_window_t _send_window_init(tcp_connection_t connection, uint32_t ISN);
+static void _send_window_reset(tcp_connection_t connection);
+static void _add_syn_options(tcp_connection_t connection, struct tcphdr* header);
+static void _add_sack(tcp_connection_t connection, struct tcphdr* header, int data_len);
+static void _receive_sack(tcp_connection_t connection, struct tcphdr* header, int length);
+static uint16_t _our_window(tcp_connection_t connection, struct tcphdr* header, uint32_t window);
+static uint32_t _their_window(tcp_connection_t connection, struct tcphdr* header);
+static void _ack_data(tcp_connection_t connection, int in_order);
+static int _fin_in_order(tcp_connection_t connection, tcp_packet_data_t tcp_packet_data);
+static int _wrap_packet_send(tcp_connection_t connection, struct tcphdr* header, void* data, int data_len, char* buffer, mirror_buffer_t ring);
+
 struct tcp_connection{
 	
 	tcp_node_t tcp_node; // needs reference to node in order to properly take itself out of kernal on timeouts etc
@@ -67,11 +81,55 @@ struct tcp_connection{
 		// lets also use this for closing
 	
 	// needs reference to the to_send queue in order to queue its packets
-	bqueue_t *to_send;	//--- tcp data for ip to send
+	ring_queue_t to_send;	//--- tcp data for ip to send
 	// when tcp_node demultiplexes packets, gives packet to tcp_connection by placing packet on its my_to_read queue
-	bqueue_t *my_to_read; // holds tcp_packet_data_t's 
-
-	pthread_t read_send_thread; //has thread that handles the my_to_read queue and window timeouts in a loop
+	ring_queue_t my_to_read; // holds tcp_packet_data_t's (only tcp_node pushes onto it)
+
+	/* the worker whose shard we're in handles the my_to_read queue and window timeouts, by calling
+		tcp_connection_run whenever we're scheduled */
+	tcp_worker_t worker;
+	int scheduled; // 1 while we're on the worker's run queue (or being let go of)
+	/* for tcp_connection_destroy to wait for the worker to be done with us */
+	pthread_mutex_t run_mutex;
+	pthread_cond_t detached_cond;
+	int detached;
+	/* on the ip_node's timer wheel -- armed for whenever we next have something to do on our own
+		(a state timeout or a retransmission), and all it does is schedule us.  NULL (as is worker)
+		if there's no tcp_node */
+	wheel_timer_t timer;
+
+	/* tcp_async ops that are waiting on something to happen to us -- every api signal gets
+		handed to each of them (see _async_event).  The mutex is recursive because handing an op
+		an event can make us signal again */
+	plain_list_t async_ops;
+	pthread_mutex_t async_mutex;
+
+	// the congestion control our send windows use -- NULL for CONGESTION_CONTROL_DEFAULT
+	const struct congestion_control_ops* congestion_control;
+	// socket options (see tcp_api_setsockopt) -- kept here so they outlive the send window
+	int nodelay;
+	int cork;
+	uint32_t send_buffer;
+	uint32_t send_low_watermark;
+	/* writers blocked on a full send buffer wait on write_cond, and tcp_connection_run wakes them 
+		once the send window's writable again */
+	int writers_waiting;
+	pthread_mutex_t write_mutex;
+	pthread_cond_t write_cond;
+	// the other side said SACK_PERMITTED on its SYN, so we SACK and our send window keeps a scoreboard
+	int sack_ok;
+	/* window scaling: if they did it too (wscale_ok), the windows we advertise are shifted down by
+		our_wscale and the ones they advertise are shifted down by their_wscale (on everything but SYNs) */
+	int wscale_ok;
+	int our_wscale;
+	int their_wscale;
+
+	/* delayed acks (RFC 1122): in-order data gets acked every TCP_DELAYED_ACK_SEGMENTS segments, or once
+		ack_deadline comes around (0 for none), unless something we send carries the ack first.  ack_sent
+		is the last ack we put on anything, so tcp_connection_run can tell if the deadline's still owed one */
+	uint32_t ack_sent;
+	int unacked_segments;
+	double ack_deadline;
 
 	int closing; //have we requested to close yet? 0 when either in CLOSED state of CLOSE requested, 1 otherwise
 	int running; //are we running still?  1 for true, 0 for false -- indicates to thread to shut down
@@ -99,7 +157,7 @@ int tcp_connection_get_api_ret(tcp_connection_t connection){
 	return connection->api_ret;
 }
 	
-tcp_connection_t tcp_connection_init(tcp_node_t tcp_node, int socket, bqueue_t *tosend){
+tcp_connection_t tcp_connection_init(tcp_node_t tcp_node, int socket, ring_queue_t tosend){
 	tcp_connection_t connection = (tcp_connection_t)malloc(sizeof(struct tcp_connection));
 	
 	connection->tcp_node = tcp_node;
@@ -114,8 +172,20 @@ tcp_connection_t tcp_connection_init(tcp_node_t tcp_node, int socket, bqueue_t *
 	
 	/* we init send window here but only init recv window when we get our first seqnum */
 	uint32_t ISN = RAND_ISN();	
-	connection->send_window = send_window_init(DEFAULT_WINDOW_SIZE, DEFAULT_WINDOW_CHUNK_SIZE, ISN,
-								WINDOW_ALPHA, WINDOW_BETA, WINDOW_UBOUND, WINDOW_LBOUND);
+	connection->congestion_control = NULL;
+	connection->nodelay = connection->cork = 0;
+	connection->send_buffer = DEFAULT_SEND_BUFFER_SIZE;
+	connection->send_low_watermark = DEFAULT_SEND_LOW_WATERMARK;
+	connection->writers_waiting = 0;
+	pthread_mutex_init(&(connection->write_mutex), NULL);
+	pthread_cond_init(&(connection->write_cond), NULL);
+	connection->sack_ok = 0;
+	connection->wscale_ok = 0;
+	connection->our_wscale = connection->their_wscale = 0;
+	connection->ack_sent = 0;
+	connection->unacked_segments = 0;
+	connection->ack_deadline = 0;
+	connection->send_window = _send_window_init(connection, ISN);
 
 	connection->receive_window = NULL;
 	connection->recv_window_alive = 1; //I set it to one for the purpose of knowing how to set window size in tcp_wrap_packet_send
@@ -141,22 +211,25 @@ tcp_connection_t tcp_connection_init(tcp_node_t tcp_node, int socket, bqueue_t *
 	connection->last_seq_sent 	  = -1;
 	
 	// init my_to_read queue
-	bqueue_t *my_to_read = (bqueue_t*) malloc(sizeof(bqueue_t));
-	bqueue_init(my_to_read);
-	connection->my_to_read = my_to_read;
-	
-	//start read_thread
-	/* Initialize and set thread detached attribute */
-	pthread_attr_t attr;
-	pthread_attr_init(&attr);
-	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-		
-	int status = pthread_create(&(connection->read_send_thread), &attr, _handle_read_send, (void *)connection);
-    if (status){
-         printf("ERROR; return code from pthread_create() for _handle_read_ack is %d\n", status);
-         return 0;
-    }
-    pthread_attr_destroy(&attr);
+	connection->my_to_read = ring_queue_init(TCP_CONNECTION_TO_READ_CAPACITY, RING_QUEUE_SPSC);
+	connection->timer = NULL;
+	connection->worker = NULL;
+	if(tcp_node){
+		connection->timer = wheel_timer_init(tcp_node_get_timer_wheel(tcp_node), _timer_fired, connection);
+		// sharded by socket, which is the one thing about us that never changes
+		connection->worker = tcp_node_get_worker(tcp_node, socket);
+	}
+	connection->scheduled = 0;
+	connection->detached = 0;
+	pthread_mutex_init(&(connection->run_mutex), NULL);
+	pthread_cond_init(&(connection->detached_cond), NULL);
+
+	connection->async_ops = plain_list_init();
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&(connection->async_mutex), &attr);
+	pthread_mutexattr_destroy(&attr);
 	
 	return connection;
 }
@@ -165,19 +238,32 @@ void tcp_connection_destroy(tcp_connection_t *connection){
 	(*connection)->running = 0;
 
 	// >> do this immediately! because it depends on the things you're destroying! <<
-	// cancel read_thread
-	int rc = pthread_join((*connection)->read_send_thread, NULL);
-	if (rc) {
-		printf("ERROR; return code from pthread_cancel() for tcp_connection of socket %d is %d\n", (*connection)->socket_id, rc);
-		exit(-1);
+	// get the worker to let go of us -- the next time it runs us it'll see we're not running
+	if((*connection)->worker){
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		tcp_connection_schedule(*connection);
+		pthread_mutex_lock(&((*connection)->run_mutex));
+		while(!(*connection)->detached)
+			pthread_cond_wait(&((*connection)->detached_cond), &((*connection)->run_mutex));
+		pthread_mutex_unlock(&((*connection)->run_mutex));
 	}
+	// (the timer can still go off, but all that does now is try to schedule us)
+	if((*connection)->timer)
+		wheel_timer_destroy(&((*connection)->timer));
+	pthread_mutex_destroy(&((*connection)->run_mutex));
+	pthread_cond_destroy(&((*connection)->detached_cond));
 	// tell everyone who is waiting on this thread that
 	// the connection is being destroyed
 	tcp_connection_api_signal((*connection), SIGNAL_DESTROYING);
+	// (which also cancelled any async ops that were still waiting on us)
+	plain_list_destroy(&((*connection)->async_ops));
+	pthread_mutex_destroy(&((*connection)->async_mutex));
 
 	/* Destroy mutex and signal */
 	pthread_mutex_destroy(&((*connection)->api_mutex));
 	pthread_cond_destroy(&((*connection)->api_cond));
+	pthread_mutex_destroy(&((*connection)->write_mutex));
+	pthread_cond_destroy(&((*connection)->write_cond));
 	
 	// destroy windows
 	if((*connection)->send_window)
@@ -191,11 +277,10 @@ void tcp_connection_destroy(tcp_connection_t *connection){
 	
 	// take all packets off my_to_read queue and destroys queue
 	tcp_packet_data_t tcp_packet_data;
-	while(!bqueue_trydequeue((*connection)->my_to_read, (void**)&tcp_packet_data))
+	while(!ring_queue_trydequeue((*connection)->my_to_read, (void**)&tcp_packet_data))
 		tcp_packet_data_destroy(&tcp_packet_data);	
 	
-	bqueue_destroy((*connection)->my_to_read);
-	free((*connection)->my_to_read);
+	ring_queue_destroy(&((*connection)->my_to_read));
 						
 	free(*connection);
 	*connection = NULL;
@@ -228,15 +313,15 @@ int _validate_ack(tcp_connection_t connection, uint32_t ack){
 }	
 
 /* Function for tcp_node to call to place a packet on this connection's
-	my_to_read queue for this connection to handle in its _handle_read_send thread 
+	my_to_read queue for this connection to handle the next time its worker runs it
 	returns 1 on success, 0 on failure */
 int tcp_connection_queue_to_read(tcp_connection_t connection, tcp_packet_data_t tcp_packet){
 	print(("queueing packet"), TCP_PRINT);
 	if(connection){
-		if(bqueue_enqueue(connection->my_to_read, tcp_packet))
+		if(ring_queue_enqueue(connection->my_to_read, tcp_packet))
 			return 0;
-		else
-			return 1;
+		tcp_connection_schedule(connection);
+		return 1;
 	}
 	return 0;
 }
@@ -245,11 +330,15 @@ int tcp_connection_queue_to_read(tcp_connection_t connection, tcp_packet_data_t
 	Queues info necessary to create a new connection when accept called 
 	returns 0 on success, negative if failed -- ie queue destroyed */
 int tcp_connection_handle_syn_LISTEN(tcp_connection_t connection, 
-		uint32_t local_ip,uint32_t remote_ip, uint16_t remote_port, uint32_t seqnum){ 
+		uint32_t local_ip,uint32_t remote_ip, uint16_t remote_port, uint32_t seqnum, const struct tcp_syn_options* options){ 
 	
 	/* create accept_queue_data to load up with necessary info and queue for accept call */
-	accept_queue_data_t data = accept_queue_data_init(local_ip, remote_ip, remote_port, seqnum);
-	return bqueue_enqueue(connection->accept_queue, data);
+	accept_queue_data_t data = accept_queue_data_init(local_ip, remote_ip, remote_port, seqnum, options);
+	int ret = bqueue_enqueue(connection->accept_queue, data);
+	// a waiting async accept can take it from here
+	if(!ret)
+		_async_event(connection, 0);
+	return ret;
 }											
 
 /*
@@ -403,7 +492,7 @@ void tcp_connection_handle_receive_packet(tcp_connection_t connection, tcp_packe
 			}
 		}
 		/* lets get the window size first  -- us, not RFC */
-		send_window_set_size(connection->send_window, tcp_window_size(tcp_packet));
+		send_window_set_size(connection->send_window, _their_window(connection, tcp_packet));
 		
 		/* second check the RST bit */
 		if(tcp_rst_bit(tcp_packet)){
@@ -473,6 +562,15 @@ void tcp_connection_handle_receive_packet(tcp_connection_t connection, tcp_packe
     		return;		
     	}
     	else{	/* if the ACK bit is on */
+			/* how much of the sequence space this segment takes up -- only ones that don't take up 
+				any can be duplicate acks (RFC 5681) */
+			int seg_len = tcp_packet_data->packet_size - tcp_offset_in_bytes(tcp_packet)
+							+ (tcp_syn_bit(tcp_packet) ? 1 : 0) + (tcp_fin_bit(tcp_packet) ? 1 : 0);
+
+			/* whatever they've SACKed goes on the scoreboard before the ack itself gets processed */
+			if(connection->sack_ok && state != SYN_RECEIVED)
+				_receive_sack(connection, tcp_packet, tcp_packet_data->packet_size);
+
 			/* SYN-RECEIVED STATE */
 			if(state==SYN_RECEIVED){
 				/* If SND.UNA =< SEG.ACK =< SND.NXT then enter ESTABLISHED state and continue processing. */
@@ -496,7 +594,7 @@ void tcp_connection_handle_receive_packet(tcp_connection_t connection, tcp_packe
     		else if(state==ESTABLISHED){
 				/* see page 72, RFC 793 for the specifics */
 				if(!_validate_ack(connection, tcp_ack(tcp_packet))){
-					send_window_ack(connection->send_window, tcp_ack(tcp_packet));
+					send_window_ack(connection->send_window, tcp_ack(tcp_packet), seg_len);
 					//send next chunks of data
 					if(tcp_connection_send_next(connection) > 0)
 						update_peer = 0;
@@ -514,13 +612,13 @@ void tcp_connection_handle_receive_packet(tcp_connection_t connection, tcp_packe
 	
 			  		/* I don't think our send-window will understand if we ack the ack for the fin, but we 
 			  			still need to know that all the previous data has just been acked, so lets ack up to it */
-			  		send_window_ack(connection->send_window, tcp_ack(tcp_packet)-1);
+			  		send_window_ack(connection->send_window, tcp_ack(tcp_packet)-1, seg_len);
 			  		/* NOTE: We don't exit because this may have been an ack+fin so then below
 			  			we can check the fin and move from FIN_WAIT_2 to TIME_WAIT */ 			  						  		
 			  	}
 			  	else{
 			  		/* just a normal data ack then */		  	
-					send_window_ack(connection->send_window, tcp_ack(tcp_packet));
+					send_window_ack(connection->send_window, tcp_ack(tcp_packet), seg_len);
 					//send next chunks of data
 					tcp_connection_send_next(connection);
 				}			
@@ -529,7 +627,7 @@ void tcp_connection_handle_receive_packet(tcp_connection_t connection, tcp_packe
 			else if(state==FIN_WAIT_2){			
 				
 				/* In addition to the processing for the ESTABLISHED state,*/
-				send_window_ack(connection->send_window, tcp_ack(tcp_packet));
+				send_window_ack(connection->send_window, tcp_ack(tcp_packet), seg_len);
 				//send next chunks of data
 				if(tcp_connection_send_next(connection) > 0)
 					update_peer = 0;
@@ -541,7 +639,7 @@ void tcp_connection_handle_receive_packet(tcp_connection_t connection, tcp_packe
           	/* CLOSE-WAIT STATE--We're just waiting for our user to finally close after receiving unsolicited FIN*/
 			else if(state==CLOSE_WAIT){				
           		/* Do the same processing as for the ESTABLISHED state. */
-				send_window_ack(connection->send_window, tcp_ack(tcp_packet));
+				send_window_ack(connection->send_window, tcp_ack(tcp_packet), seg_len);
 				//send next chunks of data
 				if(tcp_connection_send_next(connection) > 0)
 					update_peer = 0;
@@ -549,7 +647,7 @@ void tcp_connection_handle_receive_packet(tcp_connection_t connection, tcp_packe
 			/* CLOSING STATE */
 			else if(state == CLOSING){
 			  	/* In addition to the processing for the ESTABLISHED state, */
-				send_window_ack(connection->send_window, tcp_ack(tcp_packet));
+				send_window_ack(connection->send_window, tcp_ack(tcp_packet), seg_len);
 				//send next chunks of data
 				if(tcp_connection_send_next(connection) > 0)
 					update_peer = 0;
@@ -572,6 +670,9 @@ void tcp_connection_handle_receive_packet(tcp_connection_t connection, tcp_packe
 					tcp_packet_data_destroy(&tcp_packet_data);
     				return;
 				}
+				/* or it's for data that was still going out when the user closed -- our FIN waits on that */
+				send_window_ack(connection->send_window, tcp_ack(tcp_packet), seg_len);
+				tcp_connection_send_next(connection);
 			}
 			/* TIME-WAIT STATE */
 			else if(state == TIME_WAIT){
@@ -591,17 +692,21 @@ void tcp_connection_handle_receive_packet(tcp_connection_t connection, tcp_packe
      			/* DATA check if there's any data, and if there is push it to the window */
      			/* If user used the shutdown r option, then we'll just let them know in our ack that our
      				window size is 0.  All good! */
-			memchunk_t data = tcp_unwrap_data(tcp_packet, tcp_packet_data->packet_size);
-			if(data){ 
-				recv_window_receive(connection->receive_window, data->data, data->length, tcp_seqnum(tcp_packet));
-				memchunk_destroy(&data);
+			/* the window slices the segment text right out of the packet buffer -- no copying */
+			int data_offset = tcp_offset_in_bytes(tcp_packet),
+				data_len = tcp_packet_data->packet_size - data_offset;
+			if(data_len > 0){ 
+				uint32_t ack = recv_window_get_ack(connection->receive_window);
+				recv_window_receive_buffer(connection->receive_window, ((char*)tcp_packet)+data_offset, data_len, 
+											tcp_seqnum(tcp_packet), tcp_packet_data->pool_buffer);
 				// if there's a blocking read, need to signal we got more data to read
 				if(connection->recv_window_alive)
 					tcp_connection_api_signal(connection, 1);
-				// now lets send our ack -- handles the update peer situation
 
-				/* now update that peer because friends don't let friends send unacknowledged bytes*/
-				tcp_wrap_packet_send(connection, tcp_header_init(0), NULL, 0);
+				/* now update that peer because friends don't let friends send unacknowledged bytes
+					-- but in-order data can wait for the next segment or whatever we send next */
+				_ack_data(connection, tcp_seqnum(tcp_packet) == ack 
+					&& recv_window_get_ack(connection->receive_window) == ack + data_len);
 			}   	
         }
        	/* CLOSE-WAIT STATE, CLOSING STATE, LAST-ACK STATE, TIME-WAIT STATE
@@ -609,7 +714,7 @@ void tcp_connection_handle_receive_packet(tcp_connection_t connection, tcp_packe
 			remote side.  Ignore the segment text.   */ 
 		
 		/* eighth, check the FIN bit, */
-		if(tcp_fin_bit(tcp_packet)){
+		if(tcp_fin_bit(tcp_packet) && _fin_in_order(connection, tcp_packet_data)){
 			/* Do not process the FIN if the state is CLOSED, LISTEN or SYN-SENT
      		 since the SEG.SEQ cannot be validated; drop the segment and return. */
      		 if(state == CLOSED || state == LISTEN || state == SYN_SENT){  //<-- we will never actually get here
@@ -661,6 +766,12 @@ void tcp_connection_handle_syn_ack(tcp_connection_t connection, tcp_packet_data_
 	/* received a SYN/ACK, record the seq you got, and validate
 		that the ACK you received is correct */
 	connection->last_seq_received = tcp_seqnum(tcp_packet);
+
+	struct tcp_syn_options options;
+	tcp_utils_get_syn_options(tcp_packet, tcp_packet_data->packet_size, &options);
+	tcp_connection_set_syn_options(connection, &options);
+	// (a SYN's window is never scaled, so this is good no matter what they said)
+	send_window_set_size(connection->send_window, _their_window(connection, tcp_packet));
 	
 	// this function calls tcp_connection_api_finish if in SYN_SENT
 	state_machine_transition(connection->state_machine, receiveSYN_ACK); 
@@ -671,10 +782,14 @@ void tcp_connection_handle_syn(tcp_connection_t connection, tcp_packet_data_t tc
 
 	void* tcp_packet = tcp_packet_data->packet;
 
+	struct tcp_syn_options options;
+	tcp_utils_get_syn_options(tcp_packet, tcp_packet_data->packet_size, &options);
+
 	/* got a SYN -- only valid changes are LISTEN_to_SYN_RECEIVED or SYN_SENT_to_SYN_RECEIVED */ 
 	if(state_machine_get_state(connection->state_machine) == SYN_SENT){		
 	
 		tcp_connection_set_remote(connection, tcp_packet_data->remote_virt_ip, tcp_source_port(tcp_packet));
+		tcp_connection_set_syn_options(connection, &options);
 	
 		/* set the last_seq_received, then pass off to state machine to make transition SYN_SENT_to_SYN_RECEIVED */	
 		connection->last_seq_received = tcp_seqnum(tcp_packet);
@@ -690,7 +805,7 @@ void tcp_connection_handle_syn(tcp_connection_t connection, tcp_packet_data_t tc
 		tcp_connection_handle_syn_LISTEN(connection, tcp_connection_get_local_ip(connection),
 									tcp_connection_get_remote_ip(connection), 
 									tcp_source_port(tcp_packet), 
-									tcp_seqnum(tcp_packet));
+									tcp_seqnum(tcp_packet), &options);
 		// anything else??		
 	}
 	else
@@ -702,6 +817,110 @@ void tcp_connection_handle_syn(tcp_connection_t connection, tcp_packet_data_t tc
 /* 0o0o0oo0o0o0o0o0o0o0o SENDING o0o0o0ooo0o0o0o0o0o0o0o0o0oo0o */
 
 
+/* 0o0o0oo0o0o0o0o0o0o0o OPTIONS o0o0o0ooo0o0o0o0o0o0o0o0o0oo0o */
+
+/* on a SYN we offer everything we do, and on a SYN/ACK (we've heard their SYN, so there's a receive
+	window) only what they offered too -- except the MSS, which doesn't need them to do anything */
+static void _add_syn_options(tcp_connection_t connection, struct tcphdr* header){
+	uint8_t wscale = DEFAULT_WINDOW_SCALE;
+	uint16_t mss = htons(TCP_MSS);
+	tcp_header_add_option(header, TCP_OPTION_MSS, &mss, 2);
+	if(!connection->receive_window || connection->sack_ok)
+		tcp_header_add_option(header, TCP_OPTION_SACK_PERMITTED, NULL, 0);
+	if(!connection->receive_window || connection->wscale_ok)
+		tcp_header_add_option(header, TCP_OPTION_WSCALE, &wscale, 1);
+}
+
+// what they offered on their SYN (or SYN/ACK) decides what we do for the rest of the connection
+void tcp_connection_set_syn_options(tcp_connection_t connection, const struct tcp_syn_options* options){
+	connection->sack_ok = options->sack_permitted;
+	send_window_set_sack(connection->send_window, connection->sack_ok);
+
+	// window scaling only happens if both sides offer it
+	connection->wscale_ok = (options->window_scale >= 0);
+	connection->our_wscale = connection->wscale_ok ? DEFAULT_WINDOW_SCALE : 0;
+	connection->their_wscale = connection->wscale_ok ? options->window_scale : 0;
+
+	// segments are as big as both of us can take (within reason)
+	send_window_set_mss(connection->send_window, MAX(TCP_MIN_MSS, MIN(TCP_MSS, options->mss ? options->mss : TCP_DEFAULT_MSS)));
+}
+
+/* the window to put in a header we're sending: scaled down, unless it's a SYN (RFC 7323 
+	never scales those), and no more than fits */
+static uint16_t _our_window(tcp_connection_t connection, struct tcphdr* header, uint32_t window){
+	if(!tcp_syn_bit(header))
+		window >>= connection->our_wscale;
+	return MIN(window, TCP_WINDOW_MAX);
+}
+
+// the window in a header we got, in bytes
+static uint32_t _their_window(tcp_connection_t connection, struct tcphdr* header){
+	uint32_t window = tcp_window_size(header);
+	if(!tcp_syn_bit(header))
+		window <<= connection->their_wscale;
+	return window;
+}
+
+/* we just got some data: out-of-order data, data that fills in a hole, and duplicates get acked right
+	away (RFC 5681 -- the other side's loss recovery is going by those), in-order data waits for a
+	second segment or TCP_DELAYED_ACK_TIMEOUT, whichever comes first */
+static void _ack_data(tcp_connection_t connection, int in_order){
+	uint32_t blocks[2];
+	if(in_order && !recv_window_get_sack_blocks(connection->receive_window, blocks, 1)
+		&& ++(connection->unacked_segments) < TCP_DELAYED_ACK_SEGMENTS){
+		if(!connection->ack_deadline){
+			struct timeval now;
+			gettimeofday(&now, NULL);
+			connection->ack_deadline = now.tv_sec + now.tv_usec/1000000.0 + TCP_DELAYED_ACK_TIMEOUT;
+		}
+		return;
+	}
+	connection->ack_deadline = 0;
+	tcp_wrap_packet_send(connection, tcp_header_init(0), NULL, 0);
+}
+
+/* a FIN only counts once we've got everything before it -- one that got here past a hole is dropped
+	(its data got kept), and they'll resend it */
+static int _fin_in_order(tcp_connection_t connection, tcp_packet_data_t tcp_packet_data){
+	void* tcp_packet = tcp_packet_data->packet;
+	uint32_t fin_seqnum = tcp_seqnum(tcp_packet) + tcp_packet_data->packet_size - tcp_offset_in_bytes(tcp_packet);
+	if(!connection->receive_window)
+		return 1;
+	return SEQ_DIFF(fin_seqnum, recv_window_get_ack(connection->receive_window)) <= 0;
+}
+
+/* puts as many SACK blocks as will fit in the header's options -- and in the packet, if it's carrying 
+	data_len bytes of data too (the MSS only leaves room for a bare header) */
+static void _add_sack(tcp_connection_t connection, struct tcphdr* header, int data_len){
+	uint32_t blocks[2*TCP_SACK_MAX_BLOCKS];
+	int i, n, room = TCP_HEADER_MIN_SIZE + TCP_OPTIONS_MAX_SIZE - tcp_offset_in_bytes(header);
+	room = MIN(room, (int)MTU - tcp_offset_in_bytes(header) - data_len);
+	// (it's padded out to 4 bytes in front of the blocks)
+	n = MIN(TCP_SACK_MAX_BLOCKS, (room-4)/8);
+	if(n <= 0)
+		return;
+	n = recv_window_get_sack_blocks(connection->receive_window, blocks, n);
+	if(!n)
+		return;
+	for(i=0;i<2*n;i++)
+		blocks[i] = htonl(blocks[i]);
+	tcp_header_add_option(header, TCP_OPTION_SACK, blocks, 8*n);
+}
+
+// hands whatever blocks are in the SACK option on a packet we got to the send window
+static void _receive_sack(tcp_connection_t connection, struct tcphdr* header, int length){
+	uint32_t blocks[2*TCP_SACK_MAX_BLOCKS];
+	void* value;
+	int i, n = tcp_header_find_option(header, length, TCP_OPTION_SACK, &value);
+	if(n <= 0 || n%8)
+		return;
+	n = MIN(n/8, TCP_SACK_MAX_BLOCKS);
+	memcpy(blocks, value, 8*n);
+	for(i=0;i<2*n;i++)
+		blocks[i] = ntohl(blocks[i]);
+	send_window_sack(connection->send_window, blocks, n);
+}
+
 /* 
 tcp_connection_queue_ip_send
 	this is the reason that tcp_wrap_packet_send needs to be defined 
@@ -721,7 +940,7 @@ int tcp_connection_queue_ip_send(tcp_connection_t connection, tcp_packet_data_t
 		return 1;
 	}
 
-	return bqueue_enqueue(connection->to_send, packet);
+	return ring_queue_enqueue(connection->to_send, packet);
 }
 	
 /*
@@ -729,8 +948,17 @@ int tcp_connection_queue_ip_send(tcp_connection_t connection, tcp_packet_data_t
    if we had classes, it takes in and relies upon the tcp_connection_t implementation 
 	 
    I also left the original version intact in src/tcp/tcp_utils.s
+
+   header must come from tcp_header_init (so there's headroom in front of it for ip), and
+   data, if there is any, is a packet_pool buffer whose reference we take over -- it goes
+   out right after the header without being copied in
 */
 int tcp_wrap_packet_send(tcp_connection_t connection, struct tcphdr* header, void* data, int data_len){	
+	return _wrap_packet_send(connection, header, data, data_len, data, NULL);
+}
+
+// same, but data can point anywhere into buffer, the packet_pool buffer (or ring, the mirror_buffer) whose reference we take over
+static int _wrap_packet_send(tcp_connection_t connection, struct tcphdr* header, void* data, int data_len, char* buffer, mirror_buffer_t ring){
 	
 	// gotta put a seqnum on it, right?	
 	if((data_len == 0) && (!tcp_seqnum(header))){
@@ -745,13 +973,14 @@ int tcp_wrap_packet_send(tcp_connection_t connection, struct tcphdr* header, voi
 	tcp_set_source_port(header, connection->local_addr.virt_port);
 
 	/* WINDOW SIZE */
-	tcp_set_window_size(header, DEFAULT_WINDOW_SIZE);
+	uint32_t window = DEFAULT_WINDOW_SIZE;
 	if(connection->receive_window) //we don't set it until we receive our first byte
-		tcp_set_window_size(header, recv_window_get_size(connection->receive_window));
+		window = recv_window_get_size(connection->receive_window);
 	if(!connection->recv_window_alive)
 		/* means we closed the receive window down 
 			-- so lets practice congestion control and tell them not to send more data */
-		tcp_set_window_size(header, 0);
+		window = 0;
+	tcp_set_window_size(header, _our_window(connection, header, window));
 
 	
 	/* ACK */
@@ -761,6 +990,9 @@ int tcp_wrap_packet_send(tcp_connection_t connection, struct tcphdr* header, voi
 		if(connection->receive_window){
 			tcp_set_ack_bit(header);
 			tcp_set_ack(header, recv_window_get_ack(connection->receive_window));
+			// this takes care of any ack we were holding off on
+			connection->ack_sent = tcp_ack(header);
+			connection->unacked_segments = 0;
 		}
 		// if in one of closing states, possible we already closed receive window but still need to correctly ack
 		// for now we're doing it a slightly hacky way of setting it to last_seq_received + 1
@@ -770,6 +1002,10 @@ int tcp_wrap_packet_send(tcp_connection_t connection, struct tcphdr* header, voi
 		}
 	}
 	
+	/* SACK -- tell them about anything we've got past a hole */
+	if(connection->sack_ok && connection->receive_window && tcp_ack_bit(header))
+		_add_sack(connection, header, data == NULL ? 0 : data_len);
+
 	/* DATA */
 	uint32_t total_length = tcp_offset_in_bytes(header) + data_len;
     
@@ -779,101 +1015,174 @@ int tcp_wrap_packet_send(tcp_connection_t connection, struct tcphdr* header, voi
     	view_packet(header, data, data_len); 
     //}   
     
-	if((data != NULL)&&(data_len)){
-		memcpy(((char*)header)+tcp_offset_in_bytes(header), data, data_len);
-		free(data);
-	}
+	if(data == NULL)
+		data_len = 0;
 	
 	uint32_t local_ip = connection->local_addr.virt_ip, 
 			remote_ip = connection->remote_addr.virt_ip;
 	
 	/* CHECKSUM */
-	tcp_utils_add_checksum(header, total_length, local_ip, remote_ip, TCP_DATA);
+	tcp_utils_add_checksum_sg(header, tcp_offset_in_bytes(header), data, data_len, local_ip, remote_ip, TCP_DATA);
 	
 	/* init the packet */
-	tcp_packet_data_t packet_data = tcp_packet_data_init(
-										(char*)header, 
-										total_length,
-										local_ip, remote_ip);
+	tcp_packet_data_t packet_data = tcp_utils_outgoing_packet(header, tcp_offset_in_bytes(header), 
+										data, data_len, buffer, ring, local_ip, remote_ip);
 
 	/* queue it */
 	if(tcp_connection_queue_ip_send(connection, packet_data) < 0){
 		//TODO: HANDLE!
 		puts("Something wrong with sending tcp_packet to_send queue--How do we want to handle this??");	
-		free(packet_data);
+		tcp_packet_data_destroy(&packet_data);
 		return -1;
 	}
 
 	return 1;
 }
 
-void tcp_connection_send_next_chunk(tcp_connection_t connection, send_window_chunk_t next_chunk){
-	// mallocs enough memory for the header and the data
-	//printf("[send chunk length: %d]\n", next_chunk->length);
-	struct tcphdr* header = tcp_header_init(next_chunk->length);
+/* data points into the send_window's send buffer (ring) or a copy of it (buffer), and we've got a reference
+	to whichever it is (see send_window_get_next_data) -- no need to replicate it, the packet just points at 
+	it until it's been sent */
+void tcp_connection_send_next_chunk(tcp_connection_t connection, uint32_t seqnum, char* data, int length, char* buffer, mirror_buffer_t ring){
+	// mallocs enough memory for just the header
+	struct tcphdr* header = tcp_header_init(0);
 		
-	/* the seqnum should be the seqnum in the next_chunk */
-	tcp_set_seq(header, next_chunk->seqnum);
+	/* the seqnum should be the seqnum of the chunk */
+	tcp_set_seq(header, seqnum);
 	
-	// replicate it!! the send window will take care of free()ing it's data 
-	void* data = malloc(next_chunk->length);
-	memcpy(data, next_chunk->data, next_chunk->length);
-
 	/* send it off! */
-	tcp_wrap_packet_send(connection, header, data, next_chunk->length);
+	_wrap_packet_send(connection, header, data, length, buffer, ring);
 }
 
 /* 
 tcp_connection_push_data
 	just pushes the given data into the sending window. Likely followed by a get_next loop 
 */
-void tcp_connection_push_data(tcp_connection_t connection, void* data, int data_len){
+int tcp_connection_push_data(tcp_connection_t connection, void* data, int data_len){
 	/* if the window doesn't exist, you can't write because you haven't 
 		passed through the right states */
 	if(connection->send_window == NULL)
 		CRASH_AND_BURN("Sending window null when trying to push data");
 	
 	// memcpys the data into the window (will handle freeing the data)
-	send_window_push(connection->send_window, data, data_len);
+	return send_window_push(connection->send_window, data, data_len);
 }
 
 // queues chunks off from send_window and handles sending them for as long as send_window wants to send more chunks
 int tcp_connection_send_next(tcp_connection_t connection){
-	int bytes_sent = 0;
-	send_window_chunk_t next_chunk;
+	int bytes_sent = 0, length;
+	uint32_t seqnum;
+	char *data, *buffer;
+	mirror_buffer_t ring;
 	send_window_t send_window = connection->send_window;
 
 	// keep sending as many chunks as window has available to give us
-	// get_next gives you a copy of the data in the window
-	while((next_chunk = send_window_get_next(send_window))){
+	// get_next_data gives you a reference to the buffer the data's in
+	while((length = send_window_get_next_data(send_window, &seqnum, &data, &buffer, &ring))){
 	
 		// send it off
-		tcp_connection_send_next_chunk(connection, next_chunk);
+		tcp_connection_send_next_chunk(connection, seqnum, data, length, buffer, ring);
 
 		// increment bytes_sent
-		bytes_sent += next_chunk->length;
-
-		//send_window_chunk_destroy(&next_chunk);
+		bytes_sent += length;
 	}	
 
 	return bytes_sent;
 }
 
 int tcp_connection_send_data(tcp_connection_t connection, const unsigned char* to_write, int num_bytes){
-	
+	struct iovec iov = { .iov_base = (void*)to_write, .iov_len = num_bytes };
+	return tcp_connection_send_datav(connection, &iov, 1, 0);
+}
+
+static int _writable_state(tcp_connection_t connection){
 	state_e state = tcp_connection_get_state(connection);
-	if(!(state == ESTABLISHED || state == CLOSE_WAIT)){
+	return connection->running && (state == ESTABLISHED || state == CLOSE_WAIT);
+}
+
+/* blocks until the send buffer's drained down to its low watermark (or we can't write anymore)
+	returns 1 if it's writable, 0 if it isn't ever going to be */
+static int _wait_writable(tcp_connection_t connection){
+	struct timespec ts;
+	struct timeval tv;
+
+	pthread_mutex_lock(&(connection->write_mutex));
+	connection->writers_waiting++;
+	while(_writable_state(connection) && !send_window_writable(connection->send_window)){
+		// (checks back in every second, in case the connection's going away)
+		gettimeofday(&tv, NULL);	
+		ts.tv_sec = tv.tv_sec + 1;
+		ts.tv_nsec = tv.tv_usec*1000;
+		pthread_cond_timedwait(&(connection->write_cond), &(connection->write_mutex), &ts);
+	}
+	connection->writers_waiting--;
+	pthread_mutex_unlock(&(connection->write_mutex));
+	return _writable_state(connection);
+}
+
+// wakes up the writers waiting on the send buffer if they can go now
+static void _wake_writers(tcp_connection_t connection){
+	pthread_mutex_lock(&(connection->write_mutex));
+	if(connection->writers_waiting && (!_writable_state(connection) || send_window_writable(connection->send_window)))
+		pthread_cond_broadcast(&(connection->write_cond));
+	pthread_mutex_unlock(&(connection->write_mutex));
+}
+
+static int _iov_length(const struct iovec* iov, int iovcnt){
+	int i, length = 0;
+	for(i=0;i<iovcnt;i++)
+		length += iov[i].iov_len;
+	return length;
+}
+
+// takes the first bytes off of the iovcnt buffers in iov (iov gets changed!)
+static void _iov_advance(struct iovec** iov, int* iovcnt, int bytes){
+	while(*iovcnt && bytes >= (int)(*iov)->iov_len){
+		bytes -= (*iov)->iov_len;
+		(*iov)++;
+		(*iovcnt)--;
+	}
+	if(*iovcnt){
+		(*iov)->iov_base += bytes;
+		(*iov)->iov_len  -= bytes;
+	}
+}
+
+int tcp_connection_send_datav(tcp_connection_t connection, const struct iovec* iov, int iovcnt, int nonblocking){
+	
+	if(!_writable_state(connection)){
 		puts("Trying to send data on a non-established connection.");
 		return -EINVAL; // whats the correct error code here?
 	}
+	if(connection->send_window == NULL)
+		CRASH_AND_BURN("Sending window null when trying to push data");
 
-	// push data to window and then send as much as we can
-	tcp_connection_push_data(connection, (void*)to_write, num_bytes);	
+	int written = 0, pushed;
+	struct iovec *rest = NULL, *left;
+	while(1){
+		// push as much as fits to the window (so it can go out in as few segments as it fits in)
+		pushed = send_window_pushv(connection->send_window, rest ? left : iov, iovcnt);
+		written += pushed;
+
+		/* and have our worker send as much of it as send_window allows -- sending reads and writes 
+			the receive window's ack state too, which is the worker's alone */
+		tcp_connection_schedule(connection);
+
+		if(!rest){
+			// the first time around: if it all fit, there's no need for a copy of iov to keep track of where we are
+			if(!iovcnt || pushed == _iov_length(iov, iovcnt))
+				break;
+			left = rest = malloc(iovcnt*sizeof(struct iovec));
+			memcpy(rest, iov, iovcnt*sizeof(struct iovec));
+		}
+		_iov_advance(&left, &iovcnt, pushed);
+		if(!iovcnt || nonblocking || !_wait_writable(connection))
+			break;
+	}
+	free(rest);
 
-	// send as much data right now as send_window allows
-	int ret = tcp_connection_send_next(connection);
-	
-	return ret;
+	if(!written && iovcnt && nonblocking)
+		return -EAGAIN;
+	return written;
 }
 
 
@@ -897,20 +1206,104 @@ tcp_connection_get_remote_ip(tcp_connection_t connection){ return connection->re
 int 
 tcp_connection_get_socket(tcp_connection_t connection){	return connection->socket_id; }
 
-/*0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0 to_read Thread o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0*/
+/*0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0 Running on the worker o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0*/
 
-// runs thread for tcp_connection to handle sending/reading and keeping track of its packets/acks
-void *_handle_read_send(void *tcpconnection){
-	
-	tcp_connection_t connection = (tcp_connection_t)tcpconnection;
+/* puts the connection on its worker's run queue, unless it's already there.  called whenever something
+	happens that the connection needs to deal with -- a packet for it, its timer going off, something
+	changing when its timer should go off */
+void tcp_connection_schedule(tcp_connection_t connection){
+	if(!connection->worker)
+		return;
+	if(!__atomic_exchange_n(&(connection->scheduled), 1, __ATOMIC_SEQ_CST))
+		tcp_worker_schedule(connection->worker, connection);
+}
+
+/* the connection's timer just gets it scheduled -- none of the actual work happens
+	on the timer wheel's thread */
+static void _timer_fired(void* arg){
+	tcp_connection_schedule((tcp_connection_t)arg);
+}
+
+/* works out when tcp_connection_run next has to do something without a packet coming in -- whichever
+	comes first of the timeout for the state we're in and the send_window's next retransmission --
+	and arms the connection's timer for then */
+static void _arm_timer(tcp_connection_t connection){
+	state_e state = state_machine_get_state(connection->state_machine);
+	double RTO = connection->send_window ? send_window_get_RTO(connection->send_window) : 1.0;
+	double wait = -1, deadline = 0, timeout, send_time = 0;
+	struct timeval now;
+
+	/* same timeouts tcp_connection_run checks for -- how long after state_timer */
+	if(state == ESTABLISHED)
+		wait = KEEP_ALIVE_FREQUENCY;
+	else if(state == SYN_SENT)
+		wait = (1 << (BACKOFF_MULTIPLER*(connection->syn_fin_count)-1))*RTO;
+	else if(state == SYN_RECEIVED)
+		wait = (1 << 3)*RTO;
+	else if(state == LAST_ACK)
+		wait = USER_TIMEOUT;
+	else if(state == FIN_WAIT_1 && connection->syn_fin_count)
+		wait = RTO;
+	else if(state == TIME_WAIT)
+		wait = 2*MSL;
+
+	if(wait >= 0)
+		deadline = connection->state_timer.tv_sec + connection->state_timer.tv_usec/1000000.0 + wait;
+	if(connection->ack_deadline && (!deadline || connection->ack_deadline < deadline))
+		deadline = connection->ack_deadline;
+	if(connection->send_window){
+		timeout = send_window_get_next_timeout(connection->send_window);
+		if(timeout && (!deadline || timeout < deadline))
+			deadline = timeout;
+		send_time = send_window_get_next_send_time(connection->send_window);
+	}
+
+	if(!deadline && !send_time){
+		// nothing to wait for -- a packet or a kick will wake us
+		wheel_timer_cancel(connection->timer);
+		return;
+	}
+
+	gettimeofday(&now, NULL);
+	deadline -= now.tv_sec + now.tv_usec/1000000.0;
+	/* anything overdue (like a SYN_RECEIVED timeout the api hasn't dealt with yet) gets 
+		looked at again no more often than we used to poll */
+	deadline = MAX(deadline, TCP_CONNECTION_DEQUEUE_TIMEOUT_NSECS/1000000000.0);
+	/* but pacing needs the timer wheel's full resolution */
+	if(send_time)
+		deadline = MIN(deadline, MAX(send_time - (now.tv_sec + now.tv_usec/1000000.0), TIMER_WHEEL_TICK_MS/1000.0));
+	wheel_timer_arm(connection->timer, deadline);
+}
+
+/* the connection's worker calls this whenever the connection's been scheduled: reads off (up to
+	TCP_CONNECTION_RUN_BUDGET of) whatever packets are waiting for it, checks its timers and sends what it
+	can, just like its thread used to do each time around its loop -- and then arms its timer for the next
+	time it has something to do on its own.
+	returns 1 if it ran out of budget before running out of packets (so it should be scheduled again) */
+int tcp_connection_run(tcp_connection_t connection){
 
-	struct timespec wait_cond;	
 	struct timeval now;	// keep track of time to compare to window timeouts and connections' syn_timer 
 	double time_elapsed, RTO;
 	void* packet;
-	int ret, timers_ret;
+	int ret, timers_ret = 0, handled = 0;
+
+	if(!connection->running){
+		/* tcp_connection_destroy is waiting for us to let go of it.  scheduled stays set, so
+			it never gets put back on the run queue */
+		pthread_mutex_lock(&(connection->run_mutex));
+		connection->detached = 1;
+		pthread_cond_signal(&(connection->detached_cond));
+		pthread_mutex_unlock(&(connection->run_mutex));
+		return 0;
+	}
+	/* anything that happens from here on needs to get us scheduled again */
+	__atomic_store_n(&(connection->scheduled), 0, __ATOMIC_SEQ_CST);
 
 	while(connection->running){	
+
+		if(handled == TCP_CONNECTION_RUN_BUDGET)
+			return 1; // give the rest of the shard a turn
+		ret = ring_queue_trydequeue(connection->my_to_read, (void*)&packet);
         
         state_e state = state_machine_get_state(connection->state_machine);
         if(connection->send_window){
@@ -920,13 +1313,6 @@ void *_handle_read_send(void *tcpconnection){
         	RTO = 1.0;
         }
 		gettimeofday(&now, NULL);	
-		wait_cond.tv_sec = now.tv_sec+0;
-		wait_cond.tv_nsec = 1000*now.tv_usec+TCP_CONNECTION_DEQUEUE_TIMEOUT_NSECS;
-
-        wait_cond.tv_sec += wait_cond.tv_nsec/1000000000;
-        wait_cond.tv_nsec %= 1000000000;
-        
-		ret = bqueue_timed_dequeue_abs(connection->my_to_read, (void*)&packet, &wait_cond);
 
 		time_elapsed = now.tv_sec - connection->state_timer.tv_sec;
 		time_elapsed += now.tv_usec/1000000.0 - connection->state_timer.tv_usec/1000000.0;
@@ -972,7 +1358,7 @@ void *_handle_read_send(void *tcpconnection){
 		else if(state == FIN_WAIT_1){
 			/* For active close: 
 				RFC: All segments preceding and including FIN  will be retransmitted until acknowledged. */
-			if(time_elapsed > RTO){ // lets use same timeout as send_window
+			if(connection->syn_fin_count && time_elapsed > RTO){ // lets use same timeout as send_window
 				if((connection->syn_fin_count)==SYN_COUNT_MAX){
 					// lets give up on them ever acking it
 					tcp_connection_ABORT(connection);
@@ -994,25 +1380,40 @@ void *_handle_read_send(void *tcpconnection){
 											destroyed it in the loop above when we transitioned to CLOSED */
 			timers_ret = send_window_check_timers(connection->send_window);
 			tcp_connection_send_next(connection);
+
+			/* a FIN that was waiting on the rest of the data to go out first */
+			state = state_machine_get_state(connection->state_machine);
+			if(!(connection->syn_fin_count) && (state == FIN_WAIT_1 || state == LAST_ACK))
+				tcp_connection_send_fin(connection);
 		}
 		/* If we're in certain closing states, after all of our data reliably sent (acked) AND fin acked
 			then we can proceed with rest of close process */
 		
+		/* an ack we've been holding off on -- unless something we sent since already took care of it */
+		if(connection->ack_deadline && now.tv_sec + now.tv_usec/1000000.0 >= connection->ack_deadline){
+			connection->ack_deadline = 0;
+			if(connection->receive_window && connection->ack_sent != recv_window_get_ack(connection->receive_window))
+				tcp_wrap_packet_send(connection, tcp_header_init(0), NULL, 0);
+		}
+
 		//if in CLOSING, can't ack fin until received ack for every preceding segment
 		if((!timers_ret) && (state == CLOSING))
 			tcp_connection_ack_fin(connection); 
 		
 		/* now check if there's something to read */
 		if (ret != 0) 
-			/* should probably check at this point WHY we failed (for instance perhaps the queue
-				was destroyed */
-            // should be EINVAL(ask alex about that linux issue we found and she victoriously debugged) or ETIMEDOUT
-			continue;
+			break;
 
 		//handle to read packet
 		tcp_connection_handle_receive_packet(connection, packet);
+		handled++;
 	}
-	pthread_exit(NULL);
+
+	if(connection->running && connection->timer)
+		_arm_timer(connection);
+	// some of what was sent got acked, so there might be room for writers blocked on the send buffer now
+	_wake_writers(connection);
+	return 0;
 }
 
 /************* Functions regarding the accept queue ************************/
@@ -1076,6 +1477,14 @@ accept_queue_data_t tcp_connection_accept_queue_dequeue(tcp_connection_t connect
 	return data;
 }
 
+// same but never blocks -- NULL if there's nothing queued (or no queue)
+accept_queue_data_t tcp_connection_accept_queue_trydequeue(tcp_connection_t connection){
+	accept_queue_data_t data;
+	if(connection->accept_queue == NULL || bqueue_trydequeue(connection->accept_queue, (void**)&data))
+		return NULL;
+	return data;
+}
+
 /************* End of Functions regarding the accept queue ************************/
 
 
@@ -1096,9 +1505,17 @@ int tcp_connection_state_machine_transition(tcp_connection_t connection, transit
 	//tcp_connection_print_state(connection);
 	int ret = state_machine_transition(connection->state_machine, transition);
 	//tcp_connection_print_state(connection);
+	// new state, new timeout
+	tcp_connection_schedule(connection);
 	return ret;
 }
 
+// restarts state_timer, and makes sure the connection's timer gets re-armed for it
+static void _reset_state_timer(tcp_connection_t connection){
+	gettimeofday(&(connection->state_timer), NULL);
+	tcp_connection_schedule(connection);
+}
+
 state_e tcp_connection_get_state(tcp_connection_t connection){
 	return state_machine_get_state(connection->state_machine);
 }
@@ -1166,6 +1583,47 @@ void tcp_connection_api_signal(tcp_connection_t connection, int ret){
 	/* set return value and signal that tcp_api function finished on the connection's part */
 	connection->api_ret = ret;
 	pthread_cond_signal(&(connection->api_cond));
+	_async_event(connection, ret);
+}
+
+/* async ops */
+
+void tcp_connection_async_lock(tcp_connection_t connection){
+	pthread_mutex_lock(&(connection->async_mutex));
+}
+
+void tcp_connection_async_unlock(tcp_connection_t connection){
+	pthread_mutex_unlock(&(connection->async_mutex));
+}
+
+// call with the async lock held (that's what keeps the op from missing an event in between)
+void tcp_connection_async_park(tcp_connection_t connection, struct tcp_async_op* op){
+	plain_list_append(connection->async_ops, op);
+}
+
+/* hands event to every op parked on us, oldest first -- the ones that are still waiting on us
+	afterwards get parked again */
+static void _async_event(tcp_connection_t connection, int event){
+	tcp_connection_async_lock(connection);
+	if(!connection->async_ops->length){
+		tcp_connection_async_unlock(connection);
+		return;
+	}
+	// take them all off first so whatever gets parked while we're handing this out waits for the next one
+	plain_list_t ops = connection->async_ops;
+	connection->async_ops = plain_list_init();
+
+	// (append puts things at the head, so the oldest is at the end)
+	plain_list_el_t prev, el = ops->head;
+	while(el && el->next)
+		el = el->next;
+	for(; el; el = prev){
+		prev = el->prev;
+		if(!tcp_async_op_event((struct tcp_async_op*)el->data, connection, event))
+			plain_list_append(connection->async_ops, el->data);
+	}
+	plain_list_destroy(&ops);
+	tcp_connection_async_unlock(connection);
 }
 
 void tcp_connection_api_lock(tcp_connection_t connection){
@@ -1300,15 +1758,14 @@ void tcp_connection_refuse_connection(tcp_connection_t connection, tcp_packet_da
 	/* CHECKSUM */
 	tcp_utils_add_checksum(outgoing_header, tcp_offset_in_bytes(outgoing_header), connection->local_addr.virt_ip, connection->remote_addr.virt_ip, TCP_DATA);
 
-	tcp_packet_data_t packet_data = tcp_packet_data_init(
-										(char*)outgoing_header, 
-										tcp_offset_in_bytes(outgoing_header)+0,
+	tcp_packet_data_t packet_data = tcp_utils_outgoing_packet(outgoing_header, 
+										tcp_offset_in_bytes(outgoing_header), NULL, 0, NULL, NULL,
 										connection->local_addr.virt_ip,
 										connection->remote_addr.virt_ip);
 
 	if(tcp_connection_queue_ip_send(connection, packet_data) < 0){
 		puts("Something wrong with sending tcp_packet to_send queue--How do we want to handle this??");	
-		free(packet_data);
+		tcp_packet_data_destroy(&packet_data);
 	}
 
 }
@@ -1317,6 +1774,66 @@ void tcp_connection_refuse_connection(tcp_connection_t connection, tcp_packet_da
 recv_window_t tcp_connection_get_recv_window(tcp_connection_t connection){
 	return connection->receive_window;
 }
+/* our send window starts off with whichever congestion control was picked for us (and keeps it
+	through resets) */
+static send_window_t _send_window_init(tcp_connection_t connection, uint32_t ISN){
+	send_window_t send_window = send_window_init(DEFAULT_WINDOW_SIZE, DEFAULT_WINDOW_CHUNK_SIZE, ISN,
+								WINDOW_ALPHA, WINDOW_BETA, WINDOW_UBOUND, WINDOW_LBOUND);
+	if(connection->congestion_control)
+		send_window_set_congestion_control(send_window, connection->congestion_control);
+	send_window_set_nagle(send_window, !connection->nodelay);
+	send_window_set_cork(send_window, connection->cork);
+	send_window_set_buffer(send_window, connection->send_buffer, connection->send_low_watermark);
+	return send_window;
+}
+
+/* back to CLOSED: whatever's still buffered in the send window goes, and it starts over with a new ISN
+	in case we get reopened.  It's reset in place rather than swapped for a new one, since the api thread 
+	(writing) and the worker (sending) can both be in the middle of using it -- the window's own lock is 
+	all either of them holds */
+static void _send_window_reset(tcp_connection_t connection){
+	send_window_reset(connection->send_window, DEFAULT_WINDOW_SIZE, DEFAULT_WINDOW_CHUNK_SIZE, RAND_ISN());
+}
+
+// picks the congestion control algorithm for this connection, starting right away
+void tcp_connection_set_congestion_control(tcp_connection_t connection, const struct congestion_control_ops* ops){
+	connection->congestion_control = ops;
+	if(connection->send_window)
+		send_window_set_congestion_control(connection->send_window, ops);
+}
+
+// TCP_NODELAY: turns Nagle's algorithm off (1) or back on (0)
+void tcp_connection_set_nodelay(tcp_connection_t connection, int nodelay){
+	connection->nodelay = nodelay;
+	if(connection->send_window)
+		send_window_set_nagle(connection->send_window, !nodelay);
+}
+
+// TCP_CORK: uncorking has our worker send off whatever it was holding back
+void tcp_connection_set_cork(tcp_connection_t connection, int cork){
+	connection->cork = cork;
+	if(!connection->send_window)
+		return;
+	send_window_set_cork(connection->send_window, cork);
+	if(!cork)
+		tcp_connection_schedule(connection);
+}
+
+// SO_SNDBUF and SO_SNDLOWAT: writers blocked on the old size might be able to go now
+void tcp_connection_set_send_buffer(tcp_connection_t connection, uint32_t size, uint32_t low_watermark){
+	connection->send_buffer = size;
+	connection->send_low_watermark = MIN(low_watermark, size);
+	if(!connection->send_window)
+		return;
+	send_window_set_buffer(connection->send_window, size, low_watermark);
+	_wake_writers(connection);
+}
+
+uint32_t tcp_connection_get_send_buffer(tcp_connection_t connection){ return connection->send_buffer; }
+uint32_t tcp_connection_get_send_low_watermark(tcp_connection_t connection){ return connection->send_low_watermark; }
+int tcp_connection_get_nodelay(tcp_connection_t connection){ return connection->nodelay; }
+int tcp_connection_get_cork(tcp_connection_t connection){ return connection->cork; }
+
 // needed for driver window_cmd
 send_window_t tcp_connection_get_send_window(tcp_connection_t connection){
 	return connection->send_window;
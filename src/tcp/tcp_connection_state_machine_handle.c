@@ -60,7 +60,7 @@ int tcp_connection_LISTEN_to_SYN_RECEIVED(tcp_connection_t connection){
 	    2. send your own SEQ number */
 
 	 //sets time that we transitioned to SYN_RECEIVED -- so that we can timeout when necessary
-	gettimeofday(&(connection->state_timer), NULL);
+	_reset_state_timer(connection);
 	
 	/*  just to reiterate, last_seq_received should have JUST been received by the SYN
 		packet that made the state transition call this function */	// <-- Thanks a lot for that comment!! :)
@@ -80,7 +80,7 @@ int tcp_connection_LISTEN_to_SYN_RECEIVED(tcp_connection_t connection){
 	tcp_set_seq(header, ISN); 
 	connection->last_seq_sent = ISN;
 
-	tcp_set_window_size(header, recv_window_get_size(connection->receive_window));
+	_add_syn_options(connection, header);
 
 	tcp_wrap_packet_send(connection, header, NULL, 0);
 
@@ -116,9 +116,10 @@ int tcp_connection_send_syn(tcp_connection_t connection){
 
 	/* SEQ */
 	tcp_set_seq(header, connection->last_seq_sent);
+	_add_syn_options(connection, header);
 	
 	// set time of when we're sending off syn
-	gettimeofday(&(connection->state_timer), NULL);
+	_reset_state_timer(connection);
 
 	/*  that should be good? send it off. Note: NULL because I'm assuming there's
 		to send when initializing a connection, but that's not necessarily true */
@@ -172,6 +173,7 @@ int tcp_connection_LISTEN_to_SYN_SENT(tcp_connection_t connection){
 
 	/* SEQ */
 	tcp_set_seq(header, send_window_get_next_seq(connection->send_window)); //NOTE: send window initalized in tcp_connection_init
+	_add_syn_options(connection, header);
 
 	tcp_wrap_packet_send(connection, header, NULL, 0);
 	
@@ -189,7 +191,7 @@ int tcp_connection_SYN_SENT_to_SYN_RECEIVED(tcp_connection_t connection){
 		exit(1); // CRASH AND BURN 
 	}
 	 //sets time that we transitioned to SYN_RECEIVED
-	gettimeofday(&(connection->state_timer), NULL);
+	_reset_state_timer(connection);
 	
 	// again, last_seq_received will have been set by the packet that triggered this transition 
 	connection->receive_window = recv_window_init(DEFAULT_WINDOW_SIZE, connection->last_seq_received);
@@ -202,6 +204,7 @@ int tcp_connection_SYN_SENT_to_SYN_RECEIVED(tcp_connection_t connection){
 
 	/* SYN */
 	tcp_set_syn_bit(header);
+	_add_syn_options(connection, header);
 	
 	tcp_wrap_packet_send(connection, header, NULL, 0);
 
@@ -251,7 +254,7 @@ int tcp_connection_SYN_RECEIVED_to_ESTABLISHED(tcp_connection_t connection){
 int tcp_connection_send_keep_alive(tcp_connection_t connection){
 
 	/* reset timer */
-	gettimeofday(&(connection->state_timer), NULL);
+	_reset_state_timer(connection);
 	
 	/* now init the packet */
 	struct tcphdr* header = tcp_header_init(0);
@@ -272,8 +275,21 @@ int tcp_connection_send_keep_alive(tcp_connection_t connection){
 /* 0o0o0oo0o0o0o0o0o0o0o0o0o0o0o0o0o0o Closing Connection 0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o */
 /* 0o0o0oo0o0o0o0o0o0o0o0o0o0o0o0o0o0o Closing Connection 0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o0o */
 
+// the FIN's seqnum is right after the last byte pushed to the send window, sent yet or not
+static uint32_t _fin_seqnum(tcp_connection_t connection){
+	return (send_window_get_next_seq(connection->send_window) + send_window_get_unsent(connection->send_window)) % MAX_SEQNUM;
+}
+
 // allows us to resend fin like we do for syn or any data
 int tcp_connection_send_fin(tcp_connection_t connection){
+	/* the FIN goes after everything that was pushed before the CLOSE, so it has to wait until all of
+		that has at least been sent -- tcp_connection_run tries again as the send window drains.  Nothing
+		more is coming, so no holding any of it back for Nagle or a cork either */
+	send_window_flush(connection->send_window);
+	if(send_window_get_unsent(connection->send_window))
+		tcp_connection_send_next(connection);
+	if(send_window_get_unsent(connection->send_window))
+		return 0;
 	
 	/* increment fin count */
 	connection->syn_fin_count++;
@@ -288,7 +304,7 @@ int tcp_connection_send_fin(tcp_connection_t connection){
 	tcp_set_seq(header, connection->fin_seqnum);
 	
 	// set time of when we're sending off fin
-	gettimeofday(&(connection->state_timer), NULL);
+	_reset_state_timer(connection);
 
 	/*  that should be good? send it off. Note: NULL because I'm assuming there's
 		to send when initializing a connection, but that's not necessarily true */
@@ -337,7 +353,7 @@ int tcp_connection_CLOSE_WAIT_to_LAST_ACK(tcp_connection_t connection){
     the connection is aborted and the user is told. */
     
     connection->syn_fin_count = 0; //not that we're going to use it for resending fins			
-	connection->fin_seqnum = send_window_get_next_seq(connection->send_window);
+	connection->fin_seqnum = _fin_seqnum(connection);
 	tcp_connection_send_fin(connection); //this will set the timer
 		
 	//now just wait for the ack to our fin and time out if it never comes
@@ -345,9 +361,8 @@ int tcp_connection_CLOSE_WAIT_to_LAST_ACK(tcp_connection_t connection){
 }
 // we received the ack we sent our peer -- so we can finish this closing process
 int tcp_connection_LAST_ACK_to_CLOSED(tcp_connection_t connection){
-	// destroy window -- i mean make a new one (We don't want to reuse the old one if reOPEN)
-	connection->send_window = send_window_init(DEFAULT_WINDOW_SIZE, DEFAULT_WINDOW_CHUNK_SIZE, RAND_ISN(),
-								WINDOW_ALPHA, WINDOW_BETA, WINDOW_UBOUND, WINDOW_LBOUND);
+	// destroy window and make a new one (We don't want to reuse the old one if reOPEN)
+	_send_window_reset(connection);
 	//okay but destroy this one
 	recv_window_destroy(&(connection->receive_window));
 	tcp_connection_api_signal(connection, 0); //0 for success, right?
@@ -382,7 +397,7 @@ int tcp_connection_SYN_RECEIVED_to_FIN_WAIT_1(tcp_connection_t connection){
       then form a FIN segment and send it, and enter FIN-WAIT-1 state;
       otherwise queue for processing after entering ESTABLISHED state.*/
 	connection->syn_fin_count = 0;	
-	connection->fin_seqnum = send_window_get_next_seq(connection->send_window);
+	connection->fin_seqnum = _fin_seqnum(connection);
 	tcp_connection_send_fin(connection);
 	
 	return 1;
@@ -393,6 +408,7 @@ int tcp_connection_ESTABLISHED_to_FIN_WAIT_1(tcp_connection_t connection){
 	/* RFC: Queue this until all preceding SENDs have been segmentized, then
       form a FIN segment and send it.  In any case, enter FIN-WAIT-1
       state.
+		(tcp_connection_send_fin holds off on it until that's happened)
 	*/
 	
 	/* So our issue here is that we don't have a way of pushing a fin to our send window.
@@ -403,7 +419,7 @@ int tcp_connection_ESTABLISHED_to_FIN_WAIT_1(tcp_connection_t connection){
 				if it needs to resend its fin.  When it ensures the timeout has occurred 
 				 then it will resend a fin up to 3 times.  Since we're in the FIN_WAIT_1 state the user 
 				 will not be able to add to the send-window queue, so we can set:  */			
-	connection->fin_seqnum = send_window_get_next_seq(connection->send_window);
+	connection->fin_seqnum = _fin_seqnum(connection);
 	tcp_connection_send_fin(connection);
 	
 	return 1;	
@@ -430,7 +446,7 @@ int tcp_connection_FIN_WAIT_2_to_TIME_WAIT(tcp_connection_t connection){
 		so we ACK their fin and set timer for time_wait */
 	
 	//set timer
-	gettimeofday(&(connection->state_timer), NULL);
+	_reset_state_timer(connection);
 	
 	//ack their fin
 	tcp_connection_ack_fin(connection);		
@@ -444,7 +460,7 @@ int tcp_connection_FIN_WAIT_2_to_TIME_WAIT(tcp_connection_t connection){
 int tcp_connection_CLOSING_to_TIME_WAIT(tcp_connection_t connection){
 	
 	//set timer
-	gettimeofday(&(connection->state_timer), NULL);
+	_reset_state_timer(connection);
 
 	return 1;
 }
@@ -496,9 +512,8 @@ int tcp_connection_SYN_SENT_to_CLOSED(tcp_connection_t connection){
 	/* We're going into CLOSED state */
 	connection->closing = 1;
 
-	// destroy window -- i mean make a new one (We don't want to reuse the old one if reOPEN)
-	connection->send_window = send_window_init(DEFAULT_WINDOW_SIZE, DEFAULT_WINDOW_CHUNK_SIZE, RAND_ISN(),
-								WINDOW_ALPHA, WINDOW_BETA, WINDOW_UBOUND, WINDOW_LBOUND);
+	// destroy window and make a new one (We don't want to reuse the old one if reOPEN)
+	_send_window_reset(connection);
 	//okay but destroy this one
 	if(connection->receive_window)
 		recv_window_destroy(&(connection->receive_window));
@@ -517,9 +532,8 @@ int tcp_connection_CLOSED_by_RST(tcp_connection_t connection){
 	/* We're going into CLOSED state */
 	connection->closing = 1;	
 
-	// destroy window -- i mean make a new one (We don't want to reuse the old one if reOPEN)
-	connection->send_window = send_window_init(DEFAULT_WINDOW_SIZE, DEFAULT_WINDOW_CHUNK_SIZE, RAND_ISN(),
-								WINDOW_ALPHA, WINDOW_BETA, WINDOW_UBOUND, WINDOW_LBOUND);
+	// destroy window and make a new one (We don't want to reuse the old one if reOPEN)
+	_send_window_reset(connection);
 	//okay but destroy this one
 	if(connection->receive_window)
 		recv_window_destroy(&(connection->receive_window));
@@ -127,11 +127,12 @@ struct tcp_node{
 	/****** End of Kernal Related *********/
 
 	/******* Thread Related **************/
-	bqueue_t *to_send;	//--- tcp data for ip to send
-	bqueue_t *to_read;	//--- tcp data that ip pushes on to queue for tcp to handle
+	ring_queue_t to_send;	//--- tcp data for ip to send (every connection pushes onto it)
+	ring_queue_t to_read;	//--- tcp data that ip pushes on to queue for tcp to handle
 	bqueue_t *stdin_commands;	//---  way for tcp_node to pass user input commands to ip_node
 
 	plain_list_t thread_list;
+	tcp_worker_pool_t workers; // every connection runs on one of these
 	/******* End of Thread Related **************/
 };
 
@@ -147,13 +148,10 @@ tcp_node_t tcp_node_init(iplist_t* links){
 	/************ Create Queues ********************/			
 	// create to_send and to_read stdin_commands queues that allow tcp_node and ip_node to communicate
 	// to_send is loaded with tcp packets by tcp_node that need to be sent by ip_node
-	bqueue_t *to_send = (bqueue_t*) malloc(sizeof(bqueue_t));
-	bqueue_init(to_send);
-	tcp_node->to_send = to_send;
+	tcp_node->to_send = ring_queue_init(IP_NODE_TO_SEND_CAPACITY, RING_QUEUE_MPSC);
 	// to_read is loaded with unwrapped ip_packets by ip_node that tcp_node needs to handle and unwrap as tcp packets
-	bqueue_t *to_read = (bqueue_t*) malloc(sizeof(bqueue_t));
-	bqueue_init(to_read);
-	tcp_node->to_read = to_read;
+	// (only the link interface thread ever pushes onto it)
+	tcp_node->to_read = ring_queue_init(IP_NODE_TO_READ_CAPACITY, RING_QUEUE_SPSC);
 	// stdin_commands is for the tcp_node to pass user input commands to ip_node that ip_node needs to handle
 	bqueue_t *stdin_commands = (bqueue_t*) malloc(sizeof(bqueue_t));   // way for tcp_node to pass user input commands to ip_node
 	bqueue_init(stdin_commands);	
@@ -188,6 +186,7 @@ tcp_node_t tcp_node_init(iplist_t* links){
 
 	/* thread queue */
 	tcp_node->thread_list = plain_list_init();
+	tcp_node->workers = tcp_worker_pool_init(TCP_NODE_WORKERS, MAX_FILE_DESCRIPTORS);
 	
 	//// you're still running right? right
 	tcp_node->running = 1;
@@ -266,6 +265,8 @@ void tcp_node_destroy(tcp_node_t tcp_node){
   	print(("tcp_node_destroy 5"), CLOSING_PRINT);
 	// free the array itself
 	free(tcp_node->connections);
+	// nothing left for the workers to run
+	tcp_worker_pool_destroy(&(tcp_node->workers));
 	// get rid of kernal mutex
 	pthread_mutex_unlock(&(tcp_node->kernal_mutex));
 	pthread_mutex_destroy(&(tcp_node->kernal_mutex));
@@ -277,11 +278,9 @@ void tcp_node_destroy(tcp_node_t tcp_node){
 	ip_node_destroy(&ip_node);
   	print(("tcp_node_destroy 7"), CLOSING_PRINT);
   		
-	bqueue_destroy(tcp_node->to_send);
-	free(tcp_node->to_send);
+	ring_queue_destroy(&(tcp_node->to_send));
   	print(("tcp_node_destroy 8"), CLOSING_PRINT);
-	bqueue_destroy(tcp_node->to_read);
-	free(tcp_node->to_read);
+	ring_queue_destroy(&(tcp_node->to_read));
   	print(("tcp_node_destroy 9"), CLOSING_PRINT);
 	bqueue_destroy(tcp_node->stdin_commands);
 	free(tcp_node->stdin_commands);
@@ -311,6 +310,11 @@ tcp_connection_t tcp_node_connection_accept(tcp_node_t tcp_node, tcp_connection_
 	if(data == NULL)
 		return NULL; // means there was an error in dequeueing -- was accept_queue destroyed?
 	
+	return tcp_node_connection_accept_data(tcp_node, listening_connection, data);
+}
+
+/* the rest of tcp_node_connection_accept, for when the triple was already dequeued -- takes care of destroying data */
+tcp_connection_t tcp_node_connection_accept_data(tcp_node_t tcp_node, tcp_connection_t listening_connection, accept_queue_data_t data){
 	
 	// create new connection which will be the accepted connection 
 	// -- function will insert it into kernal array and socket hashmap
@@ -325,6 +329,7 @@ tcp_connection_t tcp_node_connection_accept(tcp_node_t tcp_node, tcp_connection_
 	tcp_connection_set_local_ip(new_connection, accept_queue_data_get_local_ip(data));
 	tcp_connection_set_remote(new_connection, accept_queue_data_get_remote_ip(data), accept_queue_data_get_remote_port(data));
 	tcp_connection_set_last_seq_received(new_connection, accept_queue_data_get_seq(data));
+	tcp_connection_set_syn_options(new_connection, accept_queue_data_get_syn_options(data));
 
 	// don't we need to set the local port? because it needs to receive data
 	int port = tcp_node_assign_port(tcp_node, new_connection, 
@@ -615,7 +620,7 @@ void tcp_node_print(tcp_node_t tcp_node){
 void tcp_node_start(tcp_node_t tcp_node){
 	/* tcp_node runs 4 threads: 
 		pthread_t tcp_stdin_thread to catch	stdin and put commands in stdin_queue for tcp_node to handle
-		ip_link_interface_thread:  reads off link interfaces (current select() loop) and throws packets for tcp to handle into to_read
+		ip_link_interface_thread:  reads off link interfaces (epoll loop) and throws packets for tcp to handle into to_read
 		ip_send_thread: calls p_thread_cond_wait(&to_send) and sends things loaded on to queue
 		ip_command_thread: calls p_thread_cond_wait(&stdin_commands) and handles ip commands loaded on to queue
 	*/
@@ -639,7 +644,7 @@ void tcp_node_start(tcp_node_t tcp_node){
 	// create timespec for timeout on pthread_cond_timedwait(&to_read);
 	struct timespec wait_cond;// = {PTHREAD_COND_TIMEOUT_SEC, PTHREAD_COND_TIMEOUT_NSEC}; //
 
-	bqueue_t* to_read = tcp_node->to_read;
+	ring_queue_t to_read = tcp_node->to_read;
 	struct timeval now;
 	void* packet;
 	int ret;
@@ -656,7 +661,7 @@ void tcp_node_start(tcp_node_t tcp_node){
         wait_cond.tv_sec += wait_cond.tv_nsec/1000000000;
         wait_cond.tv_nsec %= 1000000000;
 		/* try to get the next thing on queue */
-        ret = bqueue_timed_dequeue_abs(to_read, &packet, &wait_cond);
+        ret = ring_queue_timed_dequeue_abs(to_read, &packet, &wait_cond);
 		if (ret != 0) 
 			/* should probably check at this point WHY we failed (for instance perhaps the queue
 				was destroyed */
@@ -717,6 +722,14 @@ int tcp_node_queue_ip_cmd(tcp_node_t tcp_node, char* buffered_cmd){
 int tcp_node_running(tcp_node_t tcp_node){
 	return tcp_node->running;
 }
+
+timer_wheel_t tcp_node_get_timer_wheel(tcp_node_t tcp_node){
+	return ip_node_get_timer_wheel(tcp_node->ip_node);
+}
+
+tcp_worker_t tcp_node_get_worker(tcp_node_t tcp_node, int socket){
+	return tcp_worker_pool_get(tcp_node->workers, (unsigned int)socket);
+}
 // returns whether ip_node running still
 int tcp_node_ip_running(tcp_node_t tcp_node){
 	return ip_node_running(tcp_node->ip_node);
@@ -779,10 +792,11 @@ void tcp_node_refuse_connection(tcp_node_t tcp_node, tcp_packet_data_t packet){
 	/* CHECKSUM */
 	tcp_utils_add_checksum(outgoing_header, sizeof(*outgoing_header), packet->local_virt_ip, packet->remote_virt_ip, TCP_DATA);
 
-	tcp_packet_data_t rst_packet = tcp_packet_data_init((char*)outgoing_header, sizeof(*outgoing_header), packet->local_virt_ip, packet->remote_virt_ip);
+	tcp_packet_data_t rst_packet = tcp_utils_outgoing_packet(outgoing_header, sizeof(*outgoing_header), NULL, 0, NULL, NULL, packet->local_virt_ip, packet->remote_virt_ip);
 	
 	/* SEND IT OFF */
-	ip_node_send_tcp(tcp_node->ip_node, rst_packet);
+	if(ip_node_send_tcp(tcp_node->ip_node, rst_packet) < 0)
+		tcp_packet_data_destroy(&rst_packet);
 
 	
 	return;
@@ -828,8 +842,9 @@ static void _handle_packet(tcp_node_t tcp_node, tcp_packet_data_t tcp_packet){
 		return;
 	}
 
-	// put it on that connection's my_to_read queue
-	tcp_connection_queue_to_read(connection, tcp_packet);
+	// put it on that connection's my_to_read queue -- if the connection is so far behind that it's full, drop it
+	if(!tcp_connection_queue_to_read(connection, tcp_packet))
+		tcp_packet_data_destroy(&tcp_packet);
 }
 
 /* helper function to tcp_node_start -- does the work of starting up _handle_tcp_node_stdin() in a thread */
@@ -854,8 +869,8 @@ static int _start_ip_threads(tcp_node_t tcp_node,
 			pthread_t* ip_link_interface_thread, pthread_t* ip_send_thread, pthread_t* ip_command_thread){
 	/*struct ip_thread_data{
 		ip_node_t ip_node;
-		bqueue_t *to_send;
-		bqueue_t *to_read;
+		ring_queue_t to_send;
+		ring_queue_t to_read;
 		bqueue_t *stdin_commands;   // way for tcp_node to pass user input commands to ip_node
 	};*/
 	// fetch and put arguments into ip_thread_data_t  -- each thread responsible for freeing its own ip_thread_data arg
@@ -458,6 +458,139 @@ void vv_write(const char* line, tcp_node_t tcp_node){
 	free(to_write);
 }
 
+// the most buffers v_writev/v_readv/v_peek take at once
+#define DRIVER_IOV_MAX 16
+
+/* v_writev [socket] [data] [data] ... -- each word goes in a buffer of its own, and they all get 
+	written with one v_writev */
+void v_writev(const char* line, tcp_node_t tcp_node){
+	struct iovec iov[DRIVER_IOV_MAX];
+	int socket, consumed, iovcnt = 0;
+	char *words, *word, *save;
+
+	if(sscanf(line, "v_writev %d %n", &socket, &consumed) != 1){
+		fprintf(stderr, "syntax error (usage: v_writev [socket] [data] [data] ...)\n");
+		return;
+	}
+	words = strdup(line + consumed);
+	for(word=strtok_r(words, " \t\n", &save);word && iovcnt<DRIVER_IOV_MAX;word=strtok_r(NULL, " \t\n", &save)){
+		iov[iovcnt].iov_base = word;
+		iov[iovcnt].iov_len = strlen(word);
+		iovcnt++;
+	}
+	if(!iovcnt){
+		fprintf(stderr, "syntax error (payload unspecified)\n");
+		free(words);
+		return;
+	}
+
+	int ret = tcp_api_writev(tcp_node, socket, iov, iovcnt);
+	printf("v_writev on %d buffers returned value: %d\n", iovcnt, ret);
+	free(words);
+}
+
+/* v_readv [socket] [bytes] [bytes] ... -- reads (without blocking) into buffers of those sizes, one 
+	after the other, and prints what each one got */
+void v_readv(const char* line, tcp_node_t tcp_node){
+	struct iovec iov[DRIVER_IOV_MAX];
+	int socket, consumed, bytes, iovcnt = 0, i, n;
+
+	if(sscanf(line, "v_readv %d %n", &socket, &consumed) != 1){
+		fprintf(stderr, "syntax error (usage: v_readv [socket] [bytes] [bytes] ...)\n");
+		return;
+	}
+	line += consumed;
+	while(iovcnt < DRIVER_IOV_MAX && sscanf(line, "%d %n", &bytes, &consumed) == 1 && bytes > 0){
+		iov[iovcnt].iov_base = malloc(bytes);
+		iov[iovcnt].iov_len = bytes;
+		iovcnt++;
+		line += consumed;
+	}
+	if(!iovcnt){
+		fprintf(stderr, "syntax error (usage: v_readv [socket] [bytes] [bytes] ...) where bytes are positive integers\n");
+		return;
+	}
+
+	int ret = tcp_api_readv(tcp_node, socket, iov, iovcnt);
+	printf("v_readv returned value: %d\n", ret);
+	for(i=0, n=ret;i<iovcnt && n>0;n-=iov[i].iov_len, i++)
+		printf("[%d]: %.*s\n", i, (int)MIN((size_t)n, iov[i].iov_len), (char*)iov[i].iov_base);
+
+	for(i=0;i<iovcnt;i++)
+		free(iov[i].iov_base);
+}
+
+/* v_peek [socket] -- prints what there is to read, slice by slice, without reading it */
+void v_peek(const char* line, tcp_node_t tcp_node){
+	struct iovec iov[DRIVER_IOV_MAX];
+	int socket, i;
+
+	if(sscanf(line, "v_peek %d", &socket) != 1){
+		fprintf(stderr, "syntax error (usage: v_peek [socket])\n");
+		return;
+	}
+
+	int ret = tcp_api_peek(tcp_node, socket, iov, DRIVER_IOV_MAX);
+	printf("v_peek returned value: %d\n", ret);
+	for(i=0;i<ret;i++)
+		printf("[%d] %d bytes: %.*s\n", i, (int)iov[i].iov_len, (int)iov[i].iov_len, (char*)iov[i].iov_base);
+}
+
+/* v_consume [socket] [bytes] -- reads bytes without copying them anywhere (after a v_peek) */
+void v_consume(const char* line, tcp_node_t tcp_node){
+	int socket;
+	uint32_t bytes;
+
+	if(sscanf(line, "v_consume %d %u", &socket, &bytes) != 2){
+		fprintf(stderr, "syntax error (usage: v_consume [socket] [bytes])\n");
+		return;
+	}
+
+	int ret = tcp_api_consume(tcp_node, socket, bytes);
+	printf("v_consume returned value: %d\n", ret);
+}
+
+// v_setsockopt [socket] [nodelay/cork/sndbuf/sndlowat] [value] -- or without a value, v_getsockopt
+static int _sockopt(const char* name){
+	if(!strcmp(name, "nodelay"))
+		return TCP_NODELAY;
+	if(!strcmp(name, "cork"))
+		return TCP_CORK;
+	if(!strcmp(name, "sndbuf"))
+		return SO_SNDBUF;
+	if(!strcmp(name, "sndlowat"))
+		return SO_SNDLOWAT;
+	return -1;
+}
+
+void v_setsockopt(const char* line, tcp_node_t tcp_node){
+	int socket, value;
+	char name[32];
+
+	if(sscanf(line, "v_setsockopt %d %31s %d", &socket, name, &value) != 3 || _sockopt(name) < 0){
+		fprintf(stderr, "syntax error (usage: v_setsockopt [socket] [nodelay/cork/sndbuf/sndlowat] [value])\n");
+		return;
+	}
+
+	int ret = tcp_api_setsockopt(tcp_node, socket, _sockopt(name), value);
+	printf("v_setsockopt returned value: %d\n", ret);
+}
+
+void v_getsockopt(const char* line, tcp_node_t tcp_node){
+	int socket, value;
+	char name[32];
+
+	if(sscanf(line, "v_getsockopt %d %31s", &socket, name) != 2 || _sockopt(name) < 0){
+		fprintf(stderr, "syntax error (usage: v_getsockopt [socket] [nodelay/cork/sndbuf/sndlowat])\n");
+		return;
+	}
+
+	int ret = tcp_api_getsockopt(tcp_node, socket, _sockopt(name), &value);
+	if(ret < 0)
+		printf("v_getsockopt returned value: %d\n", ret);
+	else
+		printf("[socket %d]: %s is %d\n", socket, name, value);
+}
 
 /*
 struct sendrecvfile_arg {
@@ -528,7 +661,14 @@ void help_cmd(const char *line, tcp_node_t tcp_node){
          "- sendfile [filename] [ip] [port]: Connect to the given ip and port, send the entirety of the specified file, and close the connection.\n"
          "- recvfile [filename] [port]: Listen for a connection on the given port. Once established, write everything you can read from the socket to the given file. Once the other side closes the connection, close the connection as well.\n"
          "- shutdown [socket] [read/write/both]: v_shutdown on the given socket. If read is given, close only the reading side. If write is given, close only the writing side. If both is given, close both sides. Default is write.\n"
-         "- close [socket]: v_close on the given socket.\n");
+         "- close [socket]: v_close on the given socket.\n"
+         "- cc [socket] [algorithm]: Switch the socket's congestion control to the given algorithm (newreno, cubic or bbr), or without one, print its congestion window and how it got there.\n"
+         "- v_setsockopt [socket] [nodelay/cork] [0/1]: Turn TCP_NODELAY or TCP_CORK on or off for the socket (v_getsockopt [socket] [nodelay/cork] to see what it's at).\n"
+         "- v_setsockopt [socket] [sndbuf/sndlowat] [bytes]: Set how much the socket buffers before writes block, or how far that drains before they go on (v_getsockopt too).\n"
+         "- v_writev [socket] [data] [data] ...: Write each word from its own buffer, all in one v_writev.\n"
+         "- v_readv [socket] [bytes] [bytes] ...: Read (without blocking) into buffers of those sizes, one after the other, and print what each got.\n"
+         "- v_peek [socket]: Print what there is to read, slice by slice, without reading it.\n"
+         "- v_consume [socket] [bytes]: Read that many bytes without copying them anywhere (after v_peek).\n");
 
   return;
 }
@@ -653,17 +793,52 @@ void window_cmd(const char* line, tcp_node_t tcp_node){
 	}
 	int s_size = 0;
 	int r_size = 0;	
+	uint32_t cwnd = 0;
 	send_window_t s = tcp_connection_get_send_window(connection);
 	recv_window_t r = tcp_connection_get_recv_window(connection);
 
 	if(s){
 	 	s_size = send_window_get_size(s);
+		cwnd = send_window_get_cwnd(s);
 	}
 	if(r){
 		r_size = (int)recv_window_get_size(r);
 	}
 
-	printf("[socket %d]:\n\t send window size: %d\n\t receive window size: %d\n", socket, s_size, r_size);
+	printf("[socket %d]:\n\t send window size: %d\n\t congestion window: %u\n\t receive window size: %d\n", socket, s_size, cwnd, r_size);
+}
+
+/* cc socket [algorithm] -- picks the socket's congestion control, or prints what it's up to */
+void cc_cmd(const char* line, tcp_node_t tcp_node){
+	int socket;
+	char algorithm[32];
+	int ret = sscanf(line, "cc %d %31s", &socket, algorithm);
+	if(ret < 1){
+		fprintf(stderr, "syntax error (usage: cc [socket] [algorithm])\n");
+		return;
+	}
+
+	tcp_connection_t connection = tcp_node_get_connection_by_socket(tcp_node, socket);
+	if(!connection){
+		printf("Error: %s\n", strerror(EBADF));
+		return;
+	}
+	if(ret == 2){
+		const struct congestion_control_ops* ops = congestion_control_find(algorithm);
+		if(!ops){
+			printf("Error: no congestion control called %s\n", algorithm);
+			return;
+		}
+		tcp_connection_set_congestion_control(connection, ops);
+		printf("[socket %d]: congestion control is now %s\n", socket, ops->name);
+		return;
+	}
+
+	send_window_t s = tcp_connection_get_send_window(connection);
+	if(!s)
+		return;
+	printf("[socket %d]:\n", socket);
+	send_window_print_congestion_control(s);
 }
 
 struct {
@@ -682,6 +857,7 @@ struct {
   {"sockets", sockets_cmd}, 
   {"ls", sockets_cmd}, 
   {"window", window_cmd},
+  {"cc", cc_cmd},
   {"recv", recv_cmd}, // calls tcp_api_read
   {"r", recv_cmd},	// calls tcp_api_read
   {"send", send_cmd},
@@ -706,6 +882,12 @@ struct {
   {"a", accept_cmd}, // follows specs for driver -- opens socket, binds, , listens and starts accepting connections
 
   {"v_write", vv_write},  // calls v_write
+  {"v_writev", v_writev},  // calls v_writev
+  {"v_readv", v_readv},  // calls v_readv
+  {"v_peek", v_peek},  // calls v_peek
+  {"v_consume", v_consume},  // calls v_consume
+  {"v_setsockopt", v_setsockopt}, // calls v_setsockopt
+  {"v_getsockopt", v_getsockopt}, // calls v_getsockopt
 	
   // custom commands 
   {"1", command_1}, // performs command 'v_connect 0 10.10.168.73 12'
@@ -8,6 +8,7 @@
 
 
 #include "ipsum.h"
+#include "packet_pool.h"
 #include "tcp_utils.h"
 
 #define MAX_BUFFER_LEN 1024 // how big should this be?
@@ -27,14 +28,17 @@ struct accept_queue_data{
 	uint32_t remote_ip;
 	uint16_t remote_port;
 	uint32_t last_seq_received;
+	struct tcp_syn_options options; // what they offered on the SYN
 };
 
-accept_queue_data_t accept_queue_data_init(uint32_t local_ip,uint32_t remote_ip,uint16_t remote_port,uint32_t last_seq_received){
+accept_queue_data_t accept_queue_data_init(uint32_t local_ip,uint32_t remote_ip,uint16_t remote_port,uint32_t last_seq_received,
+												const struct tcp_syn_options* options){
 	 accept_queue_data_t data = (accept_queue_data_t)malloc(sizeof(struct accept_queue_data));
 	 data->local_ip = local_ip;
 	 data->remote_ip = remote_ip;
 	 data->remote_port = remote_port;
 	 data->last_seq_received = last_seq_received;
+	 data->options = *options;
 	return data;
 }
 
@@ -54,6 +58,10 @@ uint32_t accept_queue_data_get_seq(accept_queue_data_t data){
 	return data->last_seq_received;
 }
 
+const struct tcp_syn_options* accept_queue_data_get_syn_options(accept_queue_data_t data){
+	return &(data->options);
+}
+
 void accept_queue_data_destroy(accept_queue_data_t* data){
 	free(*data);
 	*data = NULL;
@@ -127,49 +135,108 @@ memchunk_t tcp_unwrap_data(void* packet, int length){
 }
 
 struct tcphdr* tcp_header_init(int data_size){
-	struct tcphdr* header = malloc(sizeof(struct tcphdr) + data_size);
-	memset(header, 0, sizeof(struct tcphdr)+data_size);
+	char* buffer = malloc(TCP_HEADROOM + sizeof(struct tcphdr) + TCP_OPTIONS_MAX_SIZE + data_size);
+	struct tcphdr* header = (struct tcphdr*)(buffer + TCP_HEADROOM);
+	memset(header, 0, sizeof(struct tcphdr) + TCP_OPTIONS_MAX_SIZE + data_size);
 	tcp_set_offset(header);
 	return header;
 }
 
-/* requires the packet with the header as 
-	well as information for the pseudo-header (see below) */
-uint16_t tcp_utils_calc_checksum(void* packet, uint16_t total_length, uint32_t src_ip, uint32_t dest_ip, uint16_t protocol){
-
-	uint32_t sum 	  = 0;
-	uint16_t odd_byte = 0;
-
-	uint16_t* pseudo_packet = (uint16_t*)malloc(total_length+12); // 12 is size in bytes of pseudo-header
-	memset(pseudo_packet, 0, total_length+12);
-	((uint32_t*)pseudo_packet)[0] = src_ip;
-	((uint32_t*)pseudo_packet)[1] = dest_ip; //why of 1 and not 2??
-	((uint8_t*)pseudo_packet) [9] = (uint8_t)TCP_DATA;
-	((uint16_t*)pseudo_packet)[5] = ntohs((uint16_t)total_length);
-	
-	memcpy(((char*)pseudo_packet)+12, packet, total_length);
+int tcp_header_add_option(struct tcphdr* header, uint8_t kind, void* value, int len){
+	int offset = tcp_offset_in_bytes(header),
+		padding = (4 - (2+len)%4) % 4;
+	if(offset + padding + 2 + len > TCP_HEADER_MIN_SIZE + TCP_OPTIONS_MAX_SIZE)
+		return -1;
+
+	uint8_t* option = ((uint8_t*)header) + offset;
+	memset(option, TCP_OPTION_NOP, padding);
+	option += padding;
+	option[0] = kind;
+	option[1] = (uint8_t)(2+len);
+	if(len)
+		memcpy(option+2, value, len);
+
+	header->th_off += (padding + 2 + len)/4;
+	return 0;
+}
 
-	int n = total_length+12;
-	uint16_t* pseudo_packet_iterator = pseudo_packet;
-	while (n>1) {
-		sum += *pseudo_packet_iterator++;
-		n -= 2;
+int tcp_header_find_option(struct tcphdr* header, int length, uint8_t kind, void** value){
+	int end = MIN(tcp_offset_in_bytes(header), length), i = TCP_HEADER_MIN_SIZE;
+	uint8_t* bytes = (uint8_t*)header;
+
+	while(i < end){
+		if(bytes[i] == TCP_OPTION_END)
+			break;
+		if(bytes[i] == TCP_OPTION_NOP){
+			i++;
+			continue;
+		}
+		// everything else has a length (that counts the kind and the length too)
+		if(i+1 >= end || bytes[i+1] < 2 || i + bytes[i+1] > end)
+			break;
+		if(bytes[i] == kind){
+			*value = bytes+i+2;
+			return bytes[i+1]-2;
+		}
+		i += bytes[i+1];
 	}
+	return -1;
+}
 
-	if (n==1) {
-		*(uint8_t*)(&odd_byte) = *(uint8_t*)pseudo_packet_iterator;
-		sum += odd_byte;
+void tcp_utils_get_syn_options(struct tcphdr* header, int length, struct tcp_syn_options* options){
+	void* value;
+	memset(options, 0, sizeof(struct tcp_syn_options));
+	options->sack_permitted = (tcp_header_find_option(header, length, TCP_OPTION_SACK_PERMITTED, &value) == 0);
+	options->window_scale = -1;
+	if(tcp_header_find_option(header, length, TCP_OPTION_WSCALE, &value) == 1)
+		// (RFC 7323: anything over 14 is taken as 14)
+		options->window_scale = MIN(*(uint8_t*)value, TCP_WINDOW_SCALE_MAX);
+	if(tcp_header_find_option(header, length, TCP_OPTION_MSS, &value) == 2){
+		uint16_t mss;
+		memcpy(&mss, value, 2);
+		options->mss = ntohs(mss);
 	}
+}
+
+void tcp_header_destroy(struct tcphdr* header){
+	free(((char*)header) - TCP_HEADROOM);
+}
+
+tcp_packet_data_t tcp_utils_outgoing_packet(struct tcphdr* header, int header_len, char* payload, int payload_len, 
+												char* payload_buffer, mirror_buffer_t payload_ring, uint32_t local_ip, uint32_t remote_ip){
+	tcp_packet_data_t packet_data = tcp_packet_data_init((char*)header, header_len, local_ip, remote_ip);
+	packet_data->headroom = TCP_HEADROOM;
+	packet_data->payload = payload;
+	packet_data->payload_size = payload_len;
+	packet_data->payload_buffer = payload_buffer;
+	packet_data->payload_ring = payload_ring;
+	return packet_data;
+}
+
+/* requires the header and data as well as information for the pseudo-header (see below) 
+	the header has to be an even length (they always are) so that data's words line up */
+uint16_t tcp_utils_calc_checksum_sg(void* header, int header_len, void* data, int data_len, uint32_t src_ip, uint32_t dest_ip, uint16_t protocol){
 
-	// free it 
-	free(pseudo_packet);
+	/* the pseudo-header: src, dest, zero, protocol, tcp length -- summed without ever being put together */
+	uint32_t sum = ip_sum_pseudo_header(src_ip, dest_ip, (uint8_t)TCP_DATA, (uint16_t)(header_len + data_len), 0);
 
-	sum = (sum >> 16) + (sum & 0xffff);
-	sum += (sum >> 16);
-	uint16_t result;
-	result = ~sum;
+	sum = ip_sum_partial(header, header_len, sum);
+	if(data && data_len)
+		sum = ip_sum_partial(data, data_len, sum);
 
-	return result;
+	return ip_sum_fold(sum);
+}
+
+/* requires the packet with the header as 
+	well as information for the pseudo-header (see below) */
+uint16_t tcp_utils_calc_checksum(void* packet, uint16_t total_length, uint32_t src_ip, uint32_t dest_ip, uint16_t protocol){
+	return tcp_utils_calc_checksum_sg(packet, total_length, NULL, 0, src_ip, dest_ip, protocol);
+}
+
+/* calculates the checksum and adds it to the tcphdr, data goes right after the header */
+void tcp_utils_add_checksum_sg(void* header, int header_len, void* data, int data_len, uint32_t src_ip, uint32_t dest_ip, uint16_t protocol){
+	tcp_set_checksum(header, 0);
+	tcp_set_checksum(header, tcp_utils_calc_checksum_sg(header, header_len, data, data_len, src_ip, dest_ip, protocol));
 }
 
 /* calculates the checksum and adds it to the tcphdr */
@@ -198,28 +265,10 @@ returns
 */
 int tcp_utils_validate_checksum(void* packet, uint16_t total_length, uint32_t src_ip, uint32_t dest_ip, uint16_t protocol){
 	
-	//return 1; // was segfaulting so ALEX commented out until NEIL fixes
-	
-	/* store the original checksum */
-	u_int16_t their_checksum = tcp_checksum(packet);
-	
-	/* zero out the checksum to calculate it */
-	tcp_set_checksum(packet, 0);
-
-	/* get the actual checksum */
-	uint16_t our_checksum = tcp_utils_calc_checksum(packet, total_length, src_ip, dest_ip, protocol);
-	
-	//print(("their_sum: %u\n", their_checksum), CHECKSUM_PRINT);
-	//print(("our_sum: %u\n", our_checksum), CHECKSUM_PRINT);
-
-
-/* !!!!!!!!!!!!!!!LADFJSLADJSFLASDFJDKLSFJ ASDLFKJAS DLFKA */
-	/* XOR the actual checksum and the given checksum, 
-	   if it's not 0, then they're not the same */
-	if(their_checksum ^ our_checksum){
-		tcp_set_checksum(packet, their_checksum);
+	/* summed with their checksum left in, it comes out to 0 if it's right -- 
+		so there's no need to take it out and put it back */
+	if(tcp_utils_calc_checksum(packet, total_length, src_ip, dest_ip, protocol))
 		return -1; 
-	}
 	else
 		return 1;
 }
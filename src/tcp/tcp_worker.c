@@ -0,0 +1,87 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "tcp_worker.h"
+#include "tcp_connection.h"
+
+struct tcp_worker{
+	pthread_t thread;
+	ring_queue_t run_queue; // connections that have something to do (anybody can schedule one)
+};
+
+struct tcp_worker_pool{
+	int num_workers;
+	struct tcp_worker* workers;
+};
+
+/* the event loop: run whichever connection is next on the run queue, and if it used up its
+	turn without getting through everything it had to do, put it back on the end */
+static void* _worker_run(void* arg){
+	tcp_worker_t worker = (tcp_worker_t)arg;
+	tcp_connection_t connection;
+
+	while(!ring_queue_timed_dequeue_abs(worker->run_queue, (void**)&connection, NULL)){
+		if(tcp_connection_run(connection))
+			tcp_connection_schedule(connection);
+	}
+	pthread_exit(NULL);
+}
+
+tcp_worker_pool_t tcp_worker_pool_init(int num_workers, int max_connections){
+	tcp_worker_pool_t pool = (tcp_worker_pool_t)malloc(sizeof(struct tcp_worker_pool));
+	pool->workers = (struct tcp_worker*)malloc(sizeof(struct tcp_worker)*num_workers);
+	pool->num_workers = 0;
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+	int i, status;
+	for(i=0;i<num_workers;i++){
+		pool->workers[i].run_queue = ring_queue_init(max_connections, RING_QUEUE_MPSC);
+		status = pthread_create(&(pool->workers[i].thread), &attr, _worker_run, (void*)&(pool->workers[i]));
+		if(status){
+			printf("ERROR; return code from pthread_create() for tcp_worker %d is %d\n", i, status);
+			ring_queue_destroy(&(pool->workers[i].run_queue));
+			break;
+		}
+		pool->num_workers++;
+	}
+	pthread_attr_destroy(&attr);
+
+	if(!pool->num_workers){
+		free(pool->workers);
+		free(pool);
+		return NULL;
+	}
+	return pool;
+}
+
+void tcp_worker_pool_destroy(tcp_worker_pool_t* pool){
+	int i;
+	for(i=0;i<(*pool)->num_workers;i++)
+		ring_queue_stop((*pool)->workers[i].run_queue);
+	for(i=0;i<(*pool)->num_workers;i++){
+		pthread_join((*pool)->workers[i].thread, NULL);
+		ring_queue_destroy(&((*pool)->workers[i].run_queue));
+	}
+	free((*pool)->workers);
+	free(*pool);
+	*pool = NULL;
+}
+
+tcp_worker_t tcp_worker_pool_get(tcp_worker_pool_t pool, unsigned int hash){
+	return &(pool->workers[hash % pool->num_workers]);
+}
+
+int tcp_worker_schedule(tcp_worker_t worker, struct tcp_connection* connection){
+	int ret;
+	/* can't actually be full (a connection is never on here twice), but just in case,
+		wait for the worker to make some room rather than losing the connection */
+	while((ret = ring_queue_enqueue(worker->run_queue, connection)) == -EAGAIN)
+		sched_yield();
+	return ret ? -1 : 0;
+}
@@ -1,30 +1,172 @@
+#include <string.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+
 #include "ipsum.h"
 
-/************************************************************
- Checksum for Internet Protocol family headers (C Version)
- From ping examples in W.Richard Stevens "UNIX NETWORK PROGRAMMING" book.
-************************************************************/
-#include <inttypes.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IPSUM_X86
+#include <immintrin.h>
+#endif
+
+/* every kernel adds up the 32-bit words of buffer (as many as there are -- len is a multiple of 4) into 
+   a 64-bit sum.  that's the same as adding up the 16-bit words, once it's folded, since 2^16 = 1 in 
+   one's complement arithmetic */
+typedef uint64_t (*sum_kernel_f)(const unsigned char* buffer, int len, uint64_t sum);
+
+static uint64_t _sum_words(const unsigned char* buffer, int len, uint64_t sum){
+	uint64_t word;
+	// (two 32-bit words at a time, so this is the wide scalar path too)
+	while(len >= 8){
+		memcpy(&word, buffer, 8);
+		sum += (word & 0xffffffff) + (word >> 32);
+		buffer += 8;
+		len -= 8;
+	}
+	if(len >= 4){
+		uint32_t half;
+		memcpy(&half, buffer, 4);
+		sum += half;
+	}
+	return sum;
+}
+
+#ifdef IPSUM_X86
+/* (inlined into _sum_avx2 for what's left over there, so that gets done with AVX encodings -- 
+   going back and forth between those and plain SSE ones is slow) */
+__attribute__((target("sse2"), always_inline))
+static inline uint64_t _sum_sse2(const unsigned char* buffer, int len, uint64_t sum){
+	__m128i zero = _mm_setzero_si128(), acc = _mm_setzero_si128(), v;
+	uint64_t lanes[2];
+
+	// each 32-bit word goes into a 64-bit lane of its own, so nothing can overflow
+	while(len >= 16){
+		v = _mm_loadu_si128((const __m128i*)buffer);
+		acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, zero));
+		acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(v, zero));
+		buffer += 16;
+		len -= 16;
+	}
+	_mm_storeu_si128((__m128i*)lanes, acc);
+	return _sum_words(buffer, len, sum + lanes[0] + lanes[1]);
+}
+
+__attribute__((target("avx2")))
+static uint64_t _sum_avx2(const unsigned char* buffer, int len, uint64_t sum){
+	__m256i zero = _mm256_setzero_si256(), acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256(), v, w;
+	uint64_t lanes[4];
+
+	// two accumulators, to keep two adds going at once
+	while(len >= 64){
+		v = _mm256_loadu_si256((const __m256i*)buffer);
+		w = _mm256_loadu_si256((const __m256i*)(buffer + 32));
+		acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v, zero));
+		acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v, zero));
+		acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(w, zero));
+		acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(w, zero));
+		buffer += 64;
+		len -= 64;
+	}
+	_mm256_storeu_si256((__m256i*)lanes, _mm256_add_epi64(acc0, acc1));
+	return _sum_sse2(buffer, len, sum + lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+}
+#endif
+
+static sum_kernel_f _sum_kernel = NULL;
+
+// the kernel for IP_SUM_KERNEL_*, NULL if the CPU can't do it
+static sum_kernel_f _find_kernel(int kernel){
+#ifdef IPSUM_X86
+	__builtin_cpu_init();
+#endif
+	switch(kernel){
+		case IP_SUM_KERNEL_WORDS:
+			return _sum_words;
+#ifdef IPSUM_X86
+		case IP_SUM_KERNEL_SSE2:
+			return __builtin_cpu_supports("sse2") ? _sum_sse2 : NULL;
+		case IP_SUM_KERNEL_AVX2:
+			return __builtin_cpu_supports("avx2") ? _sum_avx2 : NULL;
+#endif
+	}
+	return NULL;
+}
+
+static sum_kernel_f _pick_kernel(){
+	sum_kernel_f kernel;
+	if((kernel = _find_kernel(IP_SUM_KERNEL_AVX2)) || (kernel = _find_kernel(IP_SUM_KERNEL_SSE2)))
+		return kernel;
+	return _sum_words;
+}
+
+int ip_sum_set_kernel(int kernel){
+	sum_kernel_f f = (kernel == IP_SUM_KERNEL_BEST) ? _pick_kernel() : _find_kernel(kernel);
+	if(!f)
+		return -1;
+	_sum_kernel = f;
+	return 0;
+}
+
+// folds a 64-bit sum down to 32 bits (still a partial sum)
+static uint32_t _fold64(uint64_t sum){
+	sum = (sum >> 32) + (sum & 0xffffffff);
+	sum = (sum >> 32) + (sum & 0xffffffff);
+	return (uint32_t)sum;
+}
+
+uint32_t ip_sum_partial(const void* buffer, int len, uint32_t sum){
+	const unsigned char* p = (const unsigned char*)buffer;
+	uint64_t total = sum;
+	uint16_t last = 0;
+
+	// (it doesn't matter if two threads both pick the first time around)
+	if(!_sum_kernel)
+		_sum_kernel = _pick_kernel();
+
+	if(len >= 4)
+		total = _sum_kernel(p, len & ~3, total);
+	p += len & ~3;
+	len &= 3;
+
+	/* mop up the last few bytes, if necessary -- an odd byte goes in as the first byte of a word */
+	if(len >= 2){
+		memcpy(&last, p, 2);
+		total += last;
+		p += 2;
+		len -= 2;
+	}
+	if(len){
+		last = 0;
+		*(uint8_t*)(&last) = *p;
+		total += last;
+	}
+	return _fold64(total);
+}
+
+uint32_t ip_sum_pseudo_header(uint32_t src, uint32_t dst, uint8_t protocol, uint16_t length, uint32_t sum){
+	uint64_t total = sum;
+	total += src;
+	total += dst;
+	total += htons(protocol); // (a zero byte and then the protocol)
+	total += htons(length);
+	return _fold64(total);
+}
+
+uint16_t ip_sum_fold(uint32_t sum){
+	sum = (sum >> 16) + (sum & 0xffff); /* add hi 16 to low 16 */
+	sum += (sum >> 16);           /* add carry */
+	return (uint16_t)~sum;        /* ones-complement, truncate*/
+}
 
 int ip_sum(char* packet, int n) {
-  uint16_t *p = (uint16_t*)packet;
-  uint16_t answer;
-  long sum = 0;
-  uint16_t odd_byte = 0;
-
-  while (n > 1) {
-    sum += *p++;
-    n -= 2;
-  }
-
-  /* mop up an odd byte, if necessary */
-  if (n == 1) {
-    *(uint8_t*)(&odd_byte) = *(uint8_t*)p;
-    sum += odd_byte;
-  }
-
-  sum = (sum >> 16) + (sum & 0xffff); /* add hi 16 to low 16 */
-  sum += (sum >> 16);           /* add carry */
-  answer = ~sum;                /* ones-complement, truncate*/
-  return answer;
+	return ip_sum_fold(ip_sum_partial(packet, n, 0));
+}
+
+/* HC' = ~(~HC + ~m + m') (eqn. 3) -- unlike HC' = HC - ~m - m' (eqn. 2), it can't turn a sum 
+   that should be 0xffff into 0 */
+uint16_t ip_sum_update(uint16_t sum, uint16_t old_word, uint16_t new_word) {
+  uint32_t s = (uint16_t)~sum + (uint16_t)~old_word + new_word;
+  s = (s >> 16) + (s & 0xffff);
+  s += (s >> 16);
+  return ~s;
 }
@@ -113,7 +113,10 @@ void plain_list_destroy_total(plain_list_t* list, destructor_f destroy){
 void plain_list_insert_before(plain_list_t list, plain_list_el_t el, void* data){
 	pthread_mutex_lock(&(list->lock));
 	if(el->prev==NULL){
+		// (append takes the lock itself)
+		pthread_mutex_unlock(&(list->lock));
 		plain_list_append(list, data);
+		return;
 	}
 	else{
 		plain_list_el_t new_el = malloc(sizeof(struct plain_list_el));
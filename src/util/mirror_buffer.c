@@ -0,0 +1,122 @@
+#define _GNU_SOURCE // memfd_create
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "mirror_buffer.h"
+#include "utils.h"
+
+struct mirror_buffer{
+	char* data; // capacity bytes, then the same capacity bytes again
+	size_t capacity;
+	size_t read; // where the oldest byte is (always < capacity)
+	size_t size;
+	int mirrored; // 0 if data's just a malloc()ed 2*capacity, so push has to write the second copy itself
+	int refcount;
+};
+
+static size_t _round_to_pages(size_t size){
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	if(size == 0)
+		size = 1;
+	return (size + page - 1) & ~(page - 1);
+}
+
+/* maps the same capacity bytes of memory twice in a row -- NULL if we can't */
+static char* _map_mirrored(size_t capacity){
+#ifdef __linux__
+	int fd = memfd_create("mirror_buffer", 0);
+	if(fd < 0)
+		return NULL;
+	if(ftruncate(fd, capacity) < 0){
+		close(fd);
+		return NULL;
+	}
+
+	// reserve room for both, then put the memory in each half
+	char* region = mmap(NULL, 2*capacity, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if(region == MAP_FAILED){
+		close(fd);
+		return NULL;
+	}
+	if(mmap(region, capacity, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, fd, 0) == MAP_FAILED
+		|| mmap(region + capacity, capacity, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, fd, 0) == MAP_FAILED){
+		munmap(region, 2*capacity);
+		close(fd);
+		return NULL;
+	}
+	// the mappings hang onto the memory
+	close(fd);
+	return region;
+#else
+	return NULL;
+#endif
+}
+
+mirror_buffer_t mirror_buffer_init(int capacity){
+	mirror_buffer_t mb = malloc(sizeof(struct mirror_buffer));
+	mb->capacity = _round_to_pages(capacity);
+	mb->data = _map_mirrored(mb->capacity);
+	mb->mirrored = (mb->data != NULL);
+	if(!mb->mirrored)
+		mb->data = malloc(2*mb->capacity);
+	mb->read = mb->size = 0;
+	mb->refcount = 1;
+	return mb;
+}
+
+void mirror_buffer_destroy(mirror_buffer_t* mb){
+	mirror_buffer_release(*mb);
+	*mb = NULL;
+}
+
+void mirror_buffer_ref(mirror_buffer_t mb){
+	__sync_fetch_and_add(&(mb->refcount), 1);
+}
+
+void mirror_buffer_release(mirror_buffer_t mb){
+	if(__sync_sub_and_fetch(&(mb->refcount), 1) > 0)
+		return;
+	if(mb->mirrored)
+		munmap(mb->data, 2*mb->capacity);
+	else
+		free(mb->data);
+	free(mb);
+}
+
+int mirror_buffer_push(mirror_buffer_t mb, const void* data, int length){
+	length = MIN((size_t)MAX(length, 0), mb->capacity - mb->size);
+	if(length == 0)
+		return 0;
+
+	size_t write = (mb->read + mb->size) % mb->capacity;
+	memcpy(mb->data + write, data, length);
+	if(!mb->mirrored){
+		// the same bytes at the other copy of each position they landed in
+		size_t first = MIN((size_t)length, mb->capacity - write);
+		memcpy(mb->data + mb->capacity + write, data, first);
+		memcpy(mb->data, (const char*)data + first, length - first);
+	}
+	mb->size += length;
+	return length;
+}
+
+char* mirror_buffer_data(mirror_buffer_t mb){
+	return mb->data + mb->read;
+}
+
+void mirror_buffer_consume(mirror_buffer_t mb, int length){
+	length = MIN((size_t)MAX(length, 0), mb->size);
+	mb->read = (mb->read + length) % mb->capacity;
+	mb->size -= length;
+}
+
+int mirror_buffer_size(mirror_buffer_t mb){
+	return (int)mb->size;
+}
+
+int mirror_buffer_capacity(mirror_buffer_t mb){
+	return (int)mb->capacity;
+}
@@ -0,0 +1,157 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "packet_pool.h"
+#include "utils.h"
+
+#define HUGEPAGE_SIZE (2*1024*1024)
+// keeps the data that follows each slot header nicely aligned
+#define SLOT_ALIGN 64
+
+/* Every buffer handed out is preceded by one of these */
+struct packet_slot{
+	packet_pool_t pool;
+	struct packet_slot* next; // for the free lists
+	int refcount;
+	int from_heap;            // 1 if the pool was empty and we had to malloc it
+};
+
+struct packet_pool{
+	char* region;
+	size_t region_size;
+	int num_slots;
+	int slot_size;
+	int stride;               // slot header + data, rounded up to SLOT_ALIGN
+
+	pthread_t owner;
+	int owned;
+
+	struct packet_slot* free_slots;            // only touched by the owner
+	struct packet_slot* volatile returned_slots; // pushed onto by everyone else
+};
+
+#define HEADER_SIZE ((sizeof(struct packet_slot) + SLOT_ALIGN - 1) & ~(SLOT_ALIGN - 1))
+#define SLOT_DATA(slot) ((char*)(slot) + HEADER_SIZE)
+#define DATA_SLOT(buffer) ((struct packet_slot*)((char*)(buffer) - HEADER_SIZE))
+
+packet_pool_t packet_pool_init(int num_slots, int slot_size, int use_hugepages){
+	packet_pool_t pool = malloc(sizeof(struct packet_pool));
+	pool->num_slots = num_slots;
+	pool->slot_size = slot_size;
+	pool->stride = (HEADER_SIZE + slot_size + SLOT_ALIGN - 1) & ~(SLOT_ALIGN - 1);
+	pool->region_size = (size_t)pool->stride*num_slots;
+	pool->owned = 0;
+	pool->free_slots = NULL;
+	pool->returned_slots = NULL;
+
+	pool->region = MAP_FAILED;
+	if(use_hugepages){
+		pool->region_size = (pool->region_size + HUGEPAGE_SIZE - 1) & ~((size_t)HUGEPAGE_SIZE - 1);
+		pool->region = mmap(NULL, pool->region_size, PROT_READ|PROT_WRITE, 
+								MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+		if(pool->region == MAP_FAILED)
+			puts("packet_pool_init: no hugepages available, using normal pages");
+	}
+	if(pool->region == MAP_FAILED){
+		pool->region = mmap(NULL, pool->region_size, PROT_READ|PROT_WRITE, 
+								MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if(pool->region == MAP_FAILED){
+			perror("packet_pool_init: mmap");
+			// everything will just come from the heap
+			pool->region = NULL;
+			pool->num_slots = 0;
+		}
+	}
+
+	/* thread all of the slots onto the free list */
+	int i;
+	struct packet_slot* slot;
+	for(i=pool->num_slots-1;i>=0;i--){
+		slot = (struct packet_slot*)(pool->region + (size_t)i*pool->stride);
+		slot->pool = pool;
+		slot->refcount = 0;
+		slot->from_heap = 0;
+		slot->next = pool->free_slots;
+		pool->free_slots = slot;
+	}
+
+	return pool;
+}
+
+/* Any buffers still out there are no longer valid after this */
+void packet_pool_destroy(packet_pool_t* pool){
+	if((*pool)->region)
+		munmap((*pool)->region, (*pool)->region_size);
+	free(*pool);
+	*pool = NULL;
+}
+
+char* packet_pool_alloc(packet_pool_t pool){
+	if(!pool->owned){
+		pool->owner = pthread_self();
+		pool->owned = 1;
+	}
+
+	/* out of local slots, so take back everything the other threads have released */
+	if(!pool->free_slots)
+		pool->free_slots = __sync_lock_test_and_set(&pool->returned_slots, NULL);
+
+	struct packet_slot* slot = pool->free_slots;
+	if(slot){
+		pool->free_slots = slot->next;
+	}
+	else{
+		print(("packet_pool_alloc: pool empty, going to the heap"), LEAK_PRINT);
+		slot = malloc(HEADER_SIZE + pool->slot_size);
+		slot->pool = pool;
+		slot->from_heap = 1;
+	}
+	slot->next = NULL;
+	slot->refcount = 1;
+	return SLOT_DATA(slot);
+}
+
+char* packet_pool_alloc_unpooled(int size){
+	struct packet_slot* slot = malloc(HEADER_SIZE + size);
+	slot->pool = NULL;
+	slot->from_heap = 1;
+	slot->next = NULL;
+	slot->refcount = 1;
+	return SLOT_DATA(slot);
+}
+
+void packet_pool_ref(char* buffer){
+	__sync_fetch_and_add(&(DATA_SLOT(buffer)->refcount), 1);
+}
+
+void packet_pool_release(char* buffer){
+	struct packet_slot* slot = DATA_SLOT(buffer);
+	if(__sync_sub_and_fetch(&(slot->refcount), 1) > 0)
+		return;
+
+	if(slot->from_heap){
+		free(slot);
+		return;
+	}
+
+	packet_pool_t pool = slot->pool;
+	if(pool->owned && pthread_equal(pool->owner, pthread_self())){
+		slot->next = pool->free_slots;
+		pool->free_slots = slot;
+	}
+	else{
+		/* push it onto the return stack -- only ever pushed onto, and the owner swaps 
+		   out the whole thing at once, so there's no ABA to worry about */
+		struct packet_slot* head;
+		do{
+			head = pool->returned_slots;
+			slot->next = head;
+		} while(!__sync_bool_compare_and_swap(&pool->returned_slots, head, slot));
+	}
+}
+
+int packet_pool_slot_size(packet_pool_t pool){
+	return pool->slot_size;
+}
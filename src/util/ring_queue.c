@@ -0,0 +1,199 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/eventfd.h>
+
+#include "ring_queue.h"
+
+#define CACHE_LINE 64
+
+struct ring_slot{
+	unsigned long seq; // == position when free for the producer at position, == position+1 when full
+	void* data;
+};
+
+struct ring_queue{
+	struct ring_slot* slots;
+	unsigned long index_mask; // capacity-1 (capacity is a power of 2)
+	int producers;
+	int event_fd;
+
+	/* the producers and the consumer each get their own cache line so they aren't fighting over it */
+	unsigned long head __attribute__((aligned(CACHE_LINE))); // next position to enqueue at
+	unsigned long tail __attribute__((aligned(CACHE_LINE))); // next position to dequeue from (consumer only)
+	int waiting; // consumer is (about to be) asleep on event_fd
+	int stopped;
+};
+
+ring_queue_t ring_queue_init(int capacity, int producers){
+	unsigned long size = 1, i;
+	while(size < (unsigned long)capacity)
+		size <<= 1;
+
+	ring_queue_t q;
+	if(posix_memalign((void**)&q, CACHE_LINE, sizeof(struct ring_queue)))
+		return NULL;
+
+	q->slots = (struct ring_slot*)malloc(sizeof(struct ring_slot)*size);
+	for(i=0;i<size;i++)
+		q->slots[i].seq = i;
+	q->index_mask = size-1;
+	q->producers = producers;
+	q->head = q->tail = 0;
+	q->waiting = q->stopped = 0;
+
+	q->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(q->event_fd < 0){
+		perror("eventfd");
+		free(q->slots);
+		free(q);
+		return NULL;
+	}
+
+	return q;
+}
+
+void ring_queue_destroy(ring_queue_t* q){
+	if(!(*q)) return;
+
+	close((*q)->event_fd);
+	free((*q)->slots);
+	free(*q);
+	*q = NULL;
+}
+
+static void _wake(ring_queue_t q){
+	uint64_t one = 1;
+	if(write(q->event_fd, &one, sizeof(uint64_t)) < 0 && errno != EAGAIN)
+		perror("ring_queue write eventfd");
+}
+
+void ring_queue_stop(ring_queue_t q){
+	__atomic_store_n(&q->stopped, 1, __ATOMIC_SEQ_CST);
+	_wake(q);
+}
+
+int ring_queue_enqueue(ring_queue_t q, void* data){
+	struct ring_slot* slot;
+	unsigned long pos, seq;
+	long diff;
+
+	if(__atomic_load_n(&q->stopped, __ATOMIC_RELAXED))
+		return -EINVAL;
+
+	pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+	while(1){
+		slot = &q->slots[pos & q->index_mask];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		diff = (long)seq - (long)pos;
+
+		if(diff == 0){
+			/* it's free -- claim it */
+			if(q->producers == RING_QUEUE_SPSC){
+				__atomic_store_n(&q->head, pos+1, __ATOMIC_RELAXED);
+				break;
+			}
+			if(__atomic_compare_exchange_n(&q->head, &pos, pos+1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+			/* somebody beat us to it, and pos now holds wherever they left head */
+		}
+		else if(diff < 0){
+			/* the consumer hasn't gotten to this one yet since we last went around, so we're full */
+			return -EAGAIN;
+		}
+		else
+			pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+	}
+
+	slot->data = data;
+	__atomic_store_n(&slot->seq, pos+1, __ATOMIC_RELEASE);
+
+	/* only go into the kernel if the consumer is (or is about to be) asleep -- the fence
+		pairs with the one in ring_queue_timed_dequeue_abs so that one of us always sees the other */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&q->waiting, __ATOMIC_RELAXED))
+		_wake(q);
+
+	return 0;
+}
+
+int ring_queue_trydequeue(ring_queue_t q, void** data){
+	unsigned long pos = q->tail;
+	struct ring_slot* slot = &q->slots[pos & q->index_mask];
+	unsigned long seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+	if((long)seq - (long)(pos+1) < 0)
+		return 1;
+
+	*data = slot->data;
+	/* hand the slot back to the producers for when they come around again */
+	__atomic_store_n(&slot->seq, pos + q->index_mask + 1, __ATOMIC_RELEASE);
+	q->tail = pos+1;
+	return 0;
+}
+
+int ring_queue_empty(ring_queue_t q){
+	unsigned long pos = q->tail;
+	return (long)__atomic_load_n(&q->slots[pos & q->index_mask].seq, __ATOMIC_ACQUIRE) - (long)(pos+1) < 0;
+}
+
+int ring_queue_timed_dequeue_abs(ring_queue_t q, void** data, const struct timespec* abs_ts){
+	struct pollfd pfd = { .fd = q->event_fd, .events = POLLIN };
+	struct timespec remaining;
+	struct timeval now;
+	uint64_t count;
+	int ret;
+
+	while(1){
+		if(__atomic_load_n(&q->stopped, __ATOMIC_RELAXED))
+			return -EINVAL;
+		if(!ring_queue_trydequeue(q, data))
+			return 0;
+
+		/* tell the producers we're going to sleep, then check one last time in case
+			something came in before they could have seen it */
+		__atomic_store_n(&q->waiting, 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if(!ring_queue_trydequeue(q, data)){
+			__atomic_store_n(&q->waiting, 0, __ATOMIC_RELAXED);
+			return 0;
+		}
+
+		if(abs_ts){
+			gettimeofday(&now, NULL);
+			remaining.tv_sec = abs_ts->tv_sec - now.tv_sec;
+			remaining.tv_nsec = abs_ts->tv_nsec - now.tv_usec*1000;
+			if(remaining.tv_nsec < 0){
+				remaining.tv_nsec += 1000000000;
+				remaining.tv_sec--;
+			}
+			if(remaining.tv_sec < 0){
+				__atomic_store_n(&q->waiting, 0, __ATOMIC_RELAXED);
+				return -ETIMEDOUT;
+			}
+		}
+
+		ret = ppoll(&pfd, 1, abs_ts ? &remaining : NULL, NULL);
+		__atomic_store_n(&q->waiting, 0, __ATOMIC_RELAXED);
+
+		if(ret > 0){
+			/* reset the eventfd counter */
+			if(read(q->event_fd, &count, sizeof(uint64_t)) < 0 && errno != EAGAIN)
+				perror("ring_queue read eventfd");
+		}
+		else if(ret == 0){
+			/* one last look before giving up */
+			if(!ring_queue_trydequeue(q, data))
+				return 0;
+			return -ETIMEDOUT;
+		}
+		else if(errno != EINTR){
+			perror("ppoll");
+			return -EINVAL;
+		}
+	}
+}
@@ -0,0 +1,294 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/timerfd.h>
+
+#include "timer_wheel.h"
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS-1)
+#define NEVER UINT64_MAX
+
+struct wheel_timer{
+	struct wheel_timer* prev;
+	struct wheel_timer* next;
+	uint64_t expires; // tick it goes off at
+	int level, slot;
+	int armed;
+
+	wheel_timer_f callback;
+	void* arg;
+	timer_wheel_t wheel;
+};
+
+struct timer_wheel{
+	wheel_timer_t slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+	uint64_t occupied[TIMER_WHEEL_LEVELS]; // bit i set iff slots[level][i] isn't empty
+	uint64_t now_tick; // every tick before this one has been handled
+
+	struct timespec base; // time of tick 0
+	int timer_fd;
+	uint64_t programmed; // tick timer_fd is set to go off at
+
+	wheel_timer_t running; // timer whose callback is being run right now
+	pthread_t runner;
+	pthread_cond_t done_running;
+	pthread_mutex_t mutex;
+};
+
+static uint64_t _current_tick(timer_wheel_t wheel){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	uint64_t ms = (now.tv_sec - wheel->base.tv_sec)*1000 + (now.tv_nsec - wheel->base.tv_nsec)/1000000;
+	return ms/TIMER_WHEEL_TICK_MS;
+}
+
+/* number of slots from index up to (and including) the next occupied one, looking past index itself
+	if skip_current is set.  bits can't be 0 */
+static int _slots_to_next(uint64_t bits, int index, int skip_current){
+	int start = (index + skip_current) & SLOT_MASK;
+	uint64_t rotated = start ? (bits >> start) | (bits << (TIMER_WHEEL_SLOTS - start)) : bits;
+	return __builtin_ctzll(rotated) + skip_current;
+}
+
+/********************** TIMER LISTS **********************/
+
+static void _link(timer_wheel_t wheel, wheel_timer_t timer){
+	uint64_t delta = timer->expires > wheel->now_tick ? timer->expires - wheel->now_tick : 0;
+	int level;
+
+	if(timer->expires < wheel->now_tick)
+		timer->expires = wheel->now_tick;
+
+	/* the first wheel that spans far enough out */
+	for(level=0;level<TIMER_WHEEL_LEVELS-1;level++)
+		if(delta < (1ULL << (TIMER_WHEEL_SLOT_BITS*(level+1))))
+			break;
+	/* past the end of the last wheel -- as far out as we can go will have to do */
+	if(delta >= (1ULL << (TIMER_WHEEL_SLOT_BITS*TIMER_WHEEL_LEVELS)))
+		timer->expires = wheel->now_tick + (1ULL << (TIMER_WHEEL_SLOT_BITS*TIMER_WHEEL_LEVELS)) - 1;
+
+	timer->level = level;
+	timer->slot = (timer->expires >> (TIMER_WHEEL_SLOT_BITS*level)) & SLOT_MASK;
+
+	wheel_timer_t* head = &(wheel->slots[level][timer->slot]);
+	timer->prev = NULL;
+	timer->next = *head;
+	if(*head)
+		(*head)->prev = timer;
+	*head = timer;
+	wheel->occupied[level] |= (1ULL << timer->slot);
+	timer->armed = 1;
+}
+
+static void _unlink(timer_wheel_t wheel, wheel_timer_t timer){
+	if(timer->prev)
+		timer->prev->next = timer->next;
+	else
+		wheel->slots[timer->level][timer->slot] = timer->next;
+	if(timer->next)
+		timer->next->prev = timer->prev;
+
+	if(!wheel->slots[timer->level][timer->slot])
+		wheel->occupied[timer->level] &= ~(1ULL << timer->slot);
+
+	timer->prev = timer->next = NULL;
+	timer->armed = 0;
+}
+
+/********************** DRIVING THE WHEEL **********************/
+
+/* the tick at which something next needs doing -- either a timer on the first wheel going off,
+	or a slot on one of the others getting cascaded down */
+static uint64_t _next_due(timer_wheel_t wheel){
+	uint64_t due = NEVER, at;
+	int level, shift, index;
+
+	if(wheel->occupied[0])
+		due = wheel->now_tick + _slots_to_next(wheel->occupied[0], wheel->now_tick & SLOT_MASK, 0);
+
+	for(level=1;level<TIMER_WHEEL_LEVELS;level++){
+		if(!wheel->occupied[level])
+			continue;
+		shift = TIMER_WHEEL_SLOT_BITS*level;
+		index = (wheel->now_tick >> shift) & SLOT_MASK;
+		/* the current slot on this wheel has already been cascaded, so anything in it is a whole turn out */
+		at = ((wheel->now_tick >> shift) + _slots_to_next(wheel->occupied[level], index, 1)) << shift;
+		if(at < due)
+			due = at;
+	}
+	return due;
+}
+
+static void _program(timer_wheel_t wheel){
+	uint64_t due = _next_due(wheel);
+	if(due == wheel->programmed)
+		return;
+	wheel->programmed = due;
+
+	struct itimerspec its;
+	memset(&its, 0, sizeof(struct itimerspec));
+	if(due != NEVER){
+		uint64_t ms = due*TIMER_WHEEL_TICK_MS;
+		its.it_value.tv_sec = wheel->base.tv_sec + ms/1000;
+		its.it_value.tv_nsec = wheel->base.tv_nsec + (ms%1000)*1000000;
+		if(its.it_value.tv_nsec >= 1000000000){
+			its.it_value.tv_nsec -= 1000000000;
+			its.it_value.tv_sec++;
+		}
+	}
+	if(timerfd_settime(wheel->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+		perror("timerfd_settime");
+}
+
+/* move everything in slots[level][slot] down to wherever it belongs now */
+static void _cascade(timer_wheel_t wheel, int level, int slot){
+	wheel_timer_t timer;
+	while((timer = wheel->slots[level][slot])){
+		_unlink(wheel, timer);
+		_link(wheel, timer);
+	}
+}
+
+/* runs every timer due at now_tick -- drops the lock while running each callback */
+static void _fire(timer_wheel_t wheel){
+	int slot = wheel->now_tick & SLOT_MASK;
+	wheel_timer_t timer;
+
+	while((timer = wheel->slots[0][slot])){
+		_unlink(wheel, timer);
+
+		wheel->running = timer;
+		wheel->runner = pthread_self();
+		pthread_mutex_unlock(&(wheel->mutex));
+
+		timer->callback(timer->arg);
+
+		pthread_mutex_lock(&(wheel->mutex));
+		wheel->running = NULL;
+		pthread_cond_broadcast(&(wheel->done_running));
+	}
+}
+
+static void _advance(timer_wheel_t wheel, uint64_t target){
+	int level, shift;
+	uint64_t next_turn;
+
+	while(wheel->now_tick <= target){
+		/* at the start of a turn of the first wheel, bring down the next slot from the wheel above
+			(and from the one above that if that wheel's starting a turn too...) */
+		if(!(wheel->now_tick & SLOT_MASK)){
+			for(level=1;level<TIMER_WHEEL_LEVELS;level++){
+				shift = TIMER_WHEEL_SLOT_BITS*level;
+				_cascade(wheel, level, (wheel->now_tick >> shift) & SLOT_MASK);
+				if((wheel->now_tick >> shift) & SLOT_MASK)
+					break;
+			}
+		}
+
+		if(wheel->occupied[0]){
+			_fire(wheel);
+			wheel->now_tick++;
+		}
+		else{
+			/* nothing on the first wheel, so nothing can happen until the next cascade */
+			next_turn = (wheel->now_tick | SLOT_MASK) + 1;
+			wheel->now_tick = next_turn <= target ? next_turn : target+1;
+		}
+	}
+}
+
+void timer_wheel_run(timer_wheel_t wheel){
+	uint64_t expirations;
+	if(read(wheel->timer_fd, &expirations, sizeof(uint64_t)) < 0 && errno != EAGAIN)
+		perror("timer_wheel read timerfd");
+
+	pthread_mutex_lock(&(wheel->mutex));
+	_advance(wheel, _current_tick(wheel));
+	/* whatever timerfd was set to has happened, so make sure it gets set again */
+	wheel->programmed = NEVER-1;
+	_program(wheel);
+	pthread_mutex_unlock(&(wheel->mutex));
+}
+
+int timer_wheel_get_fd(timer_wheel_t wheel){
+	return wheel->timer_fd;
+}
+
+timer_wheel_t timer_wheel_init(){
+	timer_wheel_t wheel = (timer_wheel_t)malloc(sizeof(struct timer_wheel));
+	memset(wheel->slots, 0, sizeof(wheel->slots));
+	memset(wheel->occupied, 0, sizeof(wheel->occupied));
+	wheel->now_tick = 0;
+	clock_gettime(CLOCK_MONOTONIC, &(wheel->base));
+	wheel->programmed = NEVER;
+	wheel->running = NULL;
+
+	wheel->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if(wheel->timer_fd < 0){
+		perror("timerfd_create");
+		free(wheel);
+		return NULL;
+	}
+
+	pthread_mutex_init(&(wheel->mutex), NULL);
+	pthread_cond_init(&(wheel->done_running), NULL);
+	return wheel;
+}
+
+/* doesn't touch the timers -- they belong to whoever made them */
+void timer_wheel_destroy(timer_wheel_t* wheel){
+	close((*wheel)->timer_fd);
+	pthread_mutex_destroy(&((*wheel)->mutex));
+	pthread_cond_destroy(&((*wheel)->done_running));
+	free(*wheel);
+	*wheel = NULL;
+}
+
+/********************** TIMERS **********************/
+
+wheel_timer_t wheel_timer_init(timer_wheel_t wheel, wheel_timer_f callback, void* arg){
+	wheel_timer_t timer = (wheel_timer_t)malloc(sizeof(struct wheel_timer));
+	timer->prev = timer->next = NULL;
+	timer->armed = 0;
+	timer->callback = callback;
+	timer->arg = arg;
+	timer->wheel = wheel;
+	return timer;
+}
+
+void wheel_timer_destroy(wheel_timer_t* timer){
+	wheel_timer_cancel(*timer);
+	free(*timer);
+	*timer = NULL;
+}
+
+void wheel_timer_arm(wheel_timer_t timer, double secs){
+	timer_wheel_t wheel = timer->wheel;
+	/* rounded up, and then one more since we're already partway through the current tick -- so it never
+		goes off early, and a callback re-arming itself can't keep the wheel on the same tick forever */
+	uint64_t ticks = secs > 0 ? (uint64_t)(secs*1000/TIMER_WHEEL_TICK_MS) + 1 : 1;
+
+	pthread_mutex_lock(&(wheel->mutex));
+	if(timer->armed)
+		_unlink(wheel, timer);
+	timer->expires = _current_tick(wheel) + ticks;
+	_link(wheel, timer);
+	_program(wheel);
+	pthread_mutex_unlock(&(wheel->mutex));
+}
+
+void wheel_timer_cancel(wheel_timer_t timer){
+	timer_wheel_t wheel = timer->wheel;
+
+	pthread_mutex_lock(&(wheel->mutex));
+	if(timer->armed)
+		_unlink(wheel, timer);
+	while(wheel->running == timer && !pthread_equal(wheel->runner, pthread_self()))
+		pthread_cond_wait(&(wheel->done_running), &(wheel->mutex));
+	pthread_mutex_unlock(&(wheel->mutex));
+}